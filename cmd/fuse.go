@@ -6,11 +6,13 @@ import (
 	"os"
 	"os/signal"
 	"flag"
+	"time"
 
 	"bazil.org/fuse"
 
 	"github.com/msg555/hcas/fusefs"
 	"github.com/msg555/hcas/hcas"
+	"github.com/msg555/hcas/hcasfs"
 	"github.com/msg555/hcas/unix"
 )
 
@@ -36,9 +38,75 @@ func getRootObject(hcasRootDir string, hcasRootLabel string) ([]byte, error) {
 	return []byte(name.Name()), nil
 }
 
+func withSession(hcasRootDir string, fn func(hcas.Hcas, hcas.Session) error) error {
+	h, err := hcas.OpenHcas(hcasRootDir)
+	if err != nil {
+		return err
+	}
+	defer h.Close()
+
+	s, err := h.CreateSession()
+	if err != nil {
+		return err
+	}
+	defer s.Close()
+
+	return fn(h, s)
+}
+
+// Prefetch the objects in the access trace previously recorded for the label.
+func prefetchTrace(hcasRootDir string, hcasRootLabel string, workers int) error {
+	return withSession(hcasRootDir, func(h hcas.Hcas, s hcas.Session) error {
+		names, err := hcasfs.LoadTrace(h, s, hcasRootLabel)
+		if err != nil {
+			return err
+		}
+		if names == nil {
+			log.Print("No access trace recorded for ", hcasRootLabel)
+			return nil
+		}
+
+		start := time.Now()
+		failures := hcasfs.PrefetchObjects(h, names, workers)
+		log.Printf("Prefetched %d traced objects in %s (%d failed)",
+			len(names), time.Since(start), failures)
+		return nil
+	})
+}
+
+func saveTrace(hcasRootDir string, hcasRootLabel string, names []hcas.Name) error {
+	return withSession(hcasRootDir, func(h hcas.Hcas, s hcas.Session) error {
+		name, err := hcasfs.SaveTrace(s, hcasRootLabel, names)
+		if err != nil {
+			return err
+		}
+		log.Printf("Saved access trace of %d objects to %s", len(names), name.HexName())
+		return nil
+	})
+}
+
+func logStats(hm *fusefs.HcasMount) {
+	stats := hm.Stats()
+	log.Printf("Requests: %d in flight of %d workers, at most %d at once, %d handled",
+		stats.Requests.InFlight, stats.Requests.Workers, stats.Requests.PeakInFlight, stats.Requests.Handled)
+	log.Printf("Object file cache: %d open, %d hits, %d misses, %d evictions",
+		stats.Files.Open, stats.Files.Hits, stats.Files.Misses, stats.Files.Evictions)
+	log.Printf("Directory cache: %d directories using %d bytes, %d hits, %d misses, %d evictions, %d too large",
+		stats.Dirs.Dirs, stats.Dirs.Bytes, stats.Dirs.Hits, stats.Dirs.Misses, stats.Dirs.Evictions,
+		stats.Dirs.Bypassed)
+}
+
 func main() {
 	flagSet := flag.NewFlagSet("hcas-fuse", flag.ExitOnError)
 	flagAllowOther := flagSet.Bool("allow-other", false, "Allow others to see mount")
+	flagRecordTrace := flagSet.Duration("record-trace", 0, "Record objects accessed in this window after mount and save the trace on unmount")
+	flagTraceMaxEntries := flagSet.Int("trace-max-entries", 65536, "Maximum number of objects to record in a trace")
+	flagPrefetchTrace := flagSet.Bool("prefetch-trace", false, "Prefetch the objects of the access trace recorded for the image")
+	flagPrefetchWorkers := flagSet.Int("prefetch-workers", 8, "Number of objects to prefetch in parallel")
+	flagMaxOpenFiles := flagSet.Int("max-open-files", fusefs.MAX_OPEN_FILES_DEFAULT, "Maximum number of object files to keep open between requests")
+	flagDirCacheBytes := flagSet.Int64("dir-cache-bytes", fusefs.DIR_CACHE_BYTES_DEFAULT, "Approximate memory to use for caching decoded directories")
+	flagWorkers := flagSet.Int("workers", 0, "Number of requests to handle in parallel, defaults to GOMAXPROCS")
+	flagStatsInterval := flagSet.Duration("stats-interval", 0, "Log mount stats at this interval while mounted, 0 only logs them at unmount")
 	flagSet.Parse(os.Args[1:])
 
 	args := flagSet.Args()
@@ -62,15 +130,46 @@ func main() {
 		options = append(options, fuse.AllowOther())
 	}
 
-	hm, err := fusefs.CreateServer(mountPoint, hcasRootDir, hcasRootName, options...)
+	hm, err := fusefs.CreateServer(mountPoint, hcasRootDir, hcasRootName, *flagWorkers, options...)
 	if err != nil {
 		log.Fatal("failed to create mount", err)
 	}
 
+	hm.SetMaxOpenFiles(*flagMaxOpenFiles)
+	hm.SetDirCacheBytes(*flagDirCacheBytes)
+	if *flagRecordTrace > 0 {
+		hm.StartTrace(*flagRecordTrace, *flagTraceMaxEntries)
+	}
+	if *flagPrefetchTrace {
+		go func() {
+			err := prefetchTrace(hcasRootDir, hcasRootLabel, *flagPrefetchWorkers)
+			if err != nil {
+				log.Print("failed to prefetch access trace: ", err)
+			}
+		}()
+	}
+
+	if *flagStatsInterval > 0 {
+		go func() {
+			for range time.Tick(*flagStatsInterval) {
+				logStats(hm)
+			}
+		}()
+	}
+
 	sigs := make(chan os.Signal, 1)
 	signal.Notify(sigs, unix.SIGINT, unix.SIGTERM)
 	fmt.Println("signal received: ", <-sigs)
 
+	if *flagRecordTrace > 0 {
+		err = saveTrace(hcasRootDir, hcasRootLabel, hm.TraceNames())
+		if err != nil {
+			log.Print("failed to save access trace: ", err)
+		}
+	}
+
+	logStats(hm)
+
 	err = hm.Close()
 	if err != nil {
 		log.Fatal("Could not unmount:", err)
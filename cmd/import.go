@@ -1,6 +1,7 @@
 package main
 
 import (
+	"flag"
 	"fmt"
 	"log"
 	"os"
@@ -11,6 +12,16 @@ import (
 )
 
 func main() {
+	flagSet := flag.NewFlagSet("hcas-import", flag.ExitOnError)
+	options := hcasfs.DefaultDirBuildOptions()
+	options.RegisterFlags(flagSet)
+	flagSet.Parse(os.Args[1:])
+
+	args := flagSet.Args()
+	if len(args) != 2 {
+		log.Fatal("Usage: import [flags] <path> <label_name>")
+	}
+
 	h, err := hcas.CreateHcas("test-hcas")
 	if err != nil {
 		log.Fatal("failed to initialize hcas: ", err)
@@ -20,7 +31,7 @@ func main() {
 	session, err := h.CreateSession()
 	defer session.Close()
 
-	name, err := hcasfs.ImportPath(session, os.Args[1])
+	name, err := hcasfs.ImportPathWithOptions(session, args[0], options)
 	if err != nil {
 		gerr, ok := err.(*errors.Error)
 		if ok {
@@ -31,7 +42,7 @@ func main() {
 	}
 	fmt.Printf("imported path to %s\n", name.HexName())
 
-	err = session.SetLabel("image", os.Args[2], name)
+	err = session.SetLabel("image", args[1], name)
 	if err != nil {
 		log.Fatal("Could not set label: ", err)
 	}
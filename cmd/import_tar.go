@@ -2,6 +2,7 @@ package main
 
 import (
 	"compress/gzip"
+	"flag"
 	"fmt"
 	"io"
 	"log"
@@ -28,13 +29,19 @@ func startTrace() (func(), error) {
 }
 
 func main() {
-	if len(os.Args) != 4 {
-		log.Fatal("Usage: import_tar <hcas_path> <tar_file> <label_name>")
+	flagSet := flag.NewFlagSet("hcas-import-tar", flag.ExitOnError)
+	options := hcasfs.DefaultDirBuildOptions()
+	options.RegisterFlags(flagSet)
+	flagSet.Parse(os.Args[1:])
+
+	args := flagSet.Args()
+	if len(args) != 3 {
+		log.Fatal("Usage: import_tar [flags] <hcas_path> <tar_file> <label_name>")
 	}
 
-	hcasFilePath := os.Args[1]
-	tarFilePath := os.Args[2]
-	labelName := os.Args[3]
+	hcasFilePath := args[0]
+	tarFilePath := args[1]
+	labelName := args[2]
 
 	// Create or open HCAS instance
 	h, err := hcas.CreateHcas(hcasFilePath)
@@ -77,7 +84,7 @@ func main() {
 
 	// Import tar contents
 	fmt.Printf("Importing tar archive...\n")
-	name, err := hcasfs.ImportTar(session, reader)
+	name, err := hcasfs.ImportTarWithOptions(session, reader, options)
 	if err != nil {
 		gerr, ok := err.(*errors.Error)
 		if ok {
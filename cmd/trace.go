@@ -0,0 +1,67 @@
+package main
+
+import (
+	"fmt"
+	"log"
+	"os"
+
+	"github.com/msg555/hcas/hcas"
+	"github.com/msg555/hcas/hcasfs"
+)
+
+// Manage access traces recorded by the hcasfs kernel module.
+//
+//	trace save hcas_root image_label trace_file
+//	    Store a trace read from a mount's debugfs trace file for the image.
+//	trace name hcas_root image_label
+//	    Print the object name to pass as the prefetch_trace mount option.
+func main() {
+	if len(os.Args) != 5 && len(os.Args) != 4 {
+		log.Fatal("Usage: trace save hcas_root image_label trace_file | trace name hcas_root image_label")
+	}
+
+	h, err := hcas.OpenHcas(os.Args[2])
+	if err != nil {
+		log.Fatal("failed to open hcas: ", err)
+	}
+	defer h.Close()
+
+	session, err := h.CreateSession()
+	if err != nil {
+		log.Fatal("failed to create session: ", err)
+	}
+	defer session.Close()
+
+	label := os.Args[3]
+	switch {
+	case os.Args[1] == "save" && len(os.Args) == 5:
+		data, err := os.ReadFile(os.Args[4])
+		if err != nil {
+			log.Fatal("failed to read trace: ", err)
+		}
+
+		names, err := hcasfs.DecodeTrace(data)
+		if err != nil {
+			log.Fatal("failed to decode trace: ", err)
+		}
+
+		name, err := hcasfs.SaveTrace(session, label, names)
+		if err != nil {
+			log.Fatal("failed to save trace: ", err)
+		}
+		fmt.Printf("saved trace of %d objects to %s\n", len(names), name.HexName())
+
+	case os.Args[1] == "name" && len(os.Args) == 4:
+		name, err := session.GetLabel(hcasfs.TraceLabelNamespace, label)
+		if err != nil {
+			log.Fatal("failed to get trace label: ", err)
+		}
+		if name == nil {
+			log.Fatal("no trace recorded for ", label)
+		}
+		fmt.Println(name.HexName())
+
+	default:
+		log.Fatal("Usage: trace save hcas_root image_label trace_file | trace name hcas_root image_label")
+	}
+}
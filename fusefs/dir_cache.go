@@ -0,0 +1,201 @@
+package fusefs
+
+import (
+	"container/list"
+	"sync"
+	"unsafe"
+
+	"github.com/msg555/hcas/hcas"
+	"github.com/msg555/hcas/hcasfs"
+)
+
+const DIR_CACHE_BYTES_DEFAULT = 64 << 20
+
+// Only directories estimated to use at most this fraction of the cache are
+// decoded, so one large directory cannot flush every other hot entry.
+// Larger directories are served from their mapped DirView.
+const dirCacheMaxFraction = 8
+
+// Number of directories remembered as too large to cache before the set is
+// reset.
+const dirCacheMaxOversize = 4096
+
+// Approximate memory held by a cached entry beyond its name and inline data,
+// covering the entry itself, its object name and its slot in the name map.
+const dirEntryOverhead = int64(unsafe.Sizeof(hcasfs.DirEntry{})) + 32 + 48
+
+// A directory decoded into memory. Decoded directories are immutable and may
+// still be used after they are evicted.
+type decodedDir struct {
+	name    hcas.Name
+	entries []hcasfs.DirEntry
+	byName  map[string]int
+	size    int64
+	lruElem *list.Element
+}
+
+// A cache of decoded directories keyed by object name, bounded by the
+// approximate memory held by the cached directories.
+type dirCache struct {
+	lock     sync.Mutex
+	maxBytes int64
+	bytes    int64
+	dirs     map[hcas.Name]*decodedDir
+	// Cached directories, the most recently used at the front.
+	lru list.List
+	// Directories that turned out too large to cache once decoded.
+	oversize map[hcas.Name]struct{}
+
+	hits      uint64
+	misses    uint64
+	evictions uint64
+	bypassed  uint64
+}
+
+// Counters of the decoded directory cache, see HcasMount.DirCacheStats.
+type DirCacheStats struct {
+	// Directories currently cached and the memory they hold.
+	Dirs      int
+	Bytes     int64
+	MaxBytes  int64
+	Hits      uint64
+	Misses    uint64
+	Evictions uint64
+	// Lookups of directories too large to cache.
+	Bypassed uint64
+}
+
+func newDirCache(maxBytes int64) *dirCache {
+	return &dirCache{
+		maxBytes: maxBytes,
+		dirs:     make(map[hcas.Name]*decodedDir),
+		oversize: make(map[hcas.Name]struct{}),
+	}
+}
+
+// Decode every entry of a mapped directory, following shards. Returns nil if
+// the decoded directory would hold more than limit bytes.
+func decodeDir(open hcasfs.DirViewOpener, name *hcas.Name, md *mappedDir, limit int64) (*decodedDir, error) {
+	count := md.view.Header.EntryCount
+	dir := &decodedDir{
+		name:    *name,
+		entries: make([]hcasfs.DirEntry, 0, count),
+		byName:  make(map[string]int, count),
+	}
+
+	err := hcasfs.WalkDirView(open, &md.view, 0, func(rec *hcasfs.DirRecord) bool {
+		entry := rec.DirEntry()
+		dir.byName[entry.FileName] = len(dir.entries)
+		dir.entries = append(dir.entries, entry)
+		dir.size += dirEntryOverhead + int64(len(entry.FileName)+len(entry.Inode.InlineData))
+		return dir.size <= limit
+	})
+	if err != nil {
+		return nil, err
+	}
+	if dir.size > limit {
+		return nil, nil
+	}
+	return dir, nil
+}
+
+func (dc *dirCache) get(name *hcas.Name) *decodedDir {
+	dc.lock.Lock()
+	defer dc.lock.Unlock()
+
+	dir := dc.dirs[*name]
+	if dir == nil {
+		dc.misses++
+		return nil
+	}
+	dc.hits++
+	dc.lru.MoveToFront(dir.lruElem)
+	return dir
+}
+
+// Largest decoded directory worth caching, must be called with lock held.
+func (dc *dirCache) limit() int64 {
+	return dc.maxBytes / dirCacheMaxFraction
+}
+
+// Returns the byte limit to decode the named directory with, or 0 if it
+// should be served from its mapped object. count and dataSize are the entry
+// count and object size of the directory; for unsharded directories the
+// estimate is an upper bound.
+func (dc *dirCache) decodeLimit(name *hcas.Name, count uint32, dataSize int) int64 {
+	dc.lock.Lock()
+	defer dc.lock.Unlock()
+
+	_, oversize := dc.oversize[*name]
+	if oversize || int64(count)*dirEntryOverhead+int64(dataSize) > dc.limit() {
+		dc.bypassed++
+		return 0
+	}
+	return dc.limit()
+}
+
+// Remember a directory that exceeded the limit once decoded so it is not
+// decoded again.
+func (dc *dirCache) markOversize(name *hcas.Name) {
+	dc.lock.Lock()
+	defer dc.lock.Unlock()
+
+	if len(dc.oversize) >= dirCacheMaxOversize {
+		clear(dc.oversize)
+	}
+	dc.oversize[*name] = struct{}{}
+}
+
+// Add a decoded directory to the cache, returning the cached copy if another
+// request added the same directory first.
+func (dc *dirCache) add(dir *decodedDir) *decodedDir {
+	dc.lock.Lock()
+	defer dc.lock.Unlock()
+
+	if cached := dc.dirs[dir.name]; cached != nil {
+		return cached
+	}
+	if dir.size > dc.limit() {
+		return dir
+	}
+
+	dir.lruElem = dc.lru.PushFront(dir)
+	dc.dirs[dir.name] = dir
+	dc.bytes += dir.size
+	dc.evict()
+	return dir
+}
+
+// Drop the least recently used directories until the cache is within its
+// limit, must be called with lock held.
+func (dc *dirCache) evict() {
+	for dc.bytes > dc.maxBytes {
+		dir := dc.lru.Remove(dc.lru.Back()).(*decodedDir)
+		delete(dc.dirs, dir.name)
+		dc.bytes -= dir.size
+		dc.evictions++
+	}
+}
+
+func (dc *dirCache) setMaxBytes(maxBytes int64) {
+	dc.lock.Lock()
+	defer dc.lock.Unlock()
+
+	dc.maxBytes = maxBytes
+	dc.evict()
+}
+
+func (dc *dirCache) stats() DirCacheStats {
+	dc.lock.Lock()
+	defer dc.lock.Unlock()
+
+	return DirCacheStats{
+		Dirs:      len(dc.dirs),
+		Bytes:     dc.bytes,
+		MaxBytes:  dc.maxBytes,
+		Hits:      dc.hits,
+		Misses:    dc.misses,
+		Evictions: dc.evictions,
+		Bypassed:  dc.bypassed,
+	}
+}
@@ -0,0 +1,149 @@
+package fusefs
+
+import (
+	"fmt"
+	"strings"
+	"testing"
+
+	"github.com/msg555/hcas/hcas"
+	"github.com/msg555/hcas/hcasfs"
+	"github.com/msg555/hcas/unix"
+)
+
+func testDirName(i int) hcas.Name {
+	return hcas.NewName(fmt.Sprintf("%032d", i))
+}
+
+func testDecodedDir(i int, size int64) *decodedDir {
+	return &decodedDir{name: testDirName(i), size: size}
+}
+
+// Returns which of the first count test directories are cached.
+func cachedDirs(dc *dirCache, count int) []bool {
+	dc.lock.Lock()
+	defer dc.lock.Unlock()
+
+	cached := make([]bool, count)
+	for i := range cached {
+		_, cached[i] = dc.dirs[testDirName(i)]
+	}
+	return cached
+}
+
+func TestDirCacheAccounting(t *testing.T) {
+	dc := newDirCache(8000)
+	for i := 0; i < 3; i++ {
+		dir := testDecodedDir(i, 100*int64(i+1))
+		if dc.add(dir) != dir {
+			t.Fatal("add did not return the added directory")
+		}
+	}
+
+	// Adding a directory that is already cached keeps the first copy.
+	name := testDirName(1)
+	first := dc.get(&name)
+	if dc.add(testDecodedDir(1, 200)) != first {
+		t.Error("add replaced a cached directory")
+	}
+	stats := dc.stats()
+	if stats.Dirs != 3 || stats.Bytes != 600 || stats.Hits != 1 {
+		t.Errorf("Expected 3 directories of 600 bytes, got %+v", stats)
+	}
+}
+
+func TestDirCacheEvictionOrder(t *testing.T) {
+	// Each directory uses the largest size allowed, so the cache holds 8.
+	dc := newDirCache(800)
+	for i := 0; i < 8; i++ {
+		dc.add(testDecodedDir(i, 100))
+	}
+
+	// Touch directory 0 so directory 1 is the least recently used.
+	name := testDirName(0)
+	if dc.get(&name) == nil {
+		t.Fatal("Directory 0 not cached")
+	}
+	dc.add(testDecodedDir(8, 100))
+	dc.add(testDecodedDir(9, 100))
+
+	cached := cachedDirs(dc, 10)
+	for i, want := range []bool{true, false, false, true, true, true, true, true, true, true} {
+		if cached[i] != want {
+			t.Errorf("Directory %d cached=%v, expected %v", i, cached[i], want)
+		}
+	}
+	stats := dc.stats()
+	if stats.Bytes != 800 || stats.Evictions != 2 {
+		t.Errorf("Expected 800 bytes after 2 evictions, got %+v", stats)
+	}
+}
+
+func TestDirCacheSetMaxBytes(t *testing.T) {
+	dc := newDirCache(800)
+	for i := 0; i < 8; i++ {
+		dc.add(testDecodedDir(i, 100))
+	}
+
+	dc.setMaxBytes(300)
+	cached := cachedDirs(dc, 8)
+	for i := range cached {
+		if cached[i] != (i >= 5) {
+			t.Errorf("Directory %d cached=%v after shrinking", i, cached[i])
+		}
+	}
+	if stats := dc.stats(); stats.Bytes != 300 || stats.Evictions != 5 {
+		t.Errorf("Expected 300 bytes after 5 evictions, got %+v", stats)
+	}
+}
+
+func TestDirCacheOversize(t *testing.T) {
+	dc := newDirCache(8000)
+
+	// Directories over an eighth of the cache are never cached.
+	dir := testDecodedDir(0, 1001)
+	if dc.add(dir) != dir || dc.stats().Dirs != 0 {
+		t.Error("Oversize directory was cached")
+	}
+
+	name := testDirName(1)
+	if limit := dc.decodeLimit(&name, 1000, 0); limit != 0 {
+		t.Errorf("Directory estimated over the limit decoded with limit %d", limit)
+	}
+	if limit := dc.decodeLimit(&name, 1, 100); limit != 1000 {
+		t.Errorf("Expected a decode limit of 1000, got %d", limit)
+	}
+	dc.markOversize(&name)
+	if limit := dc.decodeLimit(&name, 1, 100); limit != 0 {
+		t.Errorf("Directory marked oversize decoded with limit %d", limit)
+	}
+	if stats := dc.stats(); stats.Bypassed != 2 {
+		t.Errorf("Expected 2 bypassed lookups, got %+v", stats)
+	}
+}
+
+func TestDecodeDirLimit(t *testing.T) {
+	builder := hcasfs.CreateDirBuilder()
+	for i := 0; i < 100; i++ {
+		inode := &hcasfs.InodeData{Mode: unix.S_IFIFO | 0o644}
+		builder.Insert(fmt.Sprintf("entry-%d", i), inode, 1)
+	}
+
+	md := &mappedDir{data: builder.Build()}
+	if err := md.view.Reset(md.data); err != nil {
+		t.Fatalf("Reset failed: %v", err)
+	}
+
+	name := hcas.NewName(strings.Repeat("d", 32))
+	dir, err := decodeDir(nil, &name, md, 1<<20)
+	if err != nil || dir == nil {
+		t.Fatalf("decodeDir failed: %v", err)
+	}
+	if len(dir.entries) != 100 || dir.entries[dir.byName["entry-42"]].FileName != "entry-42" {
+		t.Error("decodeDir returned the wrong entries")
+	}
+
+	dir, err = decodeDir(nil, &name, md, dir.size-1)
+	if err != nil || dir != nil {
+		t.Errorf("decodeDir over the limit returned %v, %v", dir, err)
+	}
+}
@@ -0,0 +1,145 @@
+package fusefs
+
+import (
+	"container/list"
+	"os"
+	"sync"
+
+	"github.com/msg555/hcas/hcas"
+)
+
+const MAX_OPEN_FILES_DEFAULT = 1024
+
+// A bounded cache of open object files shared by every request that reads
+// objects. Files in use are never closed. Once released they stay open in LRU
+// order until more than maxOpen files are open. Cached files are shared so
+// they must only be read with ReadAt.
+type fileCache struct {
+	open func(name *hcas.Name) (*os.File, error)
+
+	lock    sync.Mutex
+	maxOpen int
+	files   map[hcas.Name]*cachedFile
+	// Released files, the most recently used at the front.
+	idle list.List
+
+	hits      uint64
+	misses    uint64
+	evictions uint64
+}
+
+type cachedFile struct {
+	*os.File
+	name     hcas.Name
+	refs     int
+	idleElem *list.Element
+}
+
+// Counters of the open object file cache, see HcasMount.FileCacheStats.
+type FileCacheStats struct {
+	// Object files currently open, including those in use.
+	Open int
+	// Limit on open files, only exceeded while more files are in use.
+	MaxOpen   int
+	Hits      uint64
+	Misses    uint64
+	Evictions uint64
+}
+
+func newFileCache(maxOpen int, open func(name *hcas.Name) (*os.File, error)) *fileCache {
+	return &fileCache{
+		open:    open,
+		maxOpen: maxOpen,
+		files:   make(map[hcas.Name]*cachedFile),
+	}
+}
+
+// Returns an open file for the named object. The file must be passed to
+// release once the caller is done with it.
+func (fc *fileCache) acquire(name *hcas.Name) (*cachedFile, error) {
+	fc.lock.Lock()
+	cf := fc.use(name)
+	if cf != nil {
+		fc.hits++
+		fc.lock.Unlock()
+		return cf, nil
+	}
+	fc.misses++
+	fc.lock.Unlock()
+
+	f, err := fc.open(name)
+	if err != nil {
+		return nil, err
+	}
+
+	fc.lock.Lock()
+	defer fc.lock.Unlock()
+
+	// Another request may have opened the same object in the meantime.
+	if cf := fc.use(name); cf != nil {
+		f.Close()
+		return cf, nil
+	}
+
+	cf = &cachedFile{File: f, name: *name, refs: 1}
+	fc.files[*name] = cf
+	fc.evict()
+	return cf, nil
+}
+
+// Take a reference to a cached file, must be called with lock held.
+func (fc *fileCache) use(name *hcas.Name) *cachedFile {
+	cf := fc.files[*name]
+	if cf == nil {
+		return nil
+	}
+	if cf.idleElem != nil {
+		fc.idle.Remove(cf.idleElem)
+		cf.idleElem = nil
+	}
+	cf.refs++
+	return cf
+}
+
+func (fc *fileCache) release(cf *cachedFile) {
+	fc.lock.Lock()
+	defer fc.lock.Unlock()
+
+	cf.refs--
+	if cf.refs == 0 {
+		cf.idleElem = fc.idle.PushFront(cf)
+		fc.evict()
+	}
+}
+
+// Close idle files until at most maxOpen files are open, must be called with
+// lock held.
+func (fc *fileCache) evict() {
+	for len(fc.files) > fc.maxOpen && fc.idle.Len() > 0 {
+		cf := fc.idle.Remove(fc.idle.Back()).(*cachedFile)
+		delete(fc.files, cf.name)
+		cf.Close()
+		fc.evictions++
+	}
+}
+
+func (fc *fileCache) setMaxOpen(maxOpen int) {
+	fc.lock.Lock()
+	defer fc.lock.Unlock()
+
+	fc.maxOpen = maxOpen
+	fc.evict()
+}
+
+func (fc *fileCache) stats() FileCacheStats {
+	fc.lock.Lock()
+	defer fc.lock.Unlock()
+
+	return FileCacheStats{
+		Open:      len(fc.files),
+		MaxOpen:   fc.maxOpen,
+		Hits:      fc.hits,
+		Misses:    fc.misses,
+		Evictions: fc.evictions,
+	}
+}
@@ -0,0 +1,141 @@
+package fusefs
+
+import (
+	"errors"
+	"os"
+	"path/filepath"
+	"strings"
+	"testing"
+
+	"github.com/msg555/hcas/hcas"
+)
+
+// Create a file cache over objects in a temporary directory, counting the
+// files it opens.
+func newTestFileCache(t *testing.T, maxOpen int, count int) (*fileCache, []hcas.Name, *int) {
+	dir := t.TempDir()
+	names := make([]hcas.Name, count)
+	for i := range names {
+		names[i] = hcas.NewName(strings.Repeat(string(rune('a'+i)), 32))
+		err := os.WriteFile(filepath.Join(dir, names[i].HexName()), []byte{byte(i)}, 0o644)
+		if err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	opens := 0
+	fc := newFileCache(maxOpen, func(name *hcas.Name) (*os.File, error) {
+		opens++
+		return os.Open(filepath.Join(dir, name.HexName()))
+	})
+	return fc, names, &opens
+}
+
+func isClosed(f *cachedFile) bool {
+	var buf [1]byte
+	_, err := f.ReadAt(buf[:], 0)
+	return errors.Is(err, os.ErrClosed)
+}
+
+func TestFileCacheReuse(t *testing.T) {
+	fc, names, opens := newTestFileCache(t, 4, 1)
+
+	first, err := fc.acquire(&names[0])
+	if err != nil {
+		t.Fatalf("acquire failed: %v", err)
+	}
+	second, err := fc.acquire(&names[0])
+	if err != nil {
+		t.Fatalf("acquire failed: %v", err)
+	}
+	if first.File != second.File {
+		t.Error("Second acquire did not reuse the open file")
+	}
+	fc.release(first)
+	fc.release(second)
+
+	third, err := fc.acquire(&names[0])
+	if err != nil {
+		t.Fatalf("acquire failed: %v", err)
+	}
+	if third.File != first.File || isClosed(third) {
+		t.Error("Released file was not kept open for reuse")
+	}
+	fc.release(third)
+
+	stats := fc.stats()
+	if *opens != 1 || stats.Hits != 2 || stats.Misses != 1 {
+		t.Errorf("Expected 1 open with 2 hits and 1 miss, got %d opens %+v", *opens, stats)
+	}
+}
+
+func TestFileCacheEvictInUse(t *testing.T) {
+	fc, names, _ := newTestFileCache(t, 1, 2)
+
+	held, err := fc.acquire(&names[0])
+	if err != nil {
+		t.Fatalf("acquire failed: %v", err)
+	}
+
+	// Shrinking the cache must not close a file that is still in use.
+	fc.setMaxOpen(0)
+	if isClosed(held) {
+		t.Fatal("File in use was closed by eviction")
+	}
+	if stats := fc.stats(); stats.Open != 1 || stats.Evictions != 0 {
+		t.Errorf("Expected the file in use to stay open, got %+v", stats)
+	}
+
+	// It is closed by the last release once over the limit.
+	again, err := fc.acquire(&names[0])
+	if err != nil {
+		t.Fatalf("acquire failed: %v", err)
+	}
+	fc.release(held)
+	if isClosed(again) {
+		t.Fatal("File closed while still referenced")
+	}
+	fc.release(again)
+	if !isClosed(again) {
+		t.Error("File not closed on last release after eviction")
+	}
+	if stats := fc.stats(); stats.Open != 0 || stats.Evictions != 1 {
+		t.Errorf("Expected the file to be evicted, got %+v", stats)
+	}
+}
+
+func TestFileCacheLimit(t *testing.T) {
+	fc, names, opens := newTestFileCache(t, 2, 5)
+
+	files := make([]*cachedFile, len(names))
+	for i := range names {
+		f, err := fc.acquire(&names[i])
+		if err != nil {
+			t.Fatalf("acquire failed: %v", err)
+		}
+		files[i] = f
+		fc.release(f)
+	}
+
+	stats := fc.stats()
+	if stats.Open != 2 || stats.Evictions != 3 {
+		t.Errorf("Expected 2 open files after 3 evictions, got %+v", stats)
+	}
+
+	// The least recently used files are the ones closed.
+	for i, f := range files {
+		if closed := isClosed(f); closed != (i < 3) {
+			t.Errorf("File %d closed=%v", i, closed)
+		}
+	}
+	for _, i := range []int{3, 4} {
+		f, err := fc.acquire(&names[i])
+		if err != nil {
+			t.Fatalf("acquire failed: %v", err)
+		}
+		fc.release(f)
+	}
+	if *opens != 5 {
+		t.Errorf("Expected recently used files to be reused, got %d opens", *opens)
+	}
+}
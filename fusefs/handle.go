@@ -2,9 +2,7 @@ package fusefs
 
 import (
 	"encoding/binary"
-	"fmt"
 	"io"
-	"os"
 
 	"bazil.org/fuse"
 	"github.com/go-errors/errors"
@@ -19,18 +17,28 @@ type FileHandle interface {
 	Release(*fuse.ReleaseRequest) error
 }
 
+// Handle of a directory, read from the directory cache or, if it is too large
+// to cache, from its mapped object.
 type FileHandleDir struct {
-	nodeFile      *os.File
+	dir           *decodedDir
+	mapped        *mappedDir
 	inodeId       uint64
 	dirEntryCount uint32
-	currentSeek   uint32
+	openDirView   hcasfs.DirViewOpener
 }
 
 type FileHandleReg struct {
-	nodeFile *os.File
+	nodeFile *cachedFile
+	files    *fileCache
 	inodeId  uint64
 }
 
+// Handle of a regular file whose contents are stored inline in its directory
+// record.
+type FileHandleInline struct {
+	data []byte
+}
+
 func (hm *HcasMount) openHandle(handle FileHandle) fuse.HandleID {
 	hm.handleLock.Lock()
 	hm.lastHandleID++
@@ -49,13 +57,18 @@ func (hm *HcasMount) handleOpenRequest(req *fuse.OpenRequest) error {
 	var handleID fuse.HandleID
 	switch inode.Mode & unix.S_IFMT {
 	case unix.S_IFDIR:
-		handle, err := hm.CreateFileHandleDir(uint64(req.Node), inode.ObjName)
+		handle, err := hm.CreateFileHandleDir(uint64(req.Node), inode)
 		if err != nil {
 			return err
 		}
 
 		handleID = hm.openHandle(handle)
 	case unix.S_IFREG:
+		if inode.InlineData != nil {
+			handleID = hm.openHandle(&FileHandleInline{data: inode.InlineData})
+			break
+		}
+
 		handle, err := hm.CreateFileHandleReg(uint64(req.Node), inode.ObjName)
 		if err != nil {
 			return err
@@ -73,41 +86,36 @@ func (hm *HcasMount) handleOpenRequest(req *fuse.OpenRequest) error {
 	return nil
 }
 
-func (hm *HcasMount) CreateFileHandleDir(inodeId uint64, objName *hcas.Name) (*FileHandleDir, error) {
-	f, err := hm.openFileByName(objName)
-	if err != nil {
-		return nil, err
+func (hm *HcasMount) CreateFileHandleDir(inodeId uint64, inode *hcasfs.InodeData) (*FileHandleDir, error) {
+	if inode.InlineData != nil {
+		// Inline directories are empty and have no object to read.
+		return &FileHandleDir{inodeId: inodeId}, nil
 	}
 
-	var header [16]byte
-	err = readAll(f, header[:])
+	dir, mapped, err := hm.openDir(inode.ObjName)
 	if err != nil {
-		f.Close()
 		return nil, err
 	}
 
-	flags := binary.BigEndian.Uint32(header[0:])
-	if flags != 0 {
-		return nil, errors.New("Unknown directory format")
+	handle := &FileHandleDir{
+		dir:         dir,
+		mapped:      mapped,
+		inodeId:     inodeId,
+		openDirView: hm.openDirView,
 	}
-	dirEntries := binary.BigEndian.Uint32(header[4:])
-
-	_, err = f.Seek(int64(16+8*dirEntries), 0)
-	if err != nil {
-		f.Close()
-		return nil, err
+	if dir != nil {
+		handle.dirEntryCount = uint32(len(dir.entries))
+	} else {
+		handle.dirEntryCount = mapped.view.Header.EntryCount
 	}
-
-	return &FileHandleDir{
-		nodeFile:      f,
-		inodeId:       inodeId,
-		dirEntryCount: dirEntries,
-		currentSeek:   0,
-	}, nil
+	return handle, nil
 }
 
 func (fhd *FileHandleDir) Release(req *fuse.ReleaseRequest) error {
-	return fhd.nodeFile.Close()
+	if fhd.mapped == nil {
+		return nil
+	}
+	return fhd.mapped.Close()
 }
 
 func (h *FileHandleDir) Read(req *fuse.ReadRequest) error {
@@ -120,48 +128,50 @@ func (h *FileHandleDir) Read(req *fuse.ReadRequest) error {
 		return nil
 	}
 
-	fmt.Printf("Read seek %d %d\n", req.Offset, h.currentSeek)
-
-	// Someone seek'ed our handle.
-	if uint64(req.Offset) != uint64(h.currentSeek) {
-		_, err := h.nodeFile.Seek(16+8*req.Offset, 0)
-		if err != nil {
-			return err
-		}
-
-		var offsetBuf [4]byte
-		err = readAll(h.nodeFile, offsetBuf[:])
-		if err != nil {
-			return err
-		}
-
-		_, err = h.nodeFile.Seek(int64(binary.BigEndian.Uint32(offsetBuf[:])), 0)
-		if err != nil {
-			return err
+	pos := uint32(req.Offset)
+	bufOffset := 0
+	buf := make([]byte, req.Size)
+	if h.dir != nil {
+		for _, entry := range h.dir.entries[pos:] {
+			size := addDirEntry(
+				buf[bufOffset:],
+				entry.FileName,
+				h.inodeId+entry.ParentDepIndex,
+				uint64(pos+1),
+				entry.Inode.Mode,
+			)
+			if size == 0 {
+				break
+			}
+			bufOffset += size
+			pos++
 		}
 
-		h.currentSeek = uint32(req.Offset)
+		req.Respond(&fuse.ReadResponse{
+			Data: buf[:bufOffset],
+		})
+		return nil
 	}
 
-	bufOffset := 0
-	buf := make([]byte, req.Size)
-	for h.currentSeek < h.dirEntryCount {
-		var dirEntry hcasfs.DirEntry
-		dirEntry.DecodeStream(h.nodeFile)
-
-		inodeId := h.inodeId + dirEntry.ParentDepIndex
+	// Entries are decoded straight out of the mapped directory, following the
+	// shards of sharded directories, until the response buffer is full.
+	err := hcasfs.WalkDirView(h.openDirView, &h.mapped.view, pos, func(rec *hcasfs.DirRecord) bool {
 		size := addDirEntry(
 			buf[bufOffset:],
-			dirEntry.FileName,
-			inodeId,
-			uint64(h.currentSeek+1),
-			dirEntry.Inode.Mode,
+			rec.FileName,
+			h.inodeId+rec.ParentDepIndex,
+			uint64(pos+1),
+			rec.Inode.Mode,
 		)
-		h.currentSeek++
 		if size == 0 {
-			break
+			return false
 		}
 		bufOffset += size
+		pos++
+		return true
+	})
+	if err != nil {
+		return err
 	}
 
 	req.Respond(&fuse.ReadResponse{
@@ -171,19 +181,21 @@ func (h *FileHandleDir) Read(req *fuse.ReadRequest) error {
 }
 
 func (hm *HcasMount) CreateFileHandleReg(inodeId uint64, objName *hcas.Name) (*FileHandleReg, error) {
-	f, err := hm.openFileByName(objName)
+	f, err := hm.acquireFile(objName)
 	if err != nil {
 		return nil, err
 	}
 
 	return &FileHandleReg{
 		nodeFile: f,
+		files:    hm.files,
 		inodeId:  inodeId,
 	}, nil
 }
 
 func (fhr *FileHandleReg) Release(req *fuse.ReleaseRequest) error {
-	return fhr.nodeFile.Close()
+	fhr.files.release(fhr.nodeFile)
+	return nil
 }
 
 func (fhr *FileHandleReg) Read(req *fuse.ReadRequest) error {
@@ -204,6 +216,23 @@ func (fhr *FileHandleReg) Read(req *fuse.ReadRequest) error {
 	return nil
 }
 
+func (fhi *FileHandleInline) Release(req *fuse.ReleaseRequest) error {
+	return nil
+}
+
+func (fhi *FileHandleInline) Read(req *fuse.ReadRequest) error {
+	var data []byte
+	if req.Offset < int64(len(fhi.data)) {
+		data = fhi.data[req.Offset:]
+		if len(data) > req.Size {
+			data = data[:req.Size]
+		}
+	}
+
+	req.Respond(&fuse.ReadResponse{Data: data})
+	return nil
+}
+
 func (hm *HcasMount) handleReleaseRequest(req *fuse.ReleaseRequest) error {
 	hm.handleLock.Lock()
 	handle, ok := hm.handleMap[req.Handle]
@@ -257,15 +286,21 @@ func (hm *HcasMount) handleReadlinkRequest(req *fuse.ReadlinkRequest) error {
 		return err
 	}
 
-	f, err := hm.openFileByName(inode.ObjName)
+	if inode.InlineData != nil {
+		req.Respond(string(inode.InlineData))
+		return nil
+	}
+
+	f, err := hm.acquireFile(inode.ObjName)
 	if err != nil {
 		return err
 	}
+	defer hm.files.release(f)
 
 	buf := make([]byte, unix.PATH_MAX+1)
 	bytesRead := 0
 	for bytesRead < len(buf) {
-		amt, err := f.Read(buf[bytesRead:])
+		amt, err := f.ReadAt(buf[bytesRead:], int64(bytesRead))
 		bytesRead += amt
 		if err == io.EOF {
 			break
@@ -112,16 +112,32 @@ func (hm *HcasMount) handleLookupRequest(req *fuse.LookupRequest) error {
 		return err
 	}
 
-	nodeFile, err := hm.openFileByName(inode.ObjName)
-	if err != nil {
-		return err
+	if inode.InlineData != nil {
+		// Inline directories are empty.
+		return FuseError{
+			source: errors.New("file not found"),
+			errno:  unix.ENOENT,
+		}
 	}
 
-	dirEntry, err := hcasfs.LookupChild(nodeFile, req.Name)
+	dir, mapped, err := hm.openDir(inode.ObjName)
 	if err != nil {
 		return err
 	}
 
+	var dirEntry *hcasfs.DirEntry
+	if dir != nil {
+		if index, ok := dir.byName[req.Name]; ok {
+			dirEntry = &dir.entries[index]
+		}
+	} else {
+		defer mapped.Close()
+		dirEntry, err = hcasfs.LookupChildView(hm.openDirView, &mapped.view, req.Name)
+		if err != nil {
+			return err
+		}
+	}
+
 	if dirEntry == nil {
 		return FuseError{
 			source: errors.New("file not found"),
@@ -1,8 +1,6 @@
 package fusefs
 
 import (
-	"fmt"
-
 	"github.com/msg555/hcas/unix"
 )
 
@@ -22,7 +20,7 @@ func direntAlign(x int) int {
 	return (x + 7) &^ 7
 }
 
-func addDirEntry(buf []byte, name string, inodeId uint64, offset uint64, inodeMode uint32) int {
+func addDirEntry[T string | []byte](buf []byte, name T, inodeId uint64, offset uint64, inodeMode uint32) int {
 	/*
 	   define FUSE_DIRENT_ALIGN(x) (((x) + sizeof(__u64) - 1) & ~(sizeof(__u64) - 1))
 
@@ -41,7 +39,6 @@ func addDirEntry(buf []byte, name string, inodeId uint64, offset uint64, inodeMo
 		return 0
 	}
 
-	fmt.Printf("Yielding %s %d %d\n", name, inodeId, (inodeMode&unix.S_IFMT)>>12)
 	unix.Hbo.PutUint64(buf[0:], inodeId)
 	unix.Hbo.PutUint64(buf[8:], offset)
 	unix.Hbo.PutUint32(buf[16:], uint32(len(name)))
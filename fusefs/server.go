@@ -4,9 +4,12 @@ import (
 	"fmt"
 	"io"
 	"log"
+	"math"
 	"os"
 	"path/filepath"
+	"runtime"
 	"sync"
+	"sync/atomic"
 	"time"
 
 	"bazil.org/fuse"
@@ -46,14 +49,44 @@ type HcasMount struct {
 	handleLock   sync.RWMutex
 	handleMap    map[fuse.HandleID]FileHandle
 	lastHandleID fuse.HandleID
+
+	files *fileCache
+	dirs  *dirCache
+
+	// Records object accesses when set, see StartTrace.
+	trace atomic.Pointer[hcasfs.TraceRecorder]
+
+	// Number of goroutines reading and handling requests.
+	workers  int
+	inFlight atomic.Int64
+	peak     atomic.Int64
+	handled  atomic.Uint64
+}
+
+// Request counters of a mount, see RequestStats.
+type RequestStats struct {
+	// Size of the worker pool. Once InFlight reaches it further requests
+	// wait in the kernel queue.
+	Workers int
+	// Requests currently being handled.
+	InFlight int64
+	// Most requests handled at once since mount.
+	PeakInFlight int64
+	// Requests handled since mount.
+	Handled uint64
 }
 
 func CreateServer(
 	mountPoint string,
 	hcasRootDir string,
 	rootName []byte,
+	workers int,
 	options ...fuse.MountOption,
 ) (*HcasMount, error) {
+	if workers <= 0 {
+		workers = runtime.GOMAXPROCS(0)
+	}
+
 	options = append(
 		options, fuse.Subtype("hcasfs"),
 		fuse.DefaultPermissions(),
@@ -78,10 +111,13 @@ func CreateServer(
 		hcasDataDir: filepath.Join(hcasRootDir, hcas.DataPath),
 		inodeMap:    make(map[fuse.NodeID]*InodeReference),
 		handleMap:   make(map[fuse.HandleID]FileHandle),
+		workers:     workers,
 		rootInode: hcasfs.InodeData{
 			Mode: unix.S_IFDIR | 0o755,
 		},
 	}
+	hcasMount.files = newFileCache(MAX_OPEN_FILES_DEFAULT, hcasMount.openFileByName)
+	hcasMount.dirs = newDirCache(DIR_CACHE_BYTES_DEFAULT)
 	rootNodeName := hcas.NewName(string(rootName))
 	hcasMount.rootInode.ObjName = &rootNodeName
 
@@ -107,17 +143,112 @@ func CreateServer(
 	return hcasMount, nil
 }
 
+// Start recording the order objects are first accessed in for the given
+// window. Any previous trace is discarded.
+func (hm *HcasMount) StartTrace(window time.Duration, maxEntries int) {
+	hm.trace.Store(hcasfs.NewTraceRecorder(window, maxEntries))
+}
+
+// Returns the objects recorded by the current trace, or nil if no trace was
+// started.
+func (hm *HcasMount) TraceNames() []hcas.Name {
+	trace := hm.trace.Load()
+	if trace == nil {
+		return nil
+	}
+	return trace.Names()
+}
+
+// Limit the number of object files kept open between requests.
+func (hm *HcasMount) SetMaxOpenFiles(maxOpen int) {
+	hm.files.setMaxOpen(maxOpen)
+}
+
+// Returns the counters of the open object file cache.
+func (hm *HcasMount) FileCacheStats() FileCacheStats {
+	return hm.files.stats()
+}
+
+// Limit the approximate memory held by decoded directories.
+func (hm *HcasMount) SetDirCacheBytes(maxBytes int64) {
+	hm.dirs.setMaxBytes(maxBytes)
+}
+
+// Returns the counters of the decoded directory cache.
+func (hm *HcasMount) DirCacheStats() DirCacheStats {
+	return hm.dirs.stats()
+}
+
 func (hm *HcasMount) Close() error {
 	return fuse.Unmount(hm.mountPoint)
 }
 
+// Counters of a mount, see HcasMount.Stats.
+type MountStats struct {
+	Requests RequestStats
+	Files    FileCacheStats
+	Dirs     DirCacheStats
+}
+
+// Returns a snapshot of the counters of the mount. Safe to call at any time
+// while the mount is serving requests.
+func (hm *HcasMount) Stats() MountStats {
+	return MountStats{
+		Requests: hm.RequestStats(),
+		Files:    hm.FileCacheStats(),
+		Dirs:     hm.DirCacheStats(),
+	}
+}
+
+// Returns the request counters of the mount.
+func (hm *HcasMount) RequestStats() RequestStats {
+	return RequestStats{
+		Workers:      hm.workers,
+		InFlight:     hm.inFlight.Load(),
+		PeakInFlight: hm.peak.Load(),
+		Handled:      hm.handled.Load(),
+	}
+}
+
+// Serve requests from a fixed pool of workers that each read their next
+// request once the last one is handled. Requests waiting beyond the pool stay
+// queued in the kernel rather than piling up as goroutines. Returns once every
+// worker has stopped, with the first error seen.
 func (hm *HcasMount) serve() error {
+	var wg sync.WaitGroup
+	var errOnce sync.Once
+	var serveErr error
+
+	for i := 0; i < hm.workers; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			err := hm.serveWorker()
+			errOnce.Do(func() { serveErr = err })
+		}()
+	}
+	wg.Wait()
+	return serveErr
+}
+
+func (hm *HcasMount) serveWorker() error {
 	for {
 		req, err := hm.conn.ReadRequest()
 		if err != nil {
 			return err
 		}
-		go hm.handleRequest(req)
+
+		inFlight := hm.inFlight.Add(1)
+		for peak := hm.peak.Load(); inFlight > peak; peak = hm.peak.Load() {
+			if hm.peak.CompareAndSwap(peak, inFlight) {
+				break
+			}
+		}
+
+		hm.handleRequest(req)
+
+		hm.inFlight.Add(-1)
+		hm.handled.Add(1)
 	}
 }
 
@@ -202,3 +333,97 @@ func (hm *HcasMount) openFileByName(name *hcas.Name) (*os.File, error) {
 		nameHex[2:],
 	))
 }
+
+// Returns a shared open file for the named object, which must be released
+// with hm.files.release.
+func (hm *HcasMount) acquireFile(name *hcas.Name) (*cachedFile, error) {
+	hm.recordAccess(name)
+	return hm.files.acquire(name)
+}
+
+func (hm *HcasMount) recordAccess(name *hcas.Name) {
+	if trace := hm.trace.Load(); trace != nil {
+		trace.Record(name)
+	}
+}
+
+// Returns the named directory decoded, through the directory cache. A
+// directory too large to cache is mapped instead and the mapping must be
+// closed by the caller.
+func (hm *HcasMount) openDir(name *hcas.Name) (*decodedDir, *mappedDir, error) {
+	if dir := hm.dirs.get(name); dir != nil {
+		hm.recordAccess(name)
+		return dir, nil, nil
+	}
+
+	md, err := hm.mapDir(name)
+	if err != nil {
+		return nil, nil, err
+	}
+	limit := hm.dirs.decodeLimit(name, md.view.Header.EntryCount, len(md.data))
+	if limit == 0 {
+		return nil, md, nil
+	}
+
+	dir, err := decodeDir(hm.openDirView, name, md, limit)
+	if err != nil {
+		md.Close()
+		return nil, nil, err
+	}
+	if dir == nil {
+		hm.dirs.markOversize(name)
+		return nil, md, nil
+	}
+	md.Close()
+	return hm.dirs.add(dir), nil, nil
+}
+
+// A directory object mapped read-only into memory.
+type mappedDir struct {
+	view hcasfs.DirView
+	data []byte
+}
+
+func (md *mappedDir) Close() error {
+	return unix.Munmap(md.data)
+}
+
+// Map a directory object so it can be decoded without copying.
+func (hm *HcasMount) mapDir(name *hcas.Name) (*mappedDir, error) {
+	f, err := hm.acquireFile(name)
+	if err != nil {
+		return nil, err
+	}
+	defer hm.files.release(f)
+
+	st, err := f.Stat()
+	if err != nil {
+		return nil, err
+	}
+	if st.Size() < 16 || st.Size() > math.MaxUint32 {
+		return nil, errors.New("invalid directory object size")
+	}
+
+	data, err := unix.Mmap(int(f.Fd()), 0, int(st.Size()), unix.PROT_READ, unix.MAP_SHARED)
+	if err != nil {
+		return nil, err
+	}
+
+	md := &mappedDir{data: data}
+	err = md.view.Reset(data)
+	if err != nil {
+		unix.Munmap(data)
+		return nil, err
+	}
+	return md, nil
+}
+
+// Map a directory referenced by a sharded directory, satisfies
+// hcasfs.DirViewOpener.
+func (hm *HcasMount) openDirView(name *hcas.Name) (*hcasfs.DirView, io.Closer, error) {
+	md, err := hm.mapDir(name)
+	if err != nil {
+		return nil, nil, err
+	}
+	return &md.view, md, nil
+}
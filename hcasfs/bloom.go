@@ -0,0 +1,75 @@
+package hcasfs
+
+import (
+	"encoding/binary"
+	"io"
+)
+
+// Directories carry a blocked Bloom filter over the index hashes of their
+// names: each name sets all of its bits in a single 64-bit word so a lookup
+// checks membership with one read. The kernel module implements the same hashing,
+// keep the two in sync.
+const (
+	bloomMaxHashes = 5
+
+	defaultBloomMinEntries   = 32
+	defaultBloomBitsPerEntry = 12
+)
+
+// The murmur3 64-bit finalizer.
+func fmix64(h uint64) uint64 {
+	h ^= h >> 33
+	h *= 0xff51afd7ed558ccd
+	h ^= h >> 33
+	h *= 0xc4ceb9fe1a85ec53
+	h ^= h >> 33
+	return h
+}
+
+// Spread a name hash over 64 bits. The upper half picks the filter word and
+// the lower half the bits within the word.
+func bloomHash(nameHash uint32) uint64 {
+	return fmix64(uint64(nameHash))
+}
+
+func bloomWord(h uint64, words uint32) uint32 {
+	return uint32(((h >> 32) * uint64(words)) >> 32)
+}
+
+func bloomMask(h uint64, hashes uint32) uint64 {
+	var mask uint64
+	for i := uint32(0); i < hashes; i++ {
+		mask |= 1 << ((h >> (6 * i)) & 63)
+	}
+	return mask
+}
+
+// Build the filter words for the given name hashes.
+func buildBloom(nameHashes []uint32, words uint32, hashes uint32) []uint64 {
+	filter := make([]uint64, words)
+	for _, nameHash := range nameHashes {
+		h := bloomHash(nameHash)
+		filter[bloomWord(h, words)] |= bloomMask(h, hashes)
+	}
+	return filter
+}
+
+// Returns false if no name with the given hash is in the directory. A true
+// result may be a false positive.
+func (hdr *DirHeader) bloomContains(dirData io.ReadSeeker, nameHash uint32) (bool, error) {
+	h := bloomHash(nameHash)
+	pos := int64(hdr.BloomOffset) + 8*int64(bloomWord(h, hdr.BloomWords))
+	_, err := dirData.Seek(pos, 0)
+	if err != nil {
+		return false, err
+	}
+
+	var buf [8]byte
+	err = readAll(dirData, buf[:])
+	if err != nil {
+		return false, err
+	}
+
+	mask := bloomMask(h, hdr.BloomHashes)
+	return binary.BigEndian.Uint64(buf[:])&mask == mask, nil
+}
@@ -0,0 +1,161 @@
+package hcasfs
+
+import (
+	"encoding/binary"
+	"io"
+
+	"github.com/go-errors/errors"
+
+	"github.com/msg555/hcas/unix"
+)
+
+// Directories with DirFlagCompactRecords store each record as
+//
+//	uvarint name length, name
+//	uvarint mode
+//	uvarint ParentDepIndex
+//	uvarint uid, uvarint gid
+//	uvarint nlink for directories, dev otherwise
+//	uvarint mtime less the directory's time base
+//	varint atime less mtime, varint ctime less mtime
+//	uvarint size
+//	object name, only for modes with object data, or the inline content of
+//	records with recordModeInline set in their mode
+//
+// without padding. Name, mode and ParentDepIndex come first so that readdir
+// can stop decoding there. The kernel module decodes the same format, keep
+// the two in sync.
+const maxCompactRecordSize = binary.MaxVarintLen32 + unix.NAME_MAX +
+	3*binary.MaxVarintLen32 + 6*binary.MaxVarintLen64 + 32
+
+func (d *DirEntry) encodeCompact(buf []byte, timeBase uint64) []byte {
+	buf = binary.AppendUvarint(buf, uint64(len(d.FileName)))
+	buf = append(buf, d.FileName...)
+	mode := d.Inode.Mode
+	if d.Inode.InlineData != nil {
+		mode |= recordModeInline
+	}
+	buf = binary.AppendUvarint(buf, uint64(mode))
+	buf = binary.AppendUvarint(buf, d.ParentDepIndex)
+	buf = binary.AppendUvarint(buf, uint64(d.Inode.Uid))
+	buf = binary.AppendUvarint(buf, uint64(d.Inode.Gid))
+	if unix.S_ISDIR(d.Inode.Mode) {
+		buf = binary.AppendUvarint(buf, d.Inode.Nlink)
+	} else {
+		buf = binary.AppendUvarint(buf, d.Inode.Dev)
+	}
+	buf = binary.AppendUvarint(buf, d.Inode.Mtim-timeBase)
+	buf = binary.AppendVarint(buf, int64(d.Inode.Atim-d.Inode.Mtim))
+	buf = binary.AppendVarint(buf, int64(d.Inode.Ctim-d.Inode.Mtim))
+	buf = binary.AppendUvarint(buf, d.Inode.Size)
+	if d.Inode.InlineData != nil {
+		buf = append(buf, d.Inode.InlineData...)
+	} else if fileModeHasObjectData(d.Inode.Mode) {
+		buf = append(buf, d.Inode.ObjName.Name()...)
+	}
+	return buf
+}
+
+// Decode a compact record from the start of buf, returning its length.
+func (d *DirEntry) decodeCompact(buf []byte, timeBase uint64) (int, error) {
+	var rec DirRecord
+	n, err := rec.decodeCompact(buf, timeBase)
+	if err != nil {
+		return 0, err
+	}
+	rec.copyTo(d)
+	return n, nil
+}
+
+// Decode a compact record in place from the start of buf, returning its
+// length.
+func (r *DirRecord) decodeCompact(buf []byte, timeBase uint64) (int, error) {
+	pos := 0
+	valid := true
+	uvarint := func() uint64 {
+		val, n := binary.Uvarint(buf[pos:])
+		if n <= 0 {
+			valid = false
+			return 0
+		}
+		pos += n
+		return val
+	}
+	varint := func() uint64 {
+		val, n := binary.Varint(buf[pos:])
+		if n <= 0 {
+			valid = false
+			return 0
+		}
+		pos += n
+		return uint64(val)
+	}
+
+	fileNameLen := uvarint()
+	if !valid || fileNameLen > unix.NAME_MAX || uint64(len(buf)-pos) < fileNameLen {
+		return 0, errors.New("invalid directory record")
+	}
+	r.FileName = buf[pos : pos+int(fileNameLen)]
+	pos += int(fileNameLen)
+
+	r.Inode.Mode = uint32(uvarint())
+	r.ParentDepIndex = uvarint()
+	r.Inode.Uid = uint32(uvarint())
+	r.Inode.Gid = uint32(uvarint())
+	if unix.S_ISDIR(r.Inode.Mode) {
+		r.Inode.Dev = 0
+		r.Inode.Nlink = uvarint()
+	} else {
+		r.Inode.Dev = uvarint()
+		r.Inode.Nlink = 1
+	}
+	r.Inode.Mtim = timeBase + uvarint()
+	r.Inode.Atim = r.Inode.Mtim + varint()
+	r.Inode.Ctim = r.Inode.Mtim + varint()
+	r.Inode.Size = uvarint()
+	if !valid {
+		return 0, errors.New("invalid directory record")
+	}
+
+	r.Inode.ObjName = nil
+	r.Inode.InlineData = nil
+	r.objName = nil
+	if r.Inode.Mode&recordModeInline != 0 {
+		r.Inode.Mode &^= recordModeInline
+		inlineLen := inlineDataLen(r.Inode.Mode, r.Inode.Size)
+		if inlineLen < 0 || len(buf)-pos < inlineLen {
+			return 0, errors.New("invalid directory record")
+		}
+		r.Inode.InlineData = buf[pos : pos+inlineLen : pos+inlineLen]
+		pos += inlineLen
+	} else if fileModeHasObjectData(r.Inode.Mode) {
+		if len(buf)-pos < 32 {
+			return 0, errors.New("invalid directory record")
+		}
+		r.objName = buf[pos : pos+32 : pos+32]
+		pos += 32
+	}
+	return pos, nil
+}
+
+// Decode the record at the current position of dirData, leaving dirData
+// positioned at the following record.
+func (hdr *DirHeader) readRecord(dirData io.ReadSeeker, de *DirEntry) error {
+	if hdr.Flags&DirFlagCompactRecords == 0 {
+		return de.DecodeStream(dirData)
+	}
+
+	// Records are variable length; read as much as the largest record could
+	// need and seek back over the unused part.
+	var buf [maxCompactRecordSize]byte
+	n, err := io.ReadFull(dirData, buf[:])
+	if err != nil && err != io.ErrUnexpectedEOF {
+		return err
+	}
+	used, err := de.decodeCompact(buf[:n], hdr.TimeBase)
+	if err != nil {
+		return err
+	}
+	_, err = dirData.Seek(int64(used-n), io.SeekCurrent)
+	return err
+}
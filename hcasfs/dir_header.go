@@ -0,0 +1,269 @@
+package hcasfs
+
+import (
+	"encoding/binary"
+	"hash/crc32"
+	"io"
+
+	"github.com/go-errors/errors"
+)
+
+// Directory objects are laid out as
+//
+//	0   u32 flags
+//	4   u32 entry count
+//	8   u64 tree size
+//	16  extended header, only present if any flag is set
+//	      u32 index offset
+//	      u32 records offset
+//	      u32 bloom offset, u32 bloom words, u32 bloom hashes, u32 reserved
+//	          (DirFlagBloom)
+//	      u64 salt k0, u64 salt k1 (DirFlagSalted)
+//	      u32 pilots offset, u32 bucket count (DirFlagPerfectHash)
+//	      u32 shards offset, u32 shard count (DirFlagSharded)
+//	      u64 time base (DirFlagCompactRecords)
+//	    optional sections referenced from the extended header
+//	    index of entry count (u32 record position, u32 name hash) pairs
+//	        sorted by hash, in Eytzinger order of the sorted index or in
+//	        perfect hash slot order
+//	    records, in index order; see DirEntry.Encode, or compact_record.go
+//	        with DirFlagCompactRecords
+//
+// A directory with no flags set has its index at offset 16 and its records
+// directly after the index.
+const (
+	// The directory has a Bloom filter over its name hashes.
+	DirFlagBloom uint32 = 1 << 0
+	// Names are hashed with SipHash-2-4 keyed by the directory's salt rather
+	// than with CRC32.
+	DirFlagSalted uint32 = 1 << 1
+	// The index is ordered by a minimal perfect hash of the names rather than
+	// sorted by hash. Requires DirFlagSalted.
+	DirFlagPerfectHash uint32 = 1 << 2
+	// The sorted index is stored in Eytzinger order. Exclusive with
+	// DirFlagPerfectHash.
+	DirFlagEytzinger uint32 = 1 << 3
+	// The directory is split across child objects by name hash and holds no
+	// index or records of its own; see shard.go. Requires DirFlagSalted and
+	// excludes every other flag.
+	DirFlagSharded uint32 = 1 << 4
+	// Records use the variable length encoding of compact_record.go instead
+	// of DirEntry.Encode.
+	DirFlagCompactRecords uint32 = 1 << 5
+
+	dirFlagsSupported = DirFlagBloom | DirFlagSalted | DirFlagPerfectHash |
+		DirFlagEytzinger | DirFlagSharded | DirFlagCompactRecords
+)
+
+type DirHeader struct {
+	Flags         uint32
+	EntryCount    uint32
+	TreeSize      uint64
+	IndexOffset   uint32
+	RecordsOffset uint32
+
+	BloomOffset uint32
+	BloomWords  uint32
+	BloomHashes uint32
+
+	Salt [2]uint64
+
+	PerfectHashOffset  uint32
+	PerfectHashBuckets uint32
+
+	ShardsOffset uint32
+	ShardCount   uint32
+
+	// Compact records store modification times relative to this.
+	TimeBase uint64
+}
+
+// Returns the hash of name used in the directory's index.
+func (hdr *DirHeader) NameHash(name string) uint32 {
+	return uint32(hdr.nameHash64(name))
+}
+
+// The full 64-bit name hash of a salted directory; the index holds the low 32
+// bits.
+func (hdr *DirHeader) nameHash64(name string) uint64 {
+	if hdr.Flags&DirFlagSalted != 0 {
+		return sipHash24(hdr.Salt[0], hdr.Salt[1], []byte(name))
+	}
+	return uint64(crc32.ChecksumIEEE([]byte(name)))
+}
+
+// Size of the encoded header including the extended header.
+func (hdr *DirHeader) Size() uint32 {
+	if hdr.Flags == 0 {
+		return 16
+	}
+	size := uint32(24)
+	if hdr.Flags&DirFlagBloom != 0 {
+		size += 16
+	}
+	if hdr.Flags&DirFlagSalted != 0 {
+		size += 16
+	}
+	if hdr.Flags&DirFlagPerfectHash != 0 {
+		size += 8
+	}
+	if hdr.Flags&DirFlagSharded != 0 {
+		size += 8
+	}
+	if hdr.Flags&DirFlagCompactRecords != 0 {
+		size += 8
+	}
+	return size
+}
+
+func (hdr *DirHeader) Encode() []byte {
+	buf := make([]byte, hdr.Size())
+	binary.BigEndian.PutUint32(buf[0:], hdr.Flags)
+	binary.BigEndian.PutUint32(buf[4:], hdr.EntryCount)
+	binary.BigEndian.PutUint64(buf[8:], hdr.TreeSize)
+	if hdr.Flags == 0 {
+		return buf
+	}
+
+	binary.BigEndian.PutUint32(buf[16:], hdr.IndexOffset)
+	binary.BigEndian.PutUint32(buf[20:], hdr.RecordsOffset)
+	ext := buf[24:]
+	if hdr.Flags&DirFlagBloom != 0 {
+		binary.BigEndian.PutUint32(ext[0:], hdr.BloomOffset)
+		binary.BigEndian.PutUint32(ext[4:], hdr.BloomWords)
+		binary.BigEndian.PutUint32(ext[8:], hdr.BloomHashes)
+		ext = ext[16:]
+	}
+	if hdr.Flags&DirFlagSalted != 0 {
+		binary.BigEndian.PutUint64(ext[0:], hdr.Salt[0])
+		binary.BigEndian.PutUint64(ext[8:], hdr.Salt[1])
+		ext = ext[16:]
+	}
+	if hdr.Flags&DirFlagPerfectHash != 0 {
+		binary.BigEndian.PutUint32(ext[0:], hdr.PerfectHashOffset)
+		binary.BigEndian.PutUint32(ext[4:], hdr.PerfectHashBuckets)
+		ext = ext[8:]
+	}
+	if hdr.Flags&DirFlagSharded != 0 {
+		binary.BigEndian.PutUint32(ext[0:], hdr.ShardsOffset)
+		binary.BigEndian.PutUint32(ext[4:], hdr.ShardCount)
+		ext = ext[8:]
+	}
+	if hdr.Flags&DirFlagCompactRecords != 0 {
+		binary.BigEndian.PutUint64(ext[0:], hdr.TimeBase)
+	}
+	return buf
+}
+
+// Largest encoded header, with every extended header field present.
+const maxDirHeaderSize = 80
+
+// Read the header of a directory object from the current position of stream,
+// which should be the start of the object.
+func ReadDirHeader(stream io.Reader) (*DirHeader, error) {
+	var buf [maxDirHeaderSize]byte
+	err := readAll(stream, buf[:16])
+	if err != nil {
+		return nil, err
+	}
+
+	hdr := &DirHeader{}
+	size, err := hdr.decodeBase(buf[:16])
+	if err != nil {
+		return nil, err
+	}
+	err = readAll(stream, buf[16:size])
+	if err != nil {
+		return nil, err
+	}
+	err = hdr.decodeExt(buf[16:size])
+	if err != nil {
+		return nil, err
+	}
+	return hdr, nil
+}
+
+// Decode the header at the start of data.
+func (hdr *DirHeader) decode(data []byte) error {
+	if len(data) < 16 {
+		return errors.New("truncated directory header")
+	}
+	size, err := hdr.decodeBase(data[:16])
+	if err != nil {
+		return err
+	}
+	if uint32(len(data)) < size {
+		return errors.New("truncated directory header")
+	}
+	return hdr.decodeExt(data[16:size])
+}
+
+// Decode the first 16 bytes of the header, returning the size of the whole
+// header.
+func (hdr *DirHeader) decodeBase(buf []byte) (uint32, error) {
+	*hdr = DirHeader{
+		Flags:      binary.BigEndian.Uint32(buf[0:]),
+		EntryCount: binary.BigEndian.Uint32(buf[4:]),
+		TreeSize:   binary.BigEndian.Uint64(buf[8:]),
+	}
+	if hdr.Flags == 0 {
+		hdr.IndexOffset = 16
+		hdr.RecordsOffset = 16 + 8*hdr.EntryCount
+		return 16, nil
+	}
+	if hdr.Flags&^dirFlagsSupported != 0 {
+		return 0, errors.New("unsupported directory flags")
+	}
+	if hdr.Flags&DirFlagPerfectHash != 0 && hdr.Flags&DirFlagEytzinger != 0 {
+		return 0, errors.New("invalid directory index layout")
+	}
+	if hdr.Flags&DirFlagSharded != 0 && hdr.Flags != DirFlagSalted|DirFlagSharded {
+		return 0, errors.New("invalid sharded directory")
+	}
+	return hdr.Size(), nil
+}
+
+// Decode the extended header that follows the first 16 bytes.
+func (hdr *DirHeader) decodeExt(ext []byte) error {
+	if hdr.Flags == 0 {
+		return nil
+	}
+	hdr.IndexOffset = binary.BigEndian.Uint32(ext[0:])
+	hdr.RecordsOffset = binary.BigEndian.Uint32(ext[4:])
+	ext = ext[8:]
+	if hdr.Flags&DirFlagBloom != 0 {
+		hdr.BloomOffset = binary.BigEndian.Uint32(ext[0:])
+		hdr.BloomWords = binary.BigEndian.Uint32(ext[4:])
+		hdr.BloomHashes = binary.BigEndian.Uint32(ext[8:])
+		if hdr.BloomWords == 0 || hdr.BloomHashes > bloomMaxHashes {
+			return errors.New("invalid directory bloom filter")
+		}
+		ext = ext[16:]
+	}
+	if hdr.Flags&DirFlagSalted != 0 {
+		hdr.Salt[0] = binary.BigEndian.Uint64(ext[0:])
+		hdr.Salt[1] = binary.BigEndian.Uint64(ext[8:])
+		ext = ext[16:]
+	}
+	if hdr.Flags&DirFlagPerfectHash != 0 {
+		hdr.PerfectHashOffset = binary.BigEndian.Uint32(ext[0:])
+		hdr.PerfectHashBuckets = binary.BigEndian.Uint32(ext[4:])
+		if hdr.Flags&DirFlagSalted == 0 ||
+			(hdr.PerfectHashBuckets == 0 && hdr.EntryCount != 0) {
+			return errors.New("invalid directory perfect hash")
+		}
+		ext = ext[8:]
+	}
+	if hdr.Flags&DirFlagSharded != 0 {
+		hdr.ShardsOffset = binary.BigEndian.Uint32(ext[0:])
+		hdr.ShardCount = binary.BigEndian.Uint32(ext[4:])
+		if hdr.ShardCount == 0 {
+			return errors.New("invalid sharded directory")
+		}
+		ext = ext[8:]
+	}
+	if hdr.Flags&DirFlagCompactRecords != 0 {
+		hdr.TimeBase = binary.BigEndian.Uint64(ext[0:])
+	}
+	return nil
+}
@@ -0,0 +1,459 @@
+package hcasfs
+
+import (
+	"encoding/binary"
+	"hash/crc32"
+	"io"
+	"math"
+
+	"github.com/go-errors/errors"
+
+	"github.com/msg555/hcas/hcas"
+	"github.com/msg555/hcas/unix"
+)
+
+// Largest record of the fixed layout of DirEntry.Encode.
+const maxFixedRecordSize = (96 + unix.NAME_MAX + 7) & ^7
+
+// DirView decodes a directory object held in memory, mapped or read whole,
+// without allocating for each entry. The stream based LookupChild and
+// ReadDirEntries issue a seek and read for every index probe and allocate every
+// record they decode; a view reads the index and records in place.
+type DirView struct {
+	Header DirHeader
+	data   []byte
+}
+
+// A directory record decoded in place by a DirView. FileName,
+// Inode.InlineData and the object name alias the view's data, so the record is
+// only valid as long as that data is. Inode.ObjName is always nil, see
+// ObjectName.
+type DirRecord struct {
+	Inode          InodeData
+	FileName       []byte
+	ParentDepIndex uint64
+	objName        []byte
+}
+
+func NewDirView(data []byte) (*DirView, error) {
+	v := &DirView{}
+	err := v.Reset(data)
+	if err != nil {
+		return nil, err
+	}
+	return v, nil
+}
+
+// Point the view at the directory object in data. The sections referenced by
+// the header are checked to lie within data so that reading the index never
+// has to.
+func (v *DirView) Reset(data []byte) error {
+	v.data = nil
+	hdr := &v.Header
+	err := hdr.decode(data)
+	if err != nil {
+		return err
+	}
+
+	within := func(offset uint32, size uint64) bool {
+		return uint64(offset)+size <= uint64(len(data))
+	}
+	// Sharded nodes count every entry below them but hold no index.
+	indexSize := 8 * uint64(hdr.EntryCount)
+	if hdr.Flags&DirFlagSharded != 0 {
+		indexSize = 0
+	}
+	if !within(hdr.IndexOffset, indexSize) || !within(hdr.RecordsOffset, 0) {
+		return errors.New("truncated directory index")
+	}
+	if hdr.Flags&DirFlagBloom != 0 && !within(hdr.BloomOffset, 8*uint64(hdr.BloomWords)) {
+		return errors.New("truncated directory bloom filter")
+	}
+	if hdr.Flags&DirFlagPerfectHash != 0 && !within(hdr.PerfectHashOffset, 4*uint64(hdr.PerfectHashBuckets)) {
+		return errors.New("truncated directory perfect hash")
+	}
+	if hdr.Flags&DirFlagSharded != 0 && !within(hdr.ShardsOffset, dirShardSize*uint64(hdr.ShardCount)) {
+		return errors.New("truncated sharded directory")
+	}
+	if uint64(len(data)) > math.MaxUint32 {
+		return errors.New("directory too large")
+	}
+
+	v.data = data
+	return nil
+}
+
+// The full name hash as DirHeader.nameHash64, without allocating.
+func (v *DirView) nameHash64(name string) uint64 {
+	hdr := &v.Header
+	if hdr.Flags&DirFlagSalted != 0 {
+		var buf [unix.NAME_MAX]byte
+		return sipHash24(hdr.Salt[0], hdr.Salt[1], buf[:copy(buf[:], name)])
+	}
+
+	crc := ^uint32(0)
+	for i := 0; i < len(name); i++ {
+		crc = crc32.IEEETable[byte(crc)^name[i]] ^ (crc >> 8)
+	}
+	return uint64(^crc)
+}
+
+// Returns the record position and name hash of index slot i.
+func (v *DirView) indexEntry(i uint32) (uint32, uint32) {
+	entry := v.data[v.Header.IndexOffset+8*i:]
+	return binary.BigEndian.Uint32(entry[0:]), binary.BigEndian.Uint32(entry[4:])
+}
+
+// Decode the record at offset into rec, returning its length.
+func (v *DirView) record(offset uint32, rec *DirRecord) (uint32, error) {
+	if uint64(offset) >= uint64(len(v.data)) {
+		return 0, errors.New("invalid directory record position")
+	}
+
+	var n int
+	var err error
+	if v.Header.Flags&DirFlagCompactRecords != 0 {
+		n, err = rec.decodeCompact(v.data[offset:], v.Header.TimeBase)
+	} else {
+		n, err = rec.decodeFixed(v.data[offset:])
+	}
+	return uint32(n), err
+}
+
+// Decode the record of index slot i into rec if its hash is h and its name is
+// name.
+func (v *DirView) matchSlot(i uint32, name string, h uint32, rec *DirRecord) (bool, error) {
+	recordPosition, recordHash := v.indexEntry(i)
+	if recordHash != h {
+		return false, nil
+	}
+	_, err := v.record(recordPosition, rec)
+	if err != nil {
+		return false, err
+	}
+	return string(rec.FileName) == name, nil
+}
+
+// Look up name in the directory, decoding its record into rec. Returns false
+// if the directory has no entry with that name.
+func (v *DirView) Lookup(name string, rec *DirRecord) (bool, error) {
+	hdr := &v.Header
+	if hdr.Flags&DirFlagSharded != 0 {
+		return false, errors.New("sharded directory requires LookupChildView")
+	}
+	if len(name) > unix.NAME_MAX || hdr.EntryCount == 0 {
+		return false, nil
+	}
+
+	h64 := v.nameHash64(name)
+	h := uint32(h64)
+
+	if hdr.Flags&DirFlagBloom != 0 {
+		bh := bloomHash(h)
+		word := binary.BigEndian.Uint64(v.data[hdr.BloomOffset+8*bloomWord(bh, hdr.BloomWords):])
+		mask := bloomMask(bh, hdr.BloomHashes)
+		if word&mask != mask {
+			return false, nil
+		}
+	}
+
+	if hdr.Flags&DirFlagPerfectHash != 0 {
+		bucket := perfectHashBucket(h64, hdr.PerfectHashBuckets)
+		pilot := binary.BigEndian.Uint32(v.data[hdr.PerfectHashOffset+4*bucket:])
+		return v.matchSlot(perfectHashSlot(h64, pilot, hdr.EntryCount), name, h, rec)
+	}
+
+	if hdr.Flags&DirFlagEytzinger != 0 {
+		// Descend to a leaf, remembering the last slot whose hash was not
+		// less than h; that is the first entry that can match.
+		var first uint32
+		for k := uint32(1); k <= hdr.EntryCount; {
+			if _, recordHash := v.indexEntry(k - 1); recordHash < h {
+				k = 2*k + 1
+			} else {
+				first = k
+				k = 2 * k
+			}
+		}
+		for k, run := first, 0; k != 0; k = eytzingerNext(k, hdr.EntryCount) {
+			if _, recordHash := v.indexEntry(k - 1); recordHash != h {
+				break
+			}
+			if run++; run > maxIndexHashRun {
+				return false, errors.New("directory index has too many names sharing a hash")
+			}
+			found, err := v.matchSlot(k-1, name, h, rec)
+			if found || err != nil {
+				return found, err
+			}
+		}
+		return false, nil
+	}
+
+	// Find the first index entry with hash h, then try each entry sharing it.
+	lo, hi := uint32(0), hdr.EntryCount
+	for lo < hi {
+		mid := lo + (hi-lo)/2
+		if _, recordHash := v.indexEntry(mid); recordHash < h {
+			lo = mid + 1
+		} else {
+			hi = mid
+		}
+	}
+	for i, run := lo, 0; i < hdr.EntryCount; i++ {
+		if _, recordHash := v.indexEntry(i); recordHash != h {
+			break
+		}
+		if run++; run > maxIndexHashRun {
+			return false, errors.New("directory index has too many names sharing a hash")
+		}
+		found, err := v.matchSlot(i, name, h, rec)
+		if found || err != nil {
+			return found, err
+		}
+	}
+	return false, nil
+}
+
+// Read child reference i of a sharded directory.
+func (v *DirView) Shard(i uint32) (DirShard, error) {
+	var shard DirShard
+	if v.Header.Flags&DirFlagSharded == 0 || i >= v.Header.ShardCount {
+		return shard, errors.New("invalid directory shard")
+	}
+	shard.decode(v.data[v.Header.ShardsOffset+dirShardSize*i:])
+	return shard, nil
+}
+
+// Find the child of a sharded directory that holds name.
+func (v *DirView) FindShard(name string) (DirShard, error) {
+	if v.Header.Flags&DirFlagSharded == 0 {
+		return DirShard{}, errors.New("invalid directory shard")
+	}
+
+	// Find the last child whose smallest hash is at most h.
+	h := v.nameHash64(name)
+	lo, hi := uint32(1), v.Header.ShardCount
+	for lo < hi {
+		mid := lo + (hi-lo)/2
+		if binary.BigEndian.Uint64(v.data[v.Header.ShardsOffset+dirShardSize*mid:]) <= h {
+			lo = mid + 1
+		} else {
+			hi = mid
+		}
+	}
+	return v.Shard(lo - 1)
+}
+
+// Iterates over the records of a directory in readdir order.
+type DirIter struct {
+	view   *DirView
+	pos    uint32
+	offset uint32
+	err    error
+}
+
+// Iterate over the records of the directory starting at entry pos.
+func (v *DirView) Iter(pos uint32) DirIter {
+	it := DirIter{view: v, pos: pos}
+	if v.Header.Flags&DirFlagSharded != 0 {
+		it.err = errors.New("sharded directory requires WalkDirView")
+	} else if pos < v.Header.EntryCount {
+		it.offset, _ = v.indexEntry(pos)
+	}
+	return it
+}
+
+// Decode the next record into rec. Returns false at the end of the directory
+// or on error, see Err.
+func (it *DirIter) Next(rec *DirRecord) bool {
+	if it.err != nil || it.pos >= it.view.Header.EntryCount {
+		return false
+	}
+	n, err := it.view.record(it.offset, rec)
+	if err != nil {
+		it.err = err
+		return false
+	}
+	it.offset += n
+	it.pos++
+	return true
+}
+
+// Position of the entry the next call to Next decodes.
+func (it *DirIter) Pos() uint32 {
+	return it.pos
+}
+
+func (it *DirIter) Err() error {
+	return it.err
+}
+
+// Decode a record in the fixed layout of DirEntry.Encode from the start of
+// buf, returning its length.
+func (r *DirRecord) decodeFixed(buf []byte) (int, error) {
+	if len(buf) < 96 {
+		return 0, errors.New("invalid directory record")
+	}
+
+	r.Inode.Mode = binary.BigEndian.Uint32(buf[0:])
+	r.Inode.Uid = binary.BigEndian.Uint32(buf[4:])
+	r.Inode.Gid = binary.BigEndian.Uint32(buf[8:])
+	if unix.S_ISDIR(r.Inode.Mode) {
+		r.Inode.Dev = 0
+		r.Inode.Nlink = binary.BigEndian.Uint64(buf[12:])
+	} else {
+		r.Inode.Dev = binary.BigEndian.Uint64(buf[12:])
+		r.Inode.Nlink = 1
+	}
+	r.Inode.Atim = binary.BigEndian.Uint64(buf[20:])
+	r.Inode.Mtim = binary.BigEndian.Uint64(buf[28:])
+	r.Inode.Ctim = binary.BigEndian.Uint64(buf[36:])
+	r.Inode.Size = binary.BigEndian.Uint64(buf[44:])
+
+	r.Inode.ObjName = nil
+	r.Inode.InlineData = nil
+	r.objName = nil
+	if r.Inode.Mode&recordModeInline != 0 {
+		r.Inode.Mode &^= recordModeInline
+		inlineLen := inlineDataLen(r.Inode.Mode, r.Inode.Size)
+		if inlineLen < 0 {
+			return 0, errors.New("invalid inline directory record")
+		}
+		r.Inode.InlineData = buf[52 : 52+inlineLen : 52+inlineLen]
+	} else if fileModeHasObjectData(r.Inode.Mode) {
+		r.objName = buf[52:84:84]
+	}
+	r.ParentDepIndex = binary.BigEndian.Uint64(buf[84:])
+
+	fileNameLen := binary.BigEndian.Uint32(buf[92:])
+	if fileNameLen > unix.NAME_MAX {
+		return 0, errors.New("invalid directory record")
+	}
+	recordLen := (96 + int(fileNameLen) + 7) & ^7
+	if len(buf) < recordLen {
+		return 0, errors.New("invalid directory record")
+	}
+	r.FileName = buf[96 : 96+fileNameLen]
+	return recordLen, nil
+}
+
+// Returns the name of the entry's object, or nil if it has none.
+func (r *DirRecord) ObjectName() *hcas.Name {
+	if r.objName == nil {
+		return nil
+	}
+	name := hcas.NewName(string(r.objName))
+	return &name
+}
+
+// Copy the record into a DirEntry that does not alias the view.
+func (r *DirRecord) DirEntry() DirEntry {
+	var de DirEntry
+	r.copyTo(&de)
+	return de
+}
+
+func (r *DirRecord) copyTo(d *DirEntry) {
+	d.Inode = r.Inode
+	d.Inode.ObjName = r.ObjectName()
+	if r.Inode.InlineData != nil {
+		d.Inode.InlineData = append([]byte{}, r.Inode.InlineData...)
+	}
+	d.FileName = string(r.FileName)
+	d.ParentDepIndex = r.ParentDepIndex
+}
+
+// Maps a directory object referenced by a sharded directory. The returned
+// closer is closed once the view is no longer used.
+type DirViewOpener func(name *hcas.Name) (*DirView, io.Closer, error)
+
+// Same as LookupChildSharded for a directory held in view, mapping its shards
+// with open.
+func LookupChildView(open DirViewOpener, view *DirView, name string) (*DirEntry, error) {
+	var base uint64
+	var shardCloser io.Closer
+	defer func() {
+		if shardCloser != nil {
+			shardCloser.Close()
+		}
+	}()
+
+	for depth := 0; view.Header.Flags&DirFlagSharded != 0; depth++ {
+		if depth > maxShardDepth {
+			return nil, errors.New("sharded directory too deep")
+		}
+		shard, err := view.FindShard(name)
+		if err != nil {
+			return nil, err
+		}
+		child, closer, err := open(&shard.Name)
+		if err != nil {
+			return nil, err
+		}
+		if shardCloser != nil {
+			shardCloser.Close()
+		}
+		shardCloser = closer
+		view = child
+		base += shard.Base
+	}
+
+	var rec DirRecord
+	found, err := view.Lookup(name, &rec)
+	if !found || err != nil {
+		return nil, err
+	}
+	dirEntry := rec.DirEntry()
+	dirEntry.ParentDepIndex += base
+	return &dirEntry, nil
+}
+
+// Call fn with each record of the directory held in view in readdir order,
+// starting at entry pos and following shards mapped with open, until fn
+// returns false. The record's ParentDepIndex is relative to the directory and
+// it is only valid for the duration of the call.
+func WalkDirView(open DirViewOpener, view *DirView, pos uint32, fn func(rec *DirRecord) bool) error {
+	var rec DirRecord
+	_, err := walkDirView(open, view, pos, 0, 0, &rec, fn)
+	return err
+}
+
+func walkDirView(open DirViewOpener, view *DirView, pos uint32, base uint64, depth int, rec *DirRecord, fn func(rec *DirRecord) bool) (bool, error) {
+	if view.Header.Flags&DirFlagSharded == 0 {
+		it := view.Iter(pos)
+		for it.Next(rec) {
+			rec.ParentDepIndex += base
+			if !fn(rec) {
+				return false, nil
+			}
+		}
+		return true, it.Err()
+	}
+	if depth >= maxShardDepth {
+		return false, errors.New("sharded directory too deep")
+	}
+
+	for i := uint32(0); i < view.Header.ShardCount; i++ {
+		shard, err := view.Shard(i)
+		if err != nil {
+			return false, err
+		}
+		if pos >= shard.EntryCount {
+			pos -= shard.EntryCount
+			continue
+		}
+
+		child, closer, err := open(&shard.Name)
+		if err != nil {
+			return false, err
+		}
+		more, err := walkDirView(open, child, pos, base+shard.Base, depth+1, rec, fn)
+		closer.Close()
+		if !more || err != nil {
+			return false, err
+		}
+		pos = 0
+	}
+	return true, nil
+}
@@ -0,0 +1,109 @@
+package hcasfs
+
+import (
+	"encoding/binary"
+	"io"
+
+	"github.com/go-errors/errors"
+)
+
+// Directories can store their index in Eytzinger (breadth first binary tree)
+// order instead of sorted. Entry k (counting from 1) has children 2k and 2k+1,
+// so the first levels of every search share the same few cache lines and
+// pages and the search never jumps across the whole index.
+
+// Returns, for each index slot in Eytzinger order, the position in sorted
+// order of the entry stored there.
+func eytzingerOrder(count int) []int {
+	order := make([]int, count)
+	next := 0
+	var fill func(k int)
+	fill = func(k int) {
+		if k > count {
+			return
+		}
+		fill(2 * k)
+		order[k-1] = next
+		next++
+		fill(2*k + 1)
+	}
+	fill(1)
+	return order
+}
+
+// Returns the in-order successor of slot k (counting from 1), or 0 if k is the
+// last slot.
+func eytzingerNext(k uint32, count uint32) uint32 {
+	if 2*k+1 <= count {
+		k = 2*k + 1
+		for 2*k <= count {
+			k = 2 * k
+		}
+		return k
+	}
+	for k&1 == 1 {
+		k >>= 1
+	}
+	return k >> 1
+}
+
+// Look up name, with index hash crc, in a directory with an Eytzinger index.
+func (hdr *DirHeader) lookupEytzinger(dirData io.ReadSeeker, name string, crc uint32) (*DirEntry, error) {
+	var entry [8]byte
+	readEntry := func(k uint32) (uint32, uint32, error) {
+		_, err := dirData.Seek(int64(hdr.IndexOffset)+8*int64(k-1), 0)
+		if err != nil {
+			return 0, 0, err
+		}
+		err = readAll(dirData, entry[:])
+		if err != nil {
+			return 0, 0, err
+		}
+		return binary.BigEndian.Uint32(entry[0:]), binary.BigEndian.Uint32(entry[4:]), nil
+	}
+
+	// Descend to a leaf, remembering the last slot whose hash was not less
+	// than crc; that is the first entry that can match.
+	var first uint32
+	for k := uint32(1); k <= hdr.EntryCount; {
+		_, recordHash, err := readEntry(k)
+		if err != nil {
+			return nil, err
+		}
+		if recordHash < crc {
+			k = 2*k + 1
+		} else {
+			first = k
+			k = 2 * k
+		}
+	}
+
+	run := 0
+	for k := first; k != 0; k = eytzingerNext(k, hdr.EntryCount) {
+		recordPosition, recordHash, err := readEntry(k)
+		if err != nil {
+			return nil, err
+		}
+		if recordHash != crc {
+			break
+		}
+		run++
+		if run > maxIndexHashRun {
+			return nil, errors.New("directory index has too many names sharing a hash")
+		}
+
+		_, err = dirData.Seek(int64(recordPosition), 0)
+		if err != nil {
+			return nil, err
+		}
+		var de DirEntry
+		err = hdr.readRecord(dirData, &de)
+		if err != nil {
+			return nil, err
+		}
+		if de.FileName == name {
+			return &de, nil
+		}
+	}
+	return nil, nil
+}
@@ -1,7 +1,10 @@
 package hcasfs
 
 import (
+	"crypto/sha256"
 	"encoding/binary"
+	"flag"
+	"fmt"
 	"hash/crc32"
 	"io"
 	"sort"
@@ -23,8 +26,19 @@ type InodeData struct {
 	Ctim    uint64
 	Size    uint64
 	ObjName *hcas.Name
+	// Contents of regular files and symlinks of at most MaxInlineSize bytes,
+	// stored in the directory record in place of ObjName. Empty but non-nil
+	// for empty directories, which are stored the same way.
+	InlineData []byte
 }
 
+// Largest content stored inline in a directory record, the size of the object
+// name it replaces.
+const MaxInlineSize = 32
+
+// Set in the encoded mode of records whose content is stored inline.
+const recordModeInline uint32 = 1 << 31
+
 func InodeFromStat(st unix.Stat_t, objName *hcas.Name) *InodeData {
 	inode := &InodeData{
 		Mode:    st.Mode,
@@ -45,18 +59,90 @@ func InodeFromStat(st unix.Stat_t, objName *hcas.Name) *InodeData {
 }
 
 type DirEntry struct {
-	Inode            InodeData
-	FileName         string
-	TreeSize         uint64
+	Inode    InodeData
+	FileName string
+	TreeSize uint64
+	// Hash of the name in the directory index; the CRC32 of the name unless
+	// the directory is salted.
 	FileNameChecksum uint32
 	ParentDepIndex   uint64
 }
 
+// Controls the optional features of built directories. Each of them changes the
+// on-disk format, so none is enabled by default and readers that predate a
+// feature can still read directories built with the default options.
+type DirBuildOptions struct {
+	// Directories with at least this many entries include a Bloom filter so
+	// that most lookups of missing names skip the index search. Zero
+	// disables the filter.
+	BloomMinEntries int
+	// Size of the Bloom filter in bits per entry.
+	BloomBitsPerEntry int
+	// Index names with SipHash keyed by a per-directory salt instead of
+	// CRC32. Names can be chosen to collide under CRC32, which turns lookups
+	// into a scan over every colliding record. Directories with more than
+	// maxIndexHashRun names sharing a CRC32 are salted regardless.
+	Salted bool
+	// Salted directories with at least this many entries get a minimal
+	// perfect hash index so lookups skip the binary search. Zero disables
+	// the perfect hash.
+	PerfectHashMinEntries int
+	// Store the sorted index of directories without a perfect hash in
+	// Eytzinger order so each step of a search stays close to the last.
+	EytzingerIndex bool
+	// Encode records with the variable length encoding of compact_record.go,
+	// which drops the padding, the object name of entries without content and
+	// most of the timestamp bytes.
+	CompactRecords bool
+	// Directories with at least this many entries are split by BuildObject
+	// into a tree of objects so that changing one entry does not rewrite the
+	// whole directory. Zero disables sharding.
+	ShardMinEntries int
+	// Average number of entries in each leaf of a sharded directory.
+	ShardEntries int
+	// Average number of children of each node of a sharded directory.
+	ShardFanout int
+	// Salt of the hash used to split sharded directories.
+	ShardSalt [2]uint64
+	// Allow entries to store their content inline in their record instead
+	// of in an object: regular files and symlinks of at most MaxInlineSize
+	// bytes, and empty directories. The importers only inline content when
+	// this is set, and Insert rejects inline entries otherwise.
+	InlineContent bool
+}
+
+// Register command line flags enabling the optional directory features.
+func (opts *DirBuildOptions) RegisterFlags(flagSet *flag.FlagSet) {
+	flagSet.IntVar(&opts.BloomMinEntries, "bloom-min-entries", opts.BloomMinEntries,
+		fmt.Sprintf("Include a Bloom filter in directories with at least this many entries, 0 disables (suggested %d)", defaultBloomMinEntries))
+	flagSet.BoolVar(&opts.Salted, "salted", opts.Salted,
+		"Index names with a per-directory keyed hash instead of CRC32")
+	flagSet.IntVar(&opts.PerfectHashMinEntries, "perfect-hash-min-entries", opts.PerfectHashMinEntries,
+		fmt.Sprintf("Include a perfect hash index in salted directories with at least this many entries, 0 disables (suggested %d)", defaultPerfectHashMinEntries))
+	flagSet.BoolVar(&opts.CompactRecords, "compact-records", opts.CompactRecords,
+		"Encode directory records with the variable length encoding")
+	flagSet.IntVar(&opts.ShardMinEntries, "shard-min-entries", opts.ShardMinEntries,
+		fmt.Sprintf("Split directories with at least this many entries into a tree of objects, 0 disables (suggested %d)", defaultShardMinEntries))
+	flagSet.BoolVar(&opts.InlineContent, "inline-content", opts.InlineContent,
+		fmt.Sprintf("Store files and symlinks of at most %d bytes and empty directories in their directory records", MaxInlineSize))
+}
+
+func DefaultDirBuildOptions() DirBuildOptions {
+	return DirBuildOptions{
+		BloomBitsPerEntry: defaultBloomBitsPerEntry,
+
+		ShardEntries: defaultShardEntries,
+		ShardFanout:  defaultShardFanout,
+		ShardSalt:    defaultShardSalt,
+	}
+}
+
 type dirBuilder struct {
 	DirEntries    []DirEntry
 	DepNames      []hcas.Name
 	TotalTreeSize uint64
 	SubDirs       uint64
+	Options       DirBuildOptions
 }
 
 func CreateDirBuilder() *dirBuilder {
@@ -64,6 +150,7 @@ func CreateDirBuilder() *dirBuilder {
 		DirEntries:    make([]DirEntry, 0, 16),
 		DepNames:      make([]hcas.Name, 0, 16),
 		TotalTreeSize: 1,
+		Options:       DefaultDirBuildOptions(),
 	}
 }
 
@@ -84,50 +171,249 @@ func (d *dirBuilder) Insert(fileName string, inode *InodeData, treeSize uint64)
 		TreeSize:         treeSize,
 		FileNameChecksum: crc32.ChecksumIEEE([]byte(fileName)),
 	}
+	if inode.InlineData != nil && !d.Options.InlineContent {
+		panic("inline data requires the InlineContent option")
+	}
+	if !validInlineData(inode) || (inode.InlineData != nil && treeSize != 1) {
+		panic("inline data unexpected for file type")
+	}
+	if fileModeHasObjectData(inode.Mode) != (inode.ObjName != nil || inode.InlineData != nil) {
+		panic("object data state unexpected for file type")
+	}
 	d.DirEntries = append(d.DirEntries, dirEntry)
 
 	if unix.S_ISDIR(inode.Mode) {
 		d.SubDirs += 1
 	}
-	if fileModeHasObjectData(inode.Mode) != (inode.ObjName != nil) {
-		panic("object data state unexpected for file type")
-	}
 	if inode.ObjName != nil {
 		d.DepNames = append(d.DepNames, *inode.ObjName)
 	}
 	d.TotalTreeSize += treeSize
 }
 
+const (
+	maxSaltAttempts  = 8
+	maxSaltedHashRun = 2
+	// Readers reject directories with more index entries sharing one hash
+	// than this, so a crafted directory can't turn a lookup into a scan over
+	// every record. Must match HCASFS_DIR_MAX_HASH_RUN in the kernel module.
+	maxIndexHashRun = 8
+)
+
+// Return the length of the longest run of equal values in hashes, sorting it.
+func longestHashRun(hashes []uint32) int {
+	sort.Slice(hashes, func(i, j int) bool { return hashes[i] < hashes[j] })
+
+	run := 0
+	for i, start := 0, 0; i < len(hashes); i++ {
+		if hashes[i] != hashes[start] {
+			start = i
+		}
+		run = max(run, i-start+1)
+	}
+	return run
+}
+
+// Pick the salt of a salted directory holding entries. The salt is derived
+// from the names in the directory so that building the same directory twice produces the same
+// object. In the unlikely case the derived salt still leaves more than
+// maxSaltedHashRun names sharing a hash the next candidate salt is tried.
+func chooseSalt(entries []DirEntry) [2]uint64 {
+	names := make([]string, len(entries))
+	for i := range entries {
+		names[i] = entries[i].FileName
+	}
+	sort.Strings(names)
+
+	var best [2]uint64
+	bestRun := -1
+	hashes := make([]uint32, len(names))
+	for attempt := 0; attempt < maxSaltAttempts; attempt++ {
+		hasher := sha256.New()
+		hasher.Write([]byte{byte(attempt)})
+		for _, name := range names {
+			hasher.Write([]byte(name))
+			hasher.Write([]byte{0})
+		}
+		sum := hasher.Sum(nil)
+		salt := [2]uint64{
+			binary.BigEndian.Uint64(sum[0:]),
+			binary.BigEndian.Uint64(sum[8:]),
+		}
+
+		for i, name := range names {
+			hashes[i] = uint32(sipHash24(salt[0], salt[1], []byte(name)))
+		}
+		run := longestHashRun(hashes)
+
+		if bestRun == -1 || run < bestRun {
+			best, bestRun = salt, run
+		}
+		if run <= maxSaltedHashRun {
+			break
+		}
+	}
+	return best
+}
+
+// Encode the directory as a single object. Directories large enough to be
+// sharded should be built with BuildObject instead.
 func (d *dirBuilder) Build() []byte {
-	sort.Slice(d.DirEntries, func(i, j int) bool {
-		return d.DirEntries[i].FileNameChecksum < d.DirEntries[j].FileNameChecksum
-	})
+	data, entries := d.buildDir(d.DirEntries, d.TotalTreeSize, 1)
+	d.DirEntries = entries
+	return data
+}
+
+// Store the directory in hs, sharding it if it is large enough, and return the
+// name of its object.
+func (d *dirBuilder) BuildObject(hs hcas.Session) (*hcas.Name, error) {
+	opts := &d.Options
+	if opts.ShardMinEntries > 0 && len(d.DirEntries) >= opts.ShardMinEntries {
+		return d.buildSharded(hs)
+	}
+	return hs.CreateObject(d.Build(), d.DepNames...)
+}
+
+// Build a subdirectory for insertion into its parent. Like BuildObject, except
+// that with InlineContent set an empty directory is returned as empty inline
+// data and no object is created for it.
+func (d *dirBuilder) buildSubdir(hs hcas.Session) (*hcas.Name, []byte, error) {
+	if d.Options.InlineContent && len(d.DirEntries) == 0 {
+		return nil, []byte{}, nil
+	}
+	name, err := d.BuildObject(hs)
+	return name, nil, err
+}
 
-	var parentOffset uint64 = 1
-	for i := range d.DirEntries {
-		d.DirEntries[i].ParentDepIndex = parentOffset
-		parentOffset += d.DirEntries[i].TreeSize
+// Encode a directory object holding entries, numbering their ParentDepIndex
+// from firstDepIndex. Returns the object data and the entries in index order.
+func (d *dirBuilder) buildDir(entries []DirEntry, treeSize uint64, firstDepIndex uint64) ([]byte, []DirEntry) {
+	entries = append([]DirEntry(nil), entries...)
+	hdr := DirHeader{
+		EntryCount: uint32(len(entries)),
+		TreeSize:   treeSize,
+	}
+	opts := &d.Options
+
+	// A CRC32 index with too many names sharing a checksum would be rejected
+	// by readers, so such a directory is salted even if not asked to be.
+	salted := opts.Salted
+	if !salted {
+		hashes := make([]uint32, len(entries))
+		for i := range entries {
+			hashes[i] = entries[i].FileNameChecksum
+		}
+		salted = longestHashRun(hashes) > maxIndexHashRun
 	}
+	var pilots []uint32
+	if salted {
+		hdr.Flags |= DirFlagSalted
+		hdr.Salt = chooseSalt(entries)
 
-	headerSize := 16 + len(d.DirEntries)*8
-	dataOut := make([]byte, headerSize)
+		hashes := make([]uint64, len(entries))
+		for i := range entries {
+			hashes[i] = hdr.nameHash64(entries[i].FileName)
+			entries[i].FileNameChecksum = uint32(hashes[i])
+		}
 
-	recordPositions := make([]uint32, 0, len(d.DirEntries))
-	for i := range d.DirEntries {
-		recordPositions = append(recordPositions, uint32(len(dataOut)))
-		dataOut = append(dataOut, d.DirEntries[i].Encode()...)
+		if opts.PerfectHashMinEntries > 0 && len(entries) >= opts.PerfectHashMinEntries {
+			var slots []uint32
+			pilots, slots = buildPerfectHash(hashes)
+			if pilots != nil {
+				hdr.Flags |= DirFlagPerfectHash
+				hdr.PerfectHashBuckets = uint32(len(pilots))
+
+				ordered := make([]DirEntry, len(entries))
+				for i, slot := range slots {
+					ordered[slot] = entries[i]
+				}
+				entries = ordered
+			}
+		}
 	}
 
-	var flags uint32 = 0
-	binary.BigEndian.PutUint32(dataOut[0:], flags)
-	binary.BigEndian.PutUint32(dataOut[4:], uint32(len(d.DirEntries)))
-	binary.BigEndian.PutUint64(dataOut[8:], d.TotalTreeSize)
-	for ind := range d.DirEntries {
-		binary.BigEndian.PutUint32(dataOut[16+8*ind:], recordPositions[ind])
-		binary.BigEndian.PutUint32(dataOut[20+8*ind:], d.DirEntries[ind].FileNameChecksum)
+	if hdr.Flags&DirFlagPerfectHash == 0 {
+		sort.Slice(entries, func(i, j int) bool {
+			if entries[i].FileNameChecksum != entries[j].FileNameChecksum {
+				return entries[i].FileNameChecksum < entries[j].FileNameChecksum
+			}
+			return entries[i].FileName < entries[j].FileName
+		})
+
+		if opts.EytzingerIndex {
+			hdr.Flags |= DirFlagEytzinger
+			ordered := make([]DirEntry, len(entries))
+			for k, ind := range eytzingerOrder(len(entries)) {
+				ordered[k] = entries[ind]
+			}
+			entries = ordered
+		}
+	}
+
+	parentOffset := firstDepIndex
+	for i := range entries {
+		entries[i].ParentDepIndex = parentOffset
+		parentOffset += entries[i].TreeSize
 	}
 
-	return dataOut
+	if opts.BloomMinEntries > 0 && len(entries) >= opts.BloomMinEntries {
+		hdr.Flags |= DirFlagBloom
+		hdr.BloomWords = uint32((len(entries)*opts.BloomBitsPerEntry + 63) / 64)
+		if hdr.BloomWords == 0 {
+			hdr.BloomWords = 1
+		}
+		hdr.BloomHashes = bloomMaxHashes
+	}
+
+	if opts.CompactRecords {
+		hdr.Flags |= DirFlagCompactRecords
+		for i := range entries {
+			if i == 0 || entries[i].Inode.Mtim < hdr.TimeBase {
+				hdr.TimeBase = entries[i].Inode.Mtim
+			}
+		}
+	}
+
+	offset := hdr.Size()
+	if hdr.Flags&DirFlagBloom != 0 {
+		hdr.BloomOffset = offset
+		offset += 8 * hdr.BloomWords
+	}
+	if hdr.Flags&DirFlagPerfectHash != 0 {
+		hdr.PerfectHashOffset = offset
+		offset += (4*hdr.PerfectHashBuckets + 7) & ^uint32(7)
+	}
+	hdr.IndexOffset = offset
+	hdr.RecordsOffset = offset + 8*hdr.EntryCount
+
+	dataOut := make([]byte, hdr.RecordsOffset)
+	copy(dataOut, hdr.Encode())
+
+	nameHashes := make([]uint32, len(entries))
+	for ind := range entries {
+		nameHashes[ind] = entries[ind].FileNameChecksum
+
+		indexEntry := dataOut[hdr.IndexOffset+8*uint32(ind):]
+		binary.BigEndian.PutUint32(indexEntry[0:], uint32(len(dataOut)))
+		binary.BigEndian.PutUint32(indexEntry[4:], nameHashes[ind])
+		if hdr.Flags&DirFlagCompactRecords != 0 {
+			dataOut = entries[ind].encodeCompact(dataOut, hdr.TimeBase)
+		} else {
+			dataOut = append(dataOut, entries[ind].Encode()...)
+		}
+	}
+
+	if hdr.Flags&DirFlagBloom != 0 {
+		filter := buildBloom(nameHashes, hdr.BloomWords, hdr.BloomHashes)
+		for i, word := range filter {
+			binary.BigEndian.PutUint64(dataOut[hdr.BloomOffset+8*uint32(i):], word)
+		}
+	}
+	for i, pilot := range pilots {
+		binary.BigEndian.PutUint32(dataOut[hdr.PerfectHashOffset+4*uint32(i):], pilot)
+	}
+
+	return dataOut, entries
 }
 
 func readAll(stream io.Reader, buf []byte) error {
@@ -145,11 +431,42 @@ func fileModeHasObjectData(mode uint32) bool {
 	return unix.S_ISREG(mode) || unix.S_ISDIR(mode) || unix.S_ISLNK(mode)
 }
 
+func validInlineData(inode *InodeData) bool {
+	if inode.InlineData == nil {
+		return true
+	}
+	if inode.ObjName != nil {
+		return false
+	}
+	if unix.S_ISDIR(inode.Mode) {
+		return len(inode.InlineData) == 0
+	}
+	return (unix.S_ISREG(inode.Mode) || unix.S_ISLNK(inode.Mode)) &&
+		len(inode.InlineData) <= MaxInlineSize &&
+		uint64(len(inode.InlineData)) == inode.Size
+}
+
+// Length of the inline content of a record with the given mode and size, or
+// -1 if it cannot be inline.
+func inlineDataLen(mode uint32, size uint64) int {
+	if unix.S_ISDIR(mode) {
+		return 0
+	}
+	if (unix.S_ISREG(mode) || unix.S_ISLNK(mode)) && size <= MaxInlineSize {
+		return int(size)
+	}
+	return -1
+}
+
 func (d *DirEntry) Encode() []byte {
 	bufLen := 96 + len(d.FileName)
 	bufLen = (bufLen + 7) & ^7
 	buf := make([]byte, bufLen)
-	binary.BigEndian.PutUint32(buf[0:], d.Inode.Mode)
+	mode := d.Inode.Mode
+	if d.Inode.InlineData != nil {
+		mode |= recordModeInline
+	}
+	binary.BigEndian.PutUint32(buf[0:], mode)
 	binary.BigEndian.PutUint32(buf[4:], d.Inode.Uid)
 	binary.BigEndian.PutUint32(buf[8:], d.Inode.Gid)
 	if unix.S_ISDIR(d.Inode.Mode) {
@@ -162,9 +479,12 @@ func (d *DirEntry) Encode() []byte {
 	binary.BigEndian.PutUint64(buf[36:], d.Inode.Ctim)
 	binary.BigEndian.PutUint64(buf[44:], d.Inode.Size)
 	if d.Inode.ObjName != nil {
-		// TODO: Don't need to reserve space for modes that don't have objects
-		// associated.
+		// Space is reserved even for modes without objects; compact records
+		// (compact_record.go) omit it.
 		copy(buf[52:], d.Inode.ObjName.Name())
+	} else if d.Inode.InlineData != nil {
+		// Inline content takes the place of the object name, zero padded.
+		copy(buf[52:84], d.Inode.InlineData)
 	}
 	binary.BigEndian.PutUint64(buf[84:], d.ParentDepIndex)
 	binary.BigEndian.PutUint32(buf[92:], uint32(len(d.FileName)))
@@ -173,41 +493,28 @@ func (d *DirEntry) Encode() []byte {
 }
 
 func (d *DirEntry) DecodeStream(stream io.Reader) error {
-	var buf [96]byte
-	err := readAll(stream, buf[:])
+	var buf [maxFixedRecordSize]byte
+	err := readAll(stream, buf[:96])
 	if err != nil {
 		return err
 	}
 
-	d.Inode.Mode = binary.BigEndian.Uint32(buf[0:])
-	d.Inode.Uid = binary.BigEndian.Uint32(buf[4:])
-	d.Inode.Gid = binary.BigEndian.Uint32(buf[8:])
-	if unix.S_ISDIR(d.Inode.Mode) {
-		d.Inode.Dev = 0
-		d.Inode.Nlink = binary.BigEndian.Uint64(buf[12:])
-	} else {
-		d.Inode.Dev = binary.BigEndian.Uint64(buf[12:])
-		d.Inode.Nlink = 1
-	}
-	d.Inode.Atim = binary.BigEndian.Uint64(buf[20:])
-	d.Inode.Mtim = binary.BigEndian.Uint64(buf[28:])
-	d.Inode.Ctim = binary.BigEndian.Uint64(buf[36:])
-	d.Inode.Size = binary.BigEndian.Uint64(buf[44:])
-	if fileModeHasObjectData(d.Inode.Mode) {
-		objName := hcas.NewName(string(buf[52:84]))
-		d.Inode.ObjName = &objName
-	}
-	d.ParentDepIndex = binary.BigEndian.Uint64(buf[84:])
 	fileNameLen := binary.BigEndian.Uint32(buf[92:])
+	if fileNameLen > unix.NAME_MAX {
+		return errors.New("invalid directory record")
+	}
+	recordLen := (96 + int(fileNameLen) + 7) & ^7
+	err = readAll(stream, buf[96:recordLen])
+	if err != nil {
+		return err
+	}
 
-	recordLen := len(buf) + int(fileNameLen)
-	recordLen = (recordLen + 7) & ^7
-	fileName := make([]byte, recordLen-len(buf))
-	err = readAll(stream, fileName)
+	var rec DirRecord
+	_, err = rec.decodeFixed(buf[:recordLen])
 	if err != nil {
 		return err
 	}
-	d.FileName = string(fileName[:fileNameLen])
+	rec.copyTo(d)
 	return nil
 }
 
@@ -282,23 +589,33 @@ func LookupChild(dirData io.ReadSeeker, name string) (dirEntry *DirEntry, err er
 		 * if there _are_ collisions, etc...
 	*/
 
-	var header [16]byte
-	err = readAll(dirData, header[:])
+	hdr, err := ReadDirHeader(dirData)
 	if err != nil {
 		return
 	}
-
-	flags := binary.BigEndian.Uint32(header[0:])
-	if flags != 0 {
-		err = errors.New("unexpected flags")
+	if hdr.Flags&DirFlagSharded != 0 {
+		err = errors.New("sharded directory requires LookupChildSharded")
 		return
 	}
-	childCount := binary.BigEndian.Uint32(header[4:])
-	// totalChildDeps := binary.BigEndian.Uint64(header[8:])
+	childCount := hdr.EntryCount
+	headerOffset := hdr.IndexOffset
 
-	var headerOffset uint32 = 16
+	h := hdr.nameHash64(name)
+	crc := uint32(h)
 
-	crc := crc32.ChecksumIEEE([]byte(name))
+	if hdr.Flags&DirFlagBloom != 0 {
+		var found bool
+		found, err = hdr.bloomContains(dirData, crc)
+		if err != nil || !found {
+			return
+		}
+	}
+	if hdr.Flags&DirFlagPerfectHash != 0 {
+		return hdr.lookupPerfectHash(dirData, name, h)
+	}
+	if hdr.Flags&DirFlagEytzinger != 0 {
+		return hdr.lookupEytzinger(dirData, name, crc)
+	}
 
 	var lo uint32 = 0
 	var hi uint32 = childCount
@@ -312,7 +629,7 @@ func LookupChild(dirData io.ReadSeeker, name string) (dirEntry *DirEntry, err er
 			return
 		}
 
-		ind = lo + uint32(1.0*(crc-loCrc)/(hiCrc-loCrc)*(hi-lo))
+		ind = lo + uint32(uint64(crc-loCrc)*uint64(hi-lo)/(uint64(hiCrc-loCrc)+1))
 		if ind == hi {
 			ind -= 1
 		}
@@ -348,7 +665,7 @@ func LookupChild(dirData io.ReadSeeker, name string) (dirEntry *DirEntry, err er
 		}
 
 		var de DirEntry
-		err = de.DecodeStream(dirData)
+		err = hdr.readRecord(dirData, &de)
 		if err != nil {
 			return nil, err
 		}
@@ -359,23 +676,31 @@ func LookupChild(dirData io.ReadSeeker, name string) (dirEntry *DirEntry, err er
 		return nil, nil
 	}
 
-	crcMatch := func(index uint32, needSeek bool) (bool, error) {
-		if needSeek {
-			_, err := dirData.Seek(int64(headerOffset+8*index), 0)
-			if err != nil {
-				return false, err
-			}
+	crcMatch := func(index uint32) (bool, error) {
+		_, err := dirData.Seek(int64(headerOffset+8*index), 0)
+		if err != nil {
+			return false, err
 		}
 
 		var crcEntry [8]byte
-		err := readAll(dirData, crcEntry[:])
+		err = readAll(dirData, crcEntry[:])
 		if err != nil {
 			return false, err
 		}
 
 		recordChecksum := binary.BigEndian.Uint32(crcEntry[4:])
 		recordPosition = binary.BigEndian.Uint32(crcEntry[0:])
-		return recordChecksum != crc, nil
+		return recordChecksum == crc, nil
+	}
+
+	// Each further record sharing the hash is another candidate to decode.
+	run := 1
+	nextCandidate := func() (*DirEntry, error) {
+		run++
+		if run > maxIndexHashRun {
+			return nil, errors.New("directory index has too many names sharing a hash")
+		}
+		return extractDirEntry()
 	}
 
 	dirEntry, err = extractDirEntry()
@@ -385,26 +710,27 @@ func LookupChild(dirData io.ReadSeeker, name string) (dirEntry *DirEntry, err er
 
 	for testInd := ind + 1; testInd < hi; testInd++ {
 		var match bool
-		match, err = crcMatch(testInd, testInd == ind+1)
+		match, err = crcMatch(testInd)
 		if err != nil {
 			return
 		} else if !match {
 			break
 		}
-		dirEntry, err = extractDirEntry()
+		dirEntry, err = nextCandidate()
 		if dirEntry != nil || err != nil {
 			return
 		}
 	}
-	for testInd := ind - 1; testInd >= lo; testInd-- {
+	for testInd := ind; testInd > lo; {
+		testInd--
 		var match bool
-		match, err = crcMatch(testInd, true)
+		match, err = crcMatch(testInd)
 		if err != nil {
 			return
 		} else if !match {
 			break
 		}
-		dirEntry, err = extractDirEntry()
+		dirEntry, err = nextCandidate()
 		if dirEntry != nil || err != nil {
 			return
 		}
@@ -2,6 +2,13 @@ package hcasfs
 
 import (
 	"bytes"
+	"crypto/sha256"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"hash/crc32"
+	"io"
+	"reflect"
 	"strings"
 	"testing"
 
@@ -542,3 +549,1096 @@ func TestLookupChildCRCCollisions(t *testing.T) {
 		}
 	}
 }
+
+func TestLookupChildBloom(t *testing.T) {
+	builder := CreateDirBuilder()
+	builder.Options.BloomMinEntries = defaultBloomMinEntries
+	for i := 0; i < 1000; i++ {
+		inode := &InodeData{
+			Mode: unix.S_IFIFO | 0644,
+		}
+		builder.Insert(fmt.Sprintf("file%d", i), inode, 1)
+	}
+
+	dirData := builder.Build()
+	dirReader := bytes.NewReader(dirData)
+
+	hdr, err := ReadDirHeader(dirReader)
+	if err != nil {
+		t.Fatalf("ReadDirHeader failed: %v", err)
+	}
+	if hdr.Flags&DirFlagBloom == 0 {
+		t.Fatal("Expected directory to have a bloom filter")
+	}
+	if hdr.EntryCount != 1000 {
+		t.Errorf("Expected 1000 entries, got %d", hdr.EntryCount)
+	}
+
+	for i := 0; i < 1000; i++ {
+		filename := fmt.Sprintf("file%d", i)
+		dirReader.Seek(0, 0)
+		entry, err := LookupChild(dirReader, filename)
+		if err != nil {
+			t.Fatalf("LookupChild failed for %s: %v", filename, err)
+		}
+		if entry == nil || entry.FileName != filename {
+			t.Fatalf("LookupChild did not find %s", filename)
+		}
+	}
+
+	falsePositives := 0
+	for i := 0; i < 10000; i++ {
+		dirReader.Seek(0, 0)
+		hdr, err := ReadDirHeader(dirReader)
+		if err != nil {
+			t.Fatalf("ReadDirHeader failed: %v", err)
+		}
+
+		filename := fmt.Sprintf("missing%d", i)
+		found, err := hdr.bloomContains(dirReader, crc32.ChecksumIEEE([]byte(filename)))
+		if err != nil {
+			t.Fatalf("bloomContains failed: %v", err)
+		}
+		if found {
+			falsePositives++
+		}
+
+		dirReader.Seek(0, 0)
+		entry, err := LookupChild(dirReader, filename)
+		if err != nil {
+			t.Fatalf("LookupChild failed for %s: %v", filename, err)
+		}
+		if entry != nil {
+			t.Fatalf("LookupChild found missing file %s", filename)
+		}
+	}
+	if falsePositives > 500 {
+		t.Errorf("Bloom filter false positive rate too high: %d/10000", falsePositives)
+	}
+}
+
+func TestDirBuilderNoBloom(t *testing.T) {
+	builder := CreateDirBuilder()
+	builder.Options.BloomMinEntries = 0
+	builder.Options.Salted = false
+	builder.Options.CompactRecords = false
+	for i := 0; i < 100; i++ {
+		inode := &InodeData{
+			Mode: unix.S_IFIFO | 0644,
+		}
+		builder.Insert(fmt.Sprintf("file%d", i), inode, 1)
+	}
+
+	dirReader := bytes.NewReader(builder.Build())
+	hdr, err := ReadDirHeader(dirReader)
+	if err != nil {
+		t.Fatalf("ReadDirHeader failed: %v", err)
+	}
+	if hdr.Flags != 0 || hdr.IndexOffset != 16 || hdr.RecordsOffset != 16+8*100 {
+		t.Errorf("Unexpected header for directory without bloom filter: %+v", hdr)
+	}
+
+	dirReader.Seek(0, 0)
+	entry, err := LookupChild(dirReader, "file42")
+	if err != nil || entry == nil {
+		t.Errorf("LookupChild failed for file42: %v", err)
+	}
+}
+
+func TestSipHash24(t *testing.T) {
+	// Reference vector from the SipHash paper.
+	msg := make([]byte, 15)
+	for i := range msg {
+		msg[i] = byte(i)
+	}
+	h := sipHash24(0x0706050403020100, 0x0f0e0d0c0b0a0908, msg)
+	if h != 0xa129ca6149be45e5 {
+		t.Errorf("Unexpected SipHash-2-4 output %x", h)
+	}
+}
+
+func TestDirBuilderSalted(t *testing.T) {
+	build := func(reverse bool) []byte {
+		builder := CreateDirBuilder()
+		builder.Options.Salted = true
+		for i := 0; i < 200; i++ {
+			ind := i
+			if reverse {
+				ind = 199 - i
+			}
+			inode := &InodeData{
+				Mode: unix.S_IFIFO | 0644,
+			}
+			builder.Insert(fmt.Sprintf("file%d", ind), inode, 1)
+		}
+		return builder.Build()
+	}
+
+	dirData := build(false)
+	if !bytes.Equal(dirData, build(true)) {
+		t.Error("Salted directory depends on insertion order")
+	}
+
+	dirReader := bytes.NewReader(dirData)
+	hdr, err := ReadDirHeader(dirReader)
+	if err != nil {
+		t.Fatalf("ReadDirHeader failed: %v", err)
+	}
+	if hdr.Flags&DirFlagSalted == 0 {
+		t.Fatal("Expected directory to be salted")
+	}
+	if hdr.NameHash("file0") == crc32.ChecksumIEEE([]byte("file0")) {
+		t.Error("Salted name hash should not be the CRC32")
+	}
+
+	for i := 0; i < 200; i++ {
+		filename := fmt.Sprintf("file%d", i)
+		dirReader.Seek(0, 0)
+		entry, err := LookupChild(dirReader, filename)
+		if err != nil {
+			t.Fatalf("LookupChild failed for %s: %v", filename, err)
+		}
+		if entry == nil || entry.FileName != filename {
+			t.Fatalf("LookupChild did not find %s", filename)
+		}
+	}
+}
+
+func TestLookupChildRealCRCCollisions(t *testing.T) {
+	// Pairs of names with equal CRC32 checksums.
+	files := []string{"plumless", "buckeroo", "codding", "gnu", "apple", "banana"}
+
+	builder := CreateDirBuilder()
+	builder.Options.Salted = false
+	for _, filename := range files {
+		inode := &InodeData{
+			Mode: unix.S_IFIFO | 0644,
+		}
+		builder.Insert(filename, inode, 1)
+	}
+
+	dirReader := bytes.NewReader(builder.Build())
+	for _, filename := range append(files, "missing") {
+		dirReader.Seek(0, 0)
+		entry, err := LookupChild(dirReader, filename)
+		if err != nil {
+			t.Fatalf("LookupChild failed for %s: %v", filename, err)
+		}
+		if filename == "missing" {
+			if entry != nil {
+				t.Errorf("LookupChild found missing file")
+			}
+		} else if entry == nil || entry.FileName != filename {
+			t.Errorf("LookupChild did not find %s", filename)
+		}
+	}
+}
+
+func TestLookupChildLongHashRun(t *testing.T) {
+	for _, eytzinger := range []bool{false, true} {
+		for _, count := range []int{maxIndexHashRun, maxIndexHashRun + 1} {
+			builder := CreateDirBuilder()
+			builder.Options.EytzingerIndex = eytzinger
+			for i := 0; i < count; i++ {
+				builder.Insert(fmt.Sprintf("file%d", i), &InodeData{Mode: unix.S_IFIFO | 0644}, 1)
+			}
+			dirData := builder.Build()
+
+			hdr, err := ReadDirHeader(bytes.NewReader(dirData))
+			if err != nil {
+				t.Fatalf("ReadDirHeader failed: %v", err)
+			}
+
+			// Rewrite the index so every entry shares the hash of a missing
+			// name.
+			missingHash := crc32.ChecksumIEEE([]byte("missing"))
+			for i := uint32(0); i < hdr.EntryCount; i++ {
+				binary.BigEndian.PutUint32(dirData[hdr.IndexOffset+8*i+4:], missingHash)
+			}
+
+			entry, err := LookupChild(bytes.NewReader(dirData), "missing")
+			if count > maxIndexHashRun && err == nil {
+				t.Errorf("LookupChild scanned a run of %d equal hashes (eytzinger=%v)", count, eytzinger)
+			} else if count <= maxIndexHashRun && (err != nil || entry != nil) {
+				t.Errorf("LookupChild failed on a run of %d equal hashes (eytzinger=%v): %v, %v",
+					count, eytzinger, entry, err)
+			}
+
+			view, err := NewDirView(dirData)
+			if err != nil {
+				t.Fatalf("NewDirView failed: %v", err)
+			}
+			var rec DirRecord
+			found, err := view.Lookup("missing", &rec)
+			if count > maxIndexHashRun && err == nil {
+				t.Errorf("DirView scanned a run of %d equal hashes (eytzinger=%v)", count, eytzinger)
+			} else if count <= maxIndexHashRun && (err != nil || found) {
+				t.Errorf("DirView failed on a run of %d equal hashes (eytzinger=%v): %v, %v",
+					count, eytzinger, found, err)
+			}
+		}
+	}
+}
+
+func TestBuildSaltsLongCRCRuns(t *testing.T) {
+	builder := CreateDirBuilder()
+	files := make([]string, maxIndexHashRun+1)
+	for i := range files {
+		files[i] = fmt.Sprintf("file%d", i)
+		builder.Insert(files[i], &InodeData{Mode: unix.S_IFIFO | 0644}, 1)
+	}
+	// Pretend the names all collide under CRC32.
+	for i := range builder.DirEntries {
+		builder.DirEntries[i].FileNameChecksum = 7
+	}
+
+	dirReader := bytes.NewReader(builder.Build())
+	hdr, err := ReadDirHeader(dirReader)
+	if err != nil {
+		t.Fatalf("ReadDirHeader failed: %v", err)
+	}
+	if hdr.Flags&DirFlagSalted == 0 {
+		t.Fatalf("directory with a long CRC32 run was not salted")
+	}
+	for _, filename := range files {
+		dirReader.Seek(0, 0)
+		entry, err := LookupChild(dirReader, filename)
+		if err != nil || entry == nil || entry.FileName != filename {
+			t.Errorf("LookupChild did not find %s: %v", filename, err)
+		}
+	}
+}
+
+func TestLookupChildPerfectHash(t *testing.T) {
+	for _, count := range []int{1, 2, 3, 7, 5000} {
+		builder := CreateDirBuilder()
+		builder.Options.Salted = true
+		builder.Options.PerfectHashMinEntries = 1
+		for i := 0; i < count; i++ {
+			inode := &InodeData{
+				Mode: unix.S_IFIFO | 0644,
+			}
+			builder.Insert(fmt.Sprintf("file%d", i), inode, 1)
+		}
+
+		dirReader := bytes.NewReader(builder.Build())
+		hdr, err := ReadDirHeader(dirReader)
+		if err != nil {
+			t.Fatalf("ReadDirHeader failed: %v", err)
+		}
+		if hdr.Flags&DirFlagPerfectHash == 0 {
+			t.Fatalf("Expected directory of %d entries to have a perfect hash", count)
+		}
+
+		for i := 0; i < count; i++ {
+			filename := fmt.Sprintf("file%d", i)
+			dirReader.Seek(0, 0)
+			entry, err := LookupChild(dirReader, filename)
+			if err != nil {
+				t.Fatalf("LookupChild failed for %s: %v", filename, err)
+			}
+			if entry == nil || entry.FileName != filename {
+				t.Fatalf("LookupChild did not find %s in %d entries", filename, count)
+			}
+		}
+		for i := 0; i < 1000; i++ {
+			filename := fmt.Sprintf("missing%d", i)
+			dirReader.Seek(0, 0)
+			entry, err := LookupChild(dirReader, filename)
+			if err != nil {
+				t.Fatalf("LookupChild failed for %s: %v", filename, err)
+			}
+			if entry != nil {
+				t.Fatalf("LookupChild found missing file %s", filename)
+			}
+		}
+	}
+}
+
+func TestLookupChildEytzinger(t *testing.T) {
+	collisions := []string{"plumless", "buckeroo", "codding", "gnu"}
+	for _, count := range []int{0, 1, 2, 3, 7, 8, 100, 1000} {
+		for _, salted := range []bool{false, true} {
+			builder := CreateDirBuilder()
+			builder.Options.Salted = salted
+			builder.Options.PerfectHashMinEntries = 0
+			builder.Options.EytzingerIndex = true
+			files := append([]string(nil), collisions...)
+			for i := 0; i < count; i++ {
+				files = append(files, fmt.Sprintf("file%d", i))
+			}
+			for _, filename := range files {
+				inode := &InodeData{
+					Mode: unix.S_IFIFO | 0644,
+				}
+				builder.Insert(filename, inode, 1)
+			}
+
+			dirReader := bytes.NewReader(builder.Build())
+			hdr, err := ReadDirHeader(dirReader)
+			if err != nil {
+				t.Fatalf("ReadDirHeader failed: %v", err)
+			}
+			if hdr.Flags&DirFlagEytzinger == 0 {
+				t.Fatal("Expected directory to have an Eytzinger index")
+			}
+
+			for _, filename := range append(files, "missing", "file-1") {
+				dirReader.Seek(0, 0)
+				entry, err := LookupChild(dirReader, filename)
+				if err != nil {
+					t.Fatalf("LookupChild failed for %s: %v", filename, err)
+				}
+				if strings.HasPrefix(filename, "missing") || filename == "file-1" {
+					if entry != nil {
+						t.Errorf("LookupChild found missing file %s", filename)
+					}
+				} else if entry == nil || entry.FileName != filename {
+					t.Errorf("LookupChild did not find %s in %d entries", filename, len(files))
+				}
+			}
+		}
+	}
+}
+
+// Compare lookups in a sorted index against an Eytzinger index. Bloom filters
+// and perfect hashing are disabled so both searches run in full.
+func BenchmarkLookupChild(b *testing.B) {
+	for _, count := range []int{10, 1000, 100000, 1000000} {
+		for _, eytzinger := range []bool{false, true} {
+			builder := CreateDirBuilder()
+			builder.Options.BloomMinEntries = 0
+			builder.Options.PerfectHashMinEntries = 0
+			builder.Options.EytzingerIndex = eytzinger
+			for i := 0; i < count; i++ {
+				inode := &InodeData{
+					Mode: unix.S_IFIFO | 0644,
+				}
+				builder.Insert(fmt.Sprintf("file%d", i), inode, 1)
+			}
+			dirReader := bytes.NewReader(builder.Build())
+
+			layout := "sorted"
+			if eytzinger {
+				layout = "eytzinger"
+			}
+			b.Run(fmt.Sprintf("%s/%d", layout, count), func(b *testing.B) {
+				for i := 0; i < b.N; i++ {
+					dirReader.Seek(0, 0)
+					entry, err := LookupChild(dirReader, fmt.Sprintf("file%d", i%count))
+					if err != nil || entry == nil {
+						b.Fatalf("LookupChild failed: %v", err)
+					}
+				}
+			})
+		}
+	}
+}
+
+// In-memory hcas.Session for building sharded directories.
+type memSession struct {
+	objects map[hcas.Name][]byte
+}
+
+func (s *memSession) GetLabel(namespace string, label string) (*hcas.Name, error) {
+	return nil, nil
+}
+
+func (s *memSession) SetLabel(namespace string, label string, name *hcas.Name) error {
+	return nil
+}
+
+func (s *memSession) CreateObject(data []byte, deps ...hcas.Name) (*hcas.Name, error) {
+	sum := sha256.Sum256(data)
+	name := hcas.NewName(string(sum[:]))
+	s.objects[name] = data
+	return &name, nil
+}
+
+func (s *memSession) StreamObject(deps ...hcas.Name) (hcas.ObjectWriter, error) {
+	return nil, errors.New("not implemented")
+}
+
+func (s *memSession) Close() error {
+	return nil
+}
+
+type memObject struct {
+	*bytes.Reader
+}
+
+func (o memObject) Close() error {
+	return nil
+}
+
+func (s *memSession) open(name *hcas.Name) (io.ReadSeekCloser, error) {
+	data, ok := s.objects[*name]
+	if !ok {
+		return nil, errors.New("object not found")
+	}
+	return memObject{bytes.NewReader(data)}, nil
+}
+
+func buildShardedTestDir(t *testing.T, hs *memSession, count int) (*dirBuilder, *hcas.Name) {
+	builder := CreateDirBuilder()
+	builder.Options.ShardMinEntries = 100
+	builder.Options.ShardEntries = 8
+	builder.Options.ShardFanout = 4
+	builder.Options.BloomMinEntries = defaultBloomMinEntries
+	builder.Options.Salted = true
+	builder.Options.PerfectHashMinEntries = 1
+	builder.Options.CompactRecords = true
+
+	subDirName := hcas.NewName(strings.Repeat("d", 32))
+	for i := 0; i < count; i++ {
+		if i%10 == 0 {
+			inode := &InodeData{
+				Mode:    unix.S_IFDIR | 0755,
+				ObjName: &subDirName,
+			}
+			builder.Insert(fmt.Sprintf("dir%d", i), inode, 3)
+		} else {
+			inode := &InodeData{
+				Mode: unix.S_IFIFO | 0644,
+			}
+			builder.Insert(fmt.Sprintf("file%d", i), inode, 1)
+		}
+	}
+
+	name, err := builder.BuildObject(hs)
+	if err != nil {
+		t.Fatalf("BuildObject failed: %v", err)
+	}
+	return builder, name
+}
+
+func TestShardedDirectory(t *testing.T) {
+	hs := &memSession{objects: make(map[hcas.Name][]byte)}
+	builder, name := buildShardedTestDir(t, hs, 2000)
+	if len(hs.objects) < 10 {
+		t.Fatalf("Expected directory to be sharded, got %d objects", len(hs.objects))
+	}
+
+	dirData, _ := hs.open(name)
+	hdr, err := ReadDirHeader(dirData)
+	if err != nil {
+		t.Fatalf("ReadDirHeader failed: %v", err)
+	}
+	if hdr.Flags&DirFlagSharded == 0 || hdr.EntryCount != 2000 ||
+		hdr.TreeSize != builder.TotalTreeSize {
+		t.Fatalf("Unexpected sharded directory header: %+v", hdr)
+	}
+
+	dirData.Seek(0, 0)
+	if _, err := LookupChild(dirData, "file1"); err == nil {
+		t.Error("LookupChild should reject sharded directories")
+	}
+
+	// Entries must cover the directory's inode range exactly once.
+	dirData.Seek(0, 0)
+	entries, err := ReadDirEntries(hs.open, dirData, 0, 1<<20)
+	if err != nil {
+		t.Fatalf("ReadDirEntries failed: %v", err)
+	}
+	if len(entries) != 2000 {
+		t.Fatalf("ReadDirEntries returned %d entries, expected 2000", len(entries))
+	}
+	ranges := make(map[uint64]uint64)
+	for i := range entries {
+		ranges[entries[i].ParentDepIndex] = 1
+		if strings.HasPrefix(entries[i].FileName, "dir") {
+			ranges[entries[i].ParentDepIndex] = 3
+		}
+	}
+	for next := uint64(1); next < builder.TotalTreeSize; {
+		treeSize, ok := ranges[next]
+		if !ok {
+			t.Fatalf("No entry has ParentDepIndex %d", next)
+		}
+		next += treeSize
+	}
+
+	// Reading in small batches must return the same sequence.
+	for pos := 0; pos < len(entries); pos += 7 {
+		dirData.Seek(0, 0)
+		batch, err := ReadDirEntries(hs.open, dirData, uint32(pos), 7)
+		if err != nil {
+			t.Fatalf("ReadDirEntries failed at %d: %v", pos, err)
+		}
+		for i := range batch {
+			if batch[i].FileName != entries[pos+i].FileName ||
+				batch[i].ParentDepIndex != entries[pos+i].ParentDepIndex {
+				t.Fatalf("ReadDirEntries mismatch at %d", pos+i)
+			}
+		}
+	}
+
+	for i := range entries {
+		dirData.Seek(0, 0)
+		entry, err := LookupChildSharded(hs.open, dirData, entries[i].FileName)
+		if err != nil {
+			t.Fatalf("LookupChildSharded failed for %s: %v", entries[i].FileName, err)
+		}
+		if entry == nil || entry.ParentDepIndex != entries[i].ParentDepIndex {
+			t.Fatalf("LookupChildSharded returned wrong entry for %s", entries[i].FileName)
+		}
+	}
+	dirData.Seek(0, 0)
+	entry, err := LookupChildSharded(hs.open, dirData, "missing")
+	if err != nil || entry != nil {
+		t.Errorf("LookupChildSharded found missing file: %v", err)
+	}
+}
+
+func TestShardedDirectoryEdit(t *testing.T) {
+	hs := &memSession{objects: make(map[hcas.Name][]byte)}
+	buildShardedTestDir(t, hs, 2000)
+	before := len(hs.objects)
+
+	// Adding one entry should only rewrite the path to its leaf.
+	buildShardedTestDir(t, hs, 2001)
+	if added := len(hs.objects) - before; added > 8 {
+		t.Errorf("Adding one entry created %d new objects", added)
+	}
+}
+
+func TestCompactRecordRoundTrip(t *testing.T) {
+	objName := hcas.NewName("0123456789abcdef0123456789abcdef")
+	entries := []DirEntry{
+		{
+			Inode: InodeData{
+				Mode:    unix.S_IFREG | 0644,
+				Uid:     1000,
+				Gid:     1000,
+				Atim:    1640995200000000000,
+				Mtim:    1640995100000000000,
+				Ctim:    1640995300000000000,
+				Size:    1024,
+				ObjName: &objName,
+			},
+			FileName:       "test.txt",
+			ParentDepIndex: 100,
+		},
+		{
+			Inode: InodeData{
+				Mode:    unix.S_IFDIR | 0755,
+				Nlink:   3,
+				Atim:    1,
+				Mtim:    1640995200000000000,
+				Ctim:    1640995200000000000,
+				Size:    4096,
+				ObjName: &objName,
+			},
+			FileName:       "subdir",
+			ParentDepIndex: 200,
+		},
+		{
+			Inode: InodeData{
+				Mode: unix.S_IFCHR | 0666,
+				Gid:  5,
+				Dev:  0x0501,
+				Mtim: 1640995200000000000,
+			},
+			FileName:       strings.Repeat("a", 255),
+			ParentDepIndex: 1,
+		},
+	}
+
+	hdr := DirHeader{
+		Flags:    DirFlagCompactRecords,
+		TimeBase: 1640995000000000000,
+	}
+	var data []byte
+	for i := range entries {
+		data = entries[i].encodeCompact(data, hdr.TimeBase)
+	}
+
+	// Records are back to back, each read must leave the stream at the next.
+	reader := bytes.NewReader(data)
+	for i := range entries {
+		var decoded DirEntry
+		err := hdr.readRecord(reader, &decoded)
+		if err != nil {
+			t.Fatalf("readRecord failed for %s: %v", entries[i].FileName, err)
+		}
+
+		want := entries[i]
+		if !unix.S_ISDIR(want.Inode.Mode) {
+			want.Inode.Nlink = 1
+		}
+		if decoded.Inode.ObjName != nil {
+			if want.Inode.ObjName == nil || *decoded.Inode.ObjName != *want.Inode.ObjName {
+				t.Errorf("ObjName mismatch for %s", want.FileName)
+			}
+			decoded.Inode.ObjName = want.Inode.ObjName
+		}
+		if !reflect.DeepEqual(decoded.Inode, want.Inode) || decoded.FileName != want.FileName ||
+			decoded.ParentDepIndex != want.ParentDepIndex {
+			t.Errorf("Compact record mismatch: got %+v, want %+v", decoded, want)
+		}
+	}
+	if reader.Len() != 0 {
+		t.Errorf("%d bytes left after reading all records", reader.Len())
+	}
+}
+
+func TestDirBuilderCompactRecords(t *testing.T) {
+	build := func(compact bool) []byte {
+		builder := CreateDirBuilder()
+		builder.Options.CompactRecords = compact
+		for i := 0; i < 500; i++ {
+			inode := &InodeData{
+				Mode: unix.S_IFIFO | 0644,
+				Uid:  1000,
+				Gid:  1000,
+				Atim: 1640995200000000000 + uint64(i),
+				Mtim: 1640995200000000000 + uint64(i),
+				Ctim: 1640995200000000000 + uint64(i),
+			}
+			builder.Insert(fmt.Sprintf("file%d", i), inode, 1)
+		}
+		return builder.Build()
+	}
+
+	fullData := build(false)
+	compactData := build(true)
+	if 2*len(compactData) > len(fullData) {
+		t.Errorf("Compact directory is %d bytes, full directory %d bytes",
+			len(compactData), len(fullData))
+	}
+
+	fullReader := bytes.NewReader(fullData)
+	compactReader := bytes.NewReader(compactData)
+	for i := 0; i < 500; i++ {
+		filename := fmt.Sprintf("file%d", i)
+		fullReader.Seek(0, 0)
+		compactReader.Seek(0, 0)
+		full, err := LookupChild(fullReader, filename)
+		if err != nil || full == nil {
+			t.Fatalf("LookupChild failed for %s: %v", filename, err)
+		}
+		compact, err := LookupChild(compactReader, filename)
+		if err != nil || compact == nil {
+			t.Fatalf("LookupChild failed for %s: %v", filename, err)
+		}
+		full.FileNameChecksum, compact.FileNameChecksum = 0, 0
+		if !reflect.DeepEqual(full, compact) {
+			t.Errorf("Compact entry mismatch: got %+v, want %+v", compact, full)
+		}
+	}
+}
+
+func TestInlineRecordRoundTrip(t *testing.T) {
+	entries := []DirEntry{
+		{
+			Inode: InodeData{
+				Mode:       unix.S_IFREG | 0644,
+				Mtim:       1640995200000000000,
+				Size:       5,
+				InlineData: []byte("hello"),
+			},
+			FileName: "small.txt",
+		},
+		{
+			Inode: InodeData{
+				Mode:       unix.S_IFREG | 0644,
+				Mtim:       1640995200000000000,
+				InlineData: []byte{},
+			},
+			FileName: "empty.txt",
+		},
+		{
+			Inode: InodeData{
+				Mode:       unix.S_IFLNK | 0777,
+				Mtim:       1640995200000000000,
+				Size:       MaxInlineSize,
+				InlineData: []byte(strings.Repeat("t", MaxInlineSize)),
+			},
+			FileName: "link",
+		},
+		{
+			Inode: InodeData{
+				Mode:       unix.S_IFDIR | 0755,
+				Nlink:      2,
+				Mtim:       1640995200000000000,
+				Size:       4096,
+				InlineData: []byte{},
+			},
+			FileName: "emptydir",
+		},
+	}
+
+	for _, compact := range []bool{false, true} {
+		hdr := DirHeader{TimeBase: 1640995000000000000}
+		if compact {
+			hdr.Flags = DirFlagCompactRecords
+		}
+		var data []byte
+		for i := range entries {
+			if compact {
+				data = entries[i].encodeCompact(data, hdr.TimeBase)
+			} else {
+				data = append(data, entries[i].Encode()...)
+			}
+		}
+
+		reader := bytes.NewReader(data)
+		for i := range entries {
+			var decoded DirEntry
+			err := hdr.readRecord(reader, &decoded)
+			if err != nil {
+				t.Fatalf("readRecord failed for %s: %v", entries[i].FileName, err)
+			}
+
+			want := entries[i]
+			if !unix.S_ISDIR(want.Inode.Mode) {
+				want.Inode.Nlink = 1
+			}
+			if !reflect.DeepEqual(decoded, want) {
+				t.Errorf("Inline record mismatch (compact=%v): got %+v, want %+v",
+					compact, decoded, want)
+			}
+		}
+		if reader.Len() != 0 {
+			t.Errorf("%d bytes left after reading all records", reader.Len())
+		}
+	}
+}
+
+func TestDirBuilderInline(t *testing.T) {
+	builder := CreateDirBuilder()
+	builder.Options.InlineContent = true
+	builder.Insert("small.txt", &InodeData{
+		Mode:       unix.S_IFREG | 0644,
+		Size:       5,
+		InlineData: []byte("hello"),
+	}, 1)
+	builder.Insert("emptydir", &InodeData{
+		Mode:       unix.S_IFDIR | 0755,
+		Nlink:      2,
+		InlineData: []byte{},
+	}, 1)
+	if len(builder.DepNames) != 0 {
+		t.Errorf("Expected no dependencies, got %d", len(builder.DepNames))
+	}
+
+	reader := bytes.NewReader(builder.Build())
+	small, err := LookupChild(reader, "small.txt")
+	if err != nil || small == nil {
+		t.Fatalf("LookupChild failed for small.txt: %v", err)
+	}
+	if small.Inode.ObjName != nil || string(small.Inode.InlineData) != "hello" {
+		t.Errorf("Unexpected inline file %+v", small.Inode)
+	}
+
+	reader.Seek(0, 0)
+	emptyDir, err := LookupChild(reader, "emptydir")
+	if err != nil || emptyDir == nil {
+		t.Fatalf("LookupChild failed for emptydir: %v", err)
+	}
+	if emptyDir.Inode.ObjName != nil || emptyDir.Inode.InlineData == nil ||
+		len(emptyDir.Inode.InlineData) != 0 {
+		t.Errorf("Unexpected inline directory %+v", emptyDir.Inode)
+	}
+
+	func() {
+		defer func() {
+			if recover() == nil {
+				t.Error("Insert accepted inline data larger than MaxInlineSize")
+			}
+		}()
+		builder := CreateDirBuilder()
+		builder.Options.InlineContent = true
+		builder.Insert("big.txt", &InodeData{
+			Mode:       unix.S_IFREG | 0644,
+			Size:       MaxInlineSize + 1,
+			InlineData: make([]byte, MaxInlineSize+1),
+		}, 1)
+	}()
+
+	func() {
+		defer func() {
+			if recover() == nil {
+				t.Error("Insert accepted inline data without InlineContent")
+			}
+		}()
+		CreateDirBuilder().Insert("small.txt", &InodeData{
+			Mode:       unix.S_IFREG | 0644,
+			Size:       5,
+			InlineData: []byte("hello"),
+		}, 1)
+	}()
+}
+
+func (s *memSession) openView(name *hcas.Name) (*DirView, io.Closer, error) {
+	data, ok := s.objects[*name]
+	if !ok {
+		return nil, nil, errors.New("object not found")
+	}
+	view, err := NewDirView(data)
+	if err != nil {
+		return nil, nil, err
+	}
+	return view, io.NopCloser(nil), nil
+}
+
+// Build a directory of count entries mixing files with objects, inline files
+// and FIFOs.
+func buildViewTestDir(count int, options DirBuildOptions) []byte {
+	objName := hcas.NewName(strings.Repeat("o", 32))
+	builder := CreateDirBuilder()
+	builder.Options = options
+	builder.Options.InlineContent = true
+	for i := 0; i < count; i++ {
+		inode := &InodeData{
+			Mode: unix.S_IFIFO | 0644,
+			Uid:  uint32(i),
+			Mtim: 1640995200000000000 + uint64(i),
+		}
+		switch i % 3 {
+		case 0:
+			inode.Mode = unix.S_IFREG | 0644
+			inode.Size = 4096
+			inode.ObjName = &objName
+		case 1:
+			inode.Mode = unix.S_IFREG | 0644
+			inode.Size = 5
+			inode.InlineData = []byte("small")
+		}
+		builder.Insert(fmt.Sprintf("entry-%d", i), inode, 1)
+	}
+	return builder.Build()
+}
+
+func dirViewTestOptions() map[string]DirBuildOptions {
+	plain := DefaultDirBuildOptions()
+	plain.BloomMinEntries = 0
+	plain.Salted = false
+	plain.PerfectHashMinEntries = 0
+	plain.CompactRecords = false
+
+	perfectHash := DefaultDirBuildOptions()
+	perfectHash.BloomMinEntries = defaultBloomMinEntries
+	perfectHash.Salted = true
+	perfectHash.CompactRecords = true
+	perfectHash.PerfectHashMinEntries = 1
+
+	eytzinger := DefaultDirBuildOptions()
+	eytzinger.BloomMinEntries = defaultBloomMinEntries
+	eytzinger.Salted = true
+	eytzinger.CompactRecords = true
+	eytzinger.PerfectHashMinEntries = 0
+	eytzinger.EytzingerIndex = true
+
+	return map[string]DirBuildOptions{
+		"plain":       plain,
+		"default":     DefaultDirBuildOptions(),
+		"perfectHash": perfectHash,
+		"eytzinger":   eytzinger,
+	}
+}
+
+func TestDirViewMatchesStream(t *testing.T) {
+	for optionsName, options := range dirViewTestOptions() {
+		data := buildViewTestDir(500, options)
+		view, err := NewDirView(data)
+		if err != nil {
+			t.Fatalf("%s: NewDirView failed: %v", optionsName, err)
+		}
+
+		reader := bytes.NewReader(data)
+		entries, err := ReadDirEntries(nil, reader, 0, 1<<20)
+		if err != nil || len(entries) != 500 {
+			t.Fatalf("%s: ReadDirEntries failed: %v", optionsName, err)
+		}
+
+		// Iteration must match ReadDirEntries from any starting position.
+		for _, start := range []uint32{0, 1, 250, 499, 500} {
+			var rec DirRecord
+			it := view.Iter(start)
+			pos := int(start)
+			for it.Next(&rec) {
+				if !reflect.DeepEqual(rec.DirEntry(), entries[pos]) {
+					t.Fatalf("%s: record %d mismatch: got %+v, want %+v",
+						optionsName, pos, rec.DirEntry(), entries[pos])
+				}
+				pos++
+			}
+			if it.Err() != nil || pos != len(entries) {
+				t.Fatalf("%s: iteration from %d stopped at %d: %v",
+					optionsName, start, pos, it.Err())
+			}
+		}
+
+		for i := range entries {
+			var rec DirRecord
+			found, err := view.Lookup(entries[i].FileName, &rec)
+			if err != nil || !found {
+				t.Fatalf("%s: Lookup failed for %s: %v", optionsName, entries[i].FileName, err)
+			}
+			if !reflect.DeepEqual(rec.DirEntry(), entries[i]) {
+				t.Errorf("%s: Lookup returned %+v, want %+v", optionsName, rec.DirEntry(), entries[i])
+			}
+		}
+		for _, name := range []string{"missing", "entry-500", strings.Repeat("x", 300)} {
+			var rec DirRecord
+			found, err := view.Lookup(name, &rec)
+			if err != nil || found {
+				t.Errorf("%s: Lookup found missing name %s: %v", optionsName, name, err)
+			}
+		}
+	}
+}
+
+func TestDirViewAllocations(t *testing.T) {
+	for optionsName, options := range dirViewTestOptions() {
+		view, err := NewDirView(buildViewTestDir(500, options))
+		if err != nil {
+			t.Fatalf("%s: NewDirView failed: %v", optionsName, err)
+		}
+
+		var rec DirRecord
+		allocs := testing.AllocsPerRun(100, func() {
+			view.Lookup("entry-123", &rec)
+			view.Lookup("missing", &rec)
+			it := view.Iter(0)
+			for it.Next(&rec) {
+			}
+		})
+		if allocs != 0 {
+			t.Errorf("%s: DirView allocated %v times per run", optionsName, allocs)
+		}
+	}
+}
+
+func TestDirViewTruncated(t *testing.T) {
+	data := buildViewTestDir(50, DefaultDirBuildOptions())
+	for n := 0; n < len(data); n++ {
+		view, err := NewDirView(data[:n])
+		if err != nil {
+			continue
+		}
+
+		// Records past the end must fail to decode rather than panic.
+		var rec DirRecord
+		view.Lookup("entry-49", &rec)
+		it := view.Iter(0)
+		for it.Next(&rec) {
+		}
+		if it.Err() == nil {
+			t.Fatalf("Iteration over %d of %d bytes succeeded", n, len(data))
+		}
+	}
+}
+
+func TestShardedDirView(t *testing.T) {
+	hs := &memSession{objects: make(map[hcas.Name][]byte)}
+	_, name := buildShardedTestDir(t, hs, 2000)
+
+	dirData, _ := hs.open(name)
+	entries, err := ReadDirEntries(hs.open, dirData, 0, 1<<20)
+	if err != nil {
+		t.Fatalf("ReadDirEntries failed: %v", err)
+	}
+
+	view, _, err := hs.openView(name)
+	if err != nil {
+		t.Fatalf("NewDirView failed: %v", err)
+	}
+	var rec DirRecord
+	if _, err := view.Lookup("file1", &rec); err == nil {
+		t.Error("Lookup should reject sharded directories")
+	}
+
+	// Walking must return the same sequence from any starting position, and
+	// stop when asked to.
+	for _, start := range []int{0, 7, 1999} {
+		pos := start
+		err := WalkDirView(hs.openView, view, uint32(start), func(rec *DirRecord) bool {
+			if string(rec.FileName) != entries[pos].FileName ||
+				rec.ParentDepIndex != entries[pos].ParentDepIndex {
+				t.Fatalf("WalkDirView mismatch at %d", pos)
+			}
+			pos++
+			return pos < start+100
+		})
+		if err != nil {
+			t.Fatalf("WalkDirView failed: %v", err)
+		}
+		if want := min(start+100, len(entries)); pos != want {
+			t.Errorf("WalkDirView from %d stopped at %d, expected %d", start, pos, want)
+		}
+	}
+
+	for i := range entries {
+		entry, err := LookupChildView(hs.openView, view, entries[i].FileName)
+		if err != nil {
+			t.Fatalf("LookupChildView failed for %s: %v", entries[i].FileName, err)
+		}
+		if entry == nil || !reflect.DeepEqual(*entry, entries[i]) {
+			t.Fatalf("LookupChildView returned wrong entry for %s", entries[i].FileName)
+		}
+	}
+	entry, err := LookupChildView(hs.openView, view, "missing")
+	if err != nil || entry != nil {
+		t.Errorf("LookupChildView found missing file: %v", err)
+	}
+}
+
+func BenchmarkLookupChildStream(b *testing.B) {
+	reader := bytes.NewReader(buildViewTestDir(10000, DefaultDirBuildOptions()))
+	names := make([]string, 10000)
+	for i := range names {
+		names[i] = fmt.Sprintf("entry-%d", i)
+	}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		reader.Seek(0, 0)
+		LookupChild(reader, names[i%len(names)])
+	}
+}
+
+func BenchmarkDirViewLookup(b *testing.B) {
+	view, err := NewDirView(buildViewTestDir(10000, DefaultDirBuildOptions()))
+	if err != nil {
+		b.Fatal(err)
+	}
+	names := make([]string, 10000)
+	for i := range names {
+		names[i] = fmt.Sprintf("entry-%d", i)
+	}
+
+	var rec DirRecord
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		view.Lookup(names[i%len(names)], &rec)
+	}
+}
+
+func BenchmarkReadDirEntries(b *testing.B) {
+	reader := bytes.NewReader(buildViewTestDir(10000, DefaultDirBuildOptions()))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		reader.Seek(0, 0)
+		ReadDirEntries(nil, reader, 0, 10000)
+	}
+}
+
+func BenchmarkDirViewIter(b *testing.B) {
+	view, err := NewDirView(buildViewTestDir(10000, DefaultDirBuildOptions()))
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	var rec DirRecord
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		it := view.Iter(0)
+		for it.Next(&rec) {
+		}
+	}
+}
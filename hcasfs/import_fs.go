@@ -10,43 +10,70 @@ import (
 	"github.com/msg555/hcas/unix"
 )
 
-func importLink(hs hcas.Session, fd int) (*hcas.Name, uint64, error) {
+// Read the contents of a regular file small enough to be stored inline. The
+// returned size exceeds MaxInlineSize if the file has grown since it was
+// statted.
+func importInline(fd int) ([]byte, uint64, error) {
+	buf := make([]byte, MaxInlineSize+1)
+	var total int
+	for total < len(buf) {
+		bytesRead, err := unix.Read(fd, buf[total:])
+		if err != nil {
+			return nil, 0, err
+		}
+		if bytesRead == 0 {
+			break
+		}
+		total += bytesRead
+	}
+	return buf[:total:total], uint64(total), nil
+}
+
+// Import the target of a symlink, returning it as inline data instead if inline
+// is set and it is at most MaxInlineSize bytes.
+func importLink(hs hcas.Session, fd int, inline bool) (*hcas.Name, []byte, uint64, error) {
 	buf := make([]byte, unix.PATH_MAX)
 	bytesRead, err := unix.Readlinkat(fd, "", buf)
 	if err != nil {
-		return nil, 0, err
+		return nil, nil, 0, err
+	}
+	if inline && bytesRead <= MaxInlineSize {
+		return nil, buf[:bytesRead:bytesRead], uint64(bytesRead), nil
 	}
 
 	writer, err := hs.StreamObject()
 	if err != nil {
-		return nil, 0, err
+		return nil, nil, 0, err
 	}
 
 	bufRead := buf[:bytesRead]
 	for total := 0; total < bytesRead; {
 		bytesWritten, err := writer.Write(bufRead[total:])
 		if err != nil {
-			return nil, 0, err
+			return nil, nil, 0, err
 		}
 		total += bytesWritten
 	}
 
 	err = writer.Close()
 	if err != nil {
-		return nil, 0, err
+		return nil, nil, 0, err
 	}
 
-	return writer.Name(), uint64(bytesRead), nil
+	return writer.Name(), nil, uint64(bytesRead), nil
 }
 
-func importDirectory(hs hcas.Session, fd int) (*hcas.Name, uint64, uint64, error) {
+// Import the children of the directory fd into a new dirBuilder, which the
+// caller builds.
+func importDirectory(hs hcas.Session, fd int, options *DirBuildOptions) (*dirBuilder, error) {
 	buf := make([]byte, 1<<16)
 	dirBuilder := CreateDirBuilder()
+	dirBuilder.Options = *options
 
 	for {
 		bytesRead, err := unix.Getdents(fd, buf)
 		if err != nil {
-			return nil, 0, 0, err
+			return nil, err
 		}
 		if bytesRead == 0 {
 			break
@@ -78,62 +105,78 @@ func importDirectory(hs hcas.Session, fd int) (*hcas.Name, uint64, uint64, error
 			}
 			childFd, err := unix.Openat(fd, fileName, flags, 0)
 			if err != nil {
-				return nil, 0, 0, err
+				return nil, err
 			}
 
 			var childSt unix.Stat_t
 			err = unix.Fstat(childFd, &childSt)
 			if err != nil {
 				unix.Close(childFd)
-				return nil, 0, 0, err
+				return nil, err
 			}
 
 			if (childSt.Mode & unix.S_IFMT) != (uint32(tp) << 12) {
 				unix.Close(childFd)
-				return nil, 0, 0, errors.New("Unexpected file type statting file")
+				return nil, errors.New("Unexpected file type statting file")
 			}
 
 			var childObjName *hcas.Name
+			var childInline []byte
 			var childSize uint64
 			var childTreeSize uint64 = 1
 			var childSubDirs uint64 = 1
 
-			if tp == unix.DT_REG {
+			if tp == unix.DT_REG && options.InlineContent && childSt.Size <= MaxInlineSize {
+				childInline, childSize, err = importInline(childFd)
+			} else if tp == unix.DT_REG {
 				childObjName, childSize, err = importRegular(hs, childFd)
 			} else if tp == unix.DT_DIR {
-				childObjName, childTreeSize, childSubDirs, err = importDirectory(hs, childFd)
+				childObjName, childInline, childTreeSize, childSubDirs, err = importSubdir(hs, childFd, options)
 			} else if tp == unix.DT_LNK {
-				childObjName, childSize, err = importLink(hs, childFd)
+				childObjName, childInline, childSize, err = importLink(hs, childFd, options.InlineContent)
 			}
 			if err != nil {
 				unix.Close(childFd)
-				return nil, 0, 0, err
+				return nil, err
 			}
 			err = unix.Close(childFd)
 			if err != nil {
-				return nil, 0, 0, err
+				return nil, err
 			}
 			if (tp == unix.DT_REG || tp == unix.DT_LNK) && childSize != uint64(childSt.Size) {
-				return nil, 0, 0, errors.New("File size changed while reading data")
+				return nil, errors.New("File size changed while reading data")
 			}
 
 			childInode := InodeFromStat(childSt, childObjName)
+			childInode.InlineData = childInline
 			if tp == unix.DT_DIR {
 				childInode.Nlink = childSubDirs + 2
 			}
 
-			dirBuilder.Insert(fileName, InodeFromStat(childSt, childObjName), childTreeSize)
+			dirBuilder.Insert(fileName, childInode, childTreeSize)
 		}
 	}
 
-	name, err := hs.CreateObject(dirBuilder.Build(), dirBuilder.DepNames...)
+	return dirBuilder, nil
+}
+
+// Import the subdirectory fd, returning its object name or inline data along
+// with its tree size and number of subdirectories.
+func importSubdir(hs hcas.Session, fd int, options *DirBuildOptions) (*hcas.Name, []byte, uint64, uint64, error) {
+	builder, err := importDirectory(hs, fd, options)
 	if err != nil {
-		return nil, 0, 0, err
+		return nil, nil, 0, 0, err
 	}
-	return name, dirBuilder.TotalTreeSize, dirBuilder.SubDirs, nil
+	name, inline, err := builder.buildSubdir(hs)
+	return name, inline, builder.TotalTreeSize, builder.SubDirs, err
 }
 
 func ImportPath(hs hcas.Session, path string) (*hcas.Name, error) {
+	return ImportPathWithOptions(hs, path, DefaultDirBuildOptions())
+}
+
+// Same as ImportPath, building directories with the given options.
+func ImportPathWithOptions(hs hcas.Session, path string, options DirBuildOptions) (*hcas.Name, error) {
 	flags := unix.O_DIRECTORY | unix.O_RDONLY
 	fd, err := unix.Open(path, flags, 0)
 	if err != nil {
@@ -150,6 +193,9 @@ func ImportPath(hs hcas.Session, path string) (*hcas.Name, error) {
 	if !unix.S_ISDIR(st.Mode) {
 		return nil, errors.New("Only directories can be imported directly")
 	}
-	name, _, _, err := importDirectory(hs, fd)
-	return name, err
+	dirBuilder, err := importDirectory(hs, fd, &options)
+	if err != nil {
+		return nil, err
+	}
+	return dirBuilder.BuildObject(hs)
 }
@@ -94,7 +94,7 @@ func TestImportPath(t *testing.T) {
 	}
 
 	// Verify file content
-	file1Data, err := readObjectData(env.store, *file1Entry.Inode.ObjName)
+	file1Data, err := readInodeData(env.store, &file1Entry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read file1 content: %v", err)
 	}
@@ -136,7 +136,7 @@ func TestImportPath(t *testing.T) {
 	}
 
 	// Check nested file
-	subdirData, err := readObjectData(env.store, *subdirEntry.Inode.ObjName)
+	subdirData, err := readInodeData(env.store, &subdirEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read subdir: %v", err)
 	}
@@ -150,7 +150,7 @@ func TestImportPath(t *testing.T) {
 		t.Fatal("nested.txt not found")
 	}
 
-	nestedData, err := readObjectData(env.store, *nestedEntry.Inode.ObjName)
+	nestedData, err := readInodeData(env.store, &nestedEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read nested content: %v", err)
 	}
@@ -176,7 +176,7 @@ func TestImportPath(t *testing.T) {
 		t.Error("link.txt is not a symlink")
 	}
 
-	linkData, err := readObjectData(env.store, *linkEntry.Inode.ObjName)
+	linkData, err := readInodeData(env.store, &linkEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read symlink: %v", err)
 	}
@@ -194,7 +194,7 @@ func TestImportPath(t *testing.T) {
 		t.Fatal("abs_link.txt not found")
 	}
 
-	absLinkData, err := readObjectData(env.store, *absLinkEntry.Inode.ObjName)
+	absLinkData, err := readInodeData(env.store, &absLinkEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read absolute symlink: %v", err)
 	}
@@ -257,7 +257,7 @@ func TestImportPathWithLargeFile(t *testing.T) {
 		t.Fatal("large.dat not found")
 	}
 
-	largeData, err := readObjectData(env.store, *largeEntry.Inode.ObjName)
+	largeData, err := readInodeData(env.store, &largeEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read large file: %v", err)
 	}
@@ -396,7 +396,7 @@ func TestImportPathDeepNesting(t *testing.T) {
 			t.Fatalf("%s not found", dirName)
 		}
 
-		currentData, err = readObjectData(env.store, *entry.Inode.ObjName)
+		currentData, err = readInodeData(env.store, &entry.Inode)
 		if err != nil {
 			t.Fatalf("Failed to read %s: %v", dirName, err)
 		}
@@ -412,7 +412,7 @@ func TestImportPathDeepNesting(t *testing.T) {
 		t.Fatal("deep.txt not found")
 	}
 
-	deepContent, err := readObjectData(env.store, *deepEntry.Inode.ObjName)
+	deepContent, err := readInodeData(env.store, &deepEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read deep file: %v", err)
 	}
@@ -577,3 +577,43 @@ func TestImportPathPreservesMetadata(t *testing.T) {
 	// Note: UID/GID testing would require specific test setup with known user/group IDs
 	// and timestamps are system-dependent, so we primarily verify the structure is correct
 }
+
+func TestImportPathInlineContent(t *testing.T) {
+	env := createTestEnvironment(t)
+	defer env.session.Close()
+
+	tempDir := setupTestDirectory(t)
+	for _, inline := range []bool{false, true} {
+		session := &countingSession{Session: env.session}
+		options := DefaultDirBuildOptions()
+		options.InlineContent = inline
+
+		rootName, err := ImportPathWithOptions(session, tempDir, options)
+		if err != nil {
+			t.Fatalf("ImportPathWithOptions failed: %v", err)
+		}
+
+		// Inline imports only create the root and subdir objects.
+		wantCreated := 8
+		if inline {
+			wantCreated = 2
+		}
+		if session.created != wantCreated {
+			t.Errorf("Expected %d objects created (inline=%v), got %d", wantCreated, inline, session.created)
+		}
+
+		rootData, err := readObjectData(env.store, *rootName)
+		if err != nil {
+			t.Fatalf("Failed to read root directory: %v", err)
+		}
+		for _, filename := range []string{"file1.txt", "link.txt", "empty"} {
+			entry, err := LookupChild(bytes.NewReader(rootData), filename)
+			if err != nil || entry == nil {
+				t.Fatalf("LookupChild failed for %s: %v", filename, err)
+			}
+			if (entry.Inode.InlineData != nil) != inline || (entry.Inode.ObjName != nil) == inline {
+				t.Errorf("Unexpected content of %s (inline=%v): %+v", filename, inline, entry.Inode)
+			}
+		}
+	}
+}
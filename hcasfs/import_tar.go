@@ -96,6 +96,16 @@ func importTarRegular(hs hcas.Session, tarReader *tar.Reader, size int64) (*hcas
 	return writer.Name(), nil
 }
 
+// Read the contents of a regular file small enough to be stored inline.
+func importTarInline(tarReader *tar.Reader, size int64) ([]byte, error) {
+	buf := make([]byte, size)
+	_, err := io.ReadFull(tarReader, buf)
+	if err != nil {
+		return nil, err
+	}
+	return buf, nil
+}
+
 func importTarSymlink(hs hcas.Session, linkTarget string) (*hcas.Name, error) {
 	return hs.CreateObject([]byte(linkTarget))
 }
@@ -112,6 +122,11 @@ type hardlinkData struct {
 }
 
 func ImportTar(hs hcas.Session, tarReader io.Reader) (*hcas.Name, error) {
+	return ImportTarWithOptions(hs, tarReader, DefaultDirBuildOptions())
+}
+
+// Same as ImportTar, building directories with the given options.
+func ImportTarWithOptions(hs hcas.Session, tarReader io.Reader, options DirBuildOptions) (*hcas.Name, error) {
 	tr := tar.NewReader(tarReader)
 
 	rootEntry := tarDirEntry{
@@ -148,7 +163,11 @@ func ImportTar(hs hcas.Session, tarReader io.Reader) (*hcas.Name, error) {
 		var objName *hcas.Name
 		switch header.Typeflag {
 		case tar.TypeReg, tar.TypeRegA:
-			objName, err = importTarRegular(hs, tr, header.Size)
+			if options.InlineContent && header.Size <= MaxInlineSize {
+				fileEntry.inode.InlineData, err = importTarInline(tr, header.Size)
+			} else {
+				objName, err = importTarRegular(hs, tr, header.Size)
+			}
 			if err != nil {
 				return nil, err
 			}
@@ -158,6 +177,10 @@ func ImportTar(hs hcas.Session, tarReader io.Reader) (*hcas.Name, error) {
 			dirEntries[name] = &fileEntry
 
 		case tar.TypeSymlink:
+			if options.InlineContent && len(header.Linkname) <= MaxInlineSize {
+				fileEntry.inode.InlineData = []byte(header.Linkname)
+				break
+			}
 			objName, err = importTarSymlink(hs, header.Linkname)
 			if err != nil {
 				return nil, err
@@ -230,6 +253,7 @@ func ImportTar(hs hcas.Session, tarReader io.Reader) (*hcas.Name, error) {
 
 	for _, dirPath := range paths {
 		dirBuilder := CreateDirBuilder()
+		dirBuilder.Options = options
 		dirEntry := dirEntries[dirPath]
 
 		var linkCount uint64 = 2
@@ -240,12 +264,20 @@ func ImportTar(hs hcas.Session, tarReader io.Reader) (*hcas.Name, error) {
 			dirBuilder.Insert(filePath, &child.inode, child.treeSize)
 		}
 
-		name, err := hs.CreateObject(dirBuilder.Build(), dirBuilder.DepNames...)
+		var name *hcas.Name
+		var inline []byte
+		var err error
+		if dirPath == "/" {
+			name, err = dirBuilder.BuildObject(hs)
+		} else {
+			name, inline, err = dirBuilder.buildSubdir(hs)
+		}
 		if err != nil {
 			return nil, err
 		}
 
 		dirEntry.inode.ObjName = name
+		dirEntry.inode.InlineData = inline
 		dirEntry.inode.Nlink = linkCount
 		dirEntry.treeSize = dirBuilder.TotalTreeSize
 	}
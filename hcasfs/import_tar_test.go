@@ -136,7 +136,7 @@ func TestImportTarBasicFiles(t *testing.T) {
 	}
 
 	// Verify file contents
-	file1Data, err := readObjectData(env.store, *entry1.Inode.ObjName)
+	file1Data, err := readInodeData(env.store, &entry1.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read file1 content: %v", err)
 	}
@@ -144,7 +144,7 @@ func TestImportTarBasicFiles(t *testing.T) {
 		t.Errorf("file1 content mismatch: got %q, want %q", string(file1Data), "hello world")
 	}
 
-	file2Data, err := readObjectData(env.store, *entry2.Inode.ObjName)
+	file2Data, err := readInodeData(env.store, &entry2.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read file2 content: %v", err)
 	}
@@ -257,7 +257,7 @@ func TestImportTarDirectories(t *testing.T) {
 	}
 
 	// Look inside dir1
-	dir1Data, err := readObjectData(env.store, *dir1Entry.Inode.ObjName)
+	dir1Data, err := readInodeData(env.store, &dir1Entry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read dir1: %v", err)
 	}
@@ -281,7 +281,7 @@ func TestImportTarDirectories(t *testing.T) {
 		t.Fatal("dir2 not found")
 	}
 
-	dir2Data, err := readObjectData(env.store, *dir2Entry.Inode.ObjName)
+	dir2Data, err := readInodeData(env.store, &dir2Entry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read dir2: %v", err)
 	}
@@ -295,7 +295,7 @@ func TestImportTarDirectories(t *testing.T) {
 		t.Fatal("subdir not found in dir2")
 	}
 
-	subdirData, err := readObjectData(env.store, *subdirEntry.Inode.ObjName)
+	subdirData, err := readInodeData(env.store, &subdirEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read subdir: %v", err)
 	}
@@ -310,7 +310,7 @@ func TestImportTarDirectories(t *testing.T) {
 	}
 
 	// Verify nested file content
-	nestedData, err := readObjectData(env.store, *nestedEntry.Inode.ObjName)
+	nestedData, err := readInodeData(env.store, &nestedEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read nested.txt: %v", err)
 	}
@@ -392,7 +392,7 @@ func TestImportTarSymlinks(t *testing.T) {
 	}
 
 	// Verify symlink target
-	linkData, err := readObjectData(env.store, *linkEntry.Inode.ObjName)
+	linkData, err := readInodeData(env.store, &linkEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read symlink data: %v", err)
 	}
@@ -410,7 +410,7 @@ func TestImportTarSymlinks(t *testing.T) {
 		t.Fatal("abs_link.txt not found")
 	}
 
-	absLinkData, err := readObjectData(env.store, *absLinkEntry.Inode.ObjName)
+	absLinkData, err := readInodeData(env.store, &absLinkEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read absolute symlink data: %v", err)
 	}
@@ -436,12 +436,12 @@ func TestImportTarHardLinks(t *testing.T) {
 			Mode:       0644,
 			Uid:        1000,
 			Gid:        1000,
-			Size:       8,
+			Size:       38,
 			ModTime:    now,
 			AccessTime: now,
 			ChangeTime: now,
 			Typeflag:   tar.TypeReg,
-			Content:    []byte("original"),
+			Content:    []byte("original content shared by a hard link"),
 		},
 		{
 			Name:       "hardlink.txt",
@@ -496,12 +496,12 @@ func TestImportTarHardLinks(t *testing.T) {
 	}
 
 	// Verify content is the same
-	originalData, err := readObjectData(env.store, *originalEntry.Inode.ObjName)
+	originalData, err := readInodeData(env.store, &originalEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read original file: %v", err)
 	}
 
-	hardlinkData, err := readObjectData(env.store, *hardlinkEntry.Inode.ObjName)
+	hardlinkData, err := readInodeData(env.store, &hardlinkEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read hardlink file: %v", err)
 	}
@@ -611,7 +611,7 @@ func TestImportTarSpecialFiles(t *testing.T) {
 		t.Fatal("dev directory not found")
 	}
 
-	devData, err := readObjectData(env.store, *devEntry.Inode.ObjName)
+	devData, err := readInodeData(env.store, &devEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read dev directory: %v", err)
 	}
@@ -669,7 +669,7 @@ func TestImportTarSpecialFiles(t *testing.T) {
 		t.Fatal("tmp directory not found")
 	}
 
-	tmpData, err := readObjectData(env.store, *tmpEntry.Inode.ObjName)
+	tmpData, err := readInodeData(env.store, &tmpEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read tmp directory: %v", err)
 	}
@@ -876,7 +876,7 @@ func TestImportTarLargeFile(t *testing.T) {
 	}
 
 	// Verify large file content
-	fileData, err := readObjectData(env.store, *fileEntry.Inode.ObjName)
+	fileData, err := readInodeData(env.store, &fileEntry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read large file: %v", err)
 	}
@@ -890,3 +890,62 @@ func TestImportTarLargeFile(t *testing.T) {
 			fileEntry.Inode.Size, len(largeContent))
 	}
 }
+
+func TestImportTarInlineContent(t *testing.T) {
+	env := createTestEnvironment(t)
+	defer env.session.Close()
+
+	now := time.Now()
+	tarData := createTestTarArchive([]tarTestEntry{
+		{Name: "dir/", Mode: 0755, ModTime: now, Typeflag: tar.TypeDir},
+		{Name: "dir/empty/", Mode: 0755, ModTime: now, Typeflag: tar.TypeDir},
+		{Name: "dir/small.txt", Mode: 0644, Size: 5, ModTime: now, Typeflag: tar.TypeReg, Content: []byte("hello")},
+		{Name: "link", Mode: 0777, ModTime: now, Typeflag: tar.TypeSymlink, Linkname: "dir/small.txt"},
+	})
+
+	for _, inline := range []bool{false, true} {
+		session := &countingSession{Session: env.session}
+		options := DefaultDirBuildOptions()
+		options.InlineContent = inline
+
+		rootName, err := ImportTarWithOptions(session, bytes.NewReader(tarData), options)
+		if err != nil {
+			t.Fatalf("ImportTarWithOptions failed: %v", err)
+		}
+
+		// Inline imports only create the root and dir objects.
+		wantCreated := 5
+		if inline {
+			wantCreated = 2
+		}
+		if session.created != wantCreated {
+			t.Errorf("Expected %d objects created (inline=%v), got %d", wantCreated, inline, session.created)
+		}
+
+		rootData, err := readObjectData(env.store, *rootName)
+		if err != nil {
+			t.Fatalf("Failed to read root directory: %v", err)
+		}
+		dirEntry, err := LookupChild(bytes.NewReader(rootData), "dir")
+		if err != nil || dirEntry == nil {
+			t.Fatalf("LookupChild failed for dir: %v", err)
+		}
+		dirData, err := readObjectData(env.store, *dirEntry.Inode.ObjName)
+		if err != nil {
+			t.Fatalf("Failed to read dir: %v", err)
+		}
+
+		for _, lookup := range []struct {
+			data     []byte
+			filename string
+		}{{rootData, "link"}, {dirData, "empty"}, {dirData, "small.txt"}} {
+			entry, err := LookupChild(bytes.NewReader(lookup.data), lookup.filename)
+			if err != nil || entry == nil {
+				t.Fatalf("LookupChild failed for %s: %v", lookup.filename, err)
+			}
+			if (entry.Inode.InlineData != nil) != inline || (entry.Inode.ObjName != nil) == inline {
+				t.Errorf("Unexpected content of %s (inline=%v): %+v", lookup.filename, inline, entry.Inode)
+			}
+		}
+	}
+}
@@ -104,12 +104,12 @@ func TestDuplicateContentDeduplication(t *testing.T) {
 	}
 
 	// Verify the content is actually the same
-	content1, err := readObjectData(env.store, *file1Entry.Inode.ObjName)
+	content1, err := readInodeData(env.store, &file1Entry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read content1: %v", err)
 	}
 
-	content2, err := readObjectData(env.store, *file2Entry.Inode.ObjName)
+	content2, err := readInodeData(env.store, &file2Entry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read content2: %v", err)
 	}
@@ -135,9 +135,9 @@ func TestComplexDirectoryStructureIntegrity(t *testing.T) {
 		"dir2/file2.txt":           "content in dir2",
 		"dir2/subdir/another.txt":  "another nested file",
 		"dir3/empty_subdir/.keep":  "",
-		"shared_content1.txt":      "shared content",
-		"dir1/shared_content2.txt": "shared content",
-		"dir2/shared_content3.txt": "shared content",
+		"shared_content1.txt":      "shared content, long enough to need an object",
+		"dir1/shared_content2.txt": "shared content, long enough to need an object",
+		"dir2/shared_content3.txt": "shared content, long enough to need an object",
 	}
 
 	// Create all files and directories
@@ -175,19 +175,19 @@ func TestComplexDirectoryStructureIntegrity(t *testing.T) {
 
 	// Verify all files are accessible and have correct content
 	verifyFileInDirectory(t, env.store, rootName, "root.txt", "root content")
-	verifyFileInDirectory(t, env.store, rootName, "shared_content1.txt", "shared content")
+	verifyFileInDirectory(t, env.store, rootName, "shared_content1.txt", "shared content, long enough to need an object")
 
 	// Navigate to subdirectories and verify files
 	dir1Name := getDirectoryObject(t, env.store, rootName, "dir1")
 	verifyFileInDirectory(t, env.store, dir1Name, "file1.txt", "content in dir1")
-	verifyFileInDirectory(t, env.store, dir1Name, "shared_content2.txt", "shared content")
+	verifyFileInDirectory(t, env.store, dir1Name, "shared_content2.txt", "shared content, long enough to need an object")
 
 	dir1SubdirName := getDirectoryObject(t, env.store, dir1Name, "subdir")
 	verifyFileInDirectory(t, env.store, dir1SubdirName, "nested.txt", "deeply nested content")
 
 	dir2Name := getDirectoryObject(t, env.store, rootName, "dir2")
 	verifyFileInDirectory(t, env.store, dir2Name, "file2.txt", "content in dir2")
-	verifyFileInDirectory(t, env.store, dir2Name, "shared_content3.txt", "shared content")
+	verifyFileInDirectory(t, env.store, dir2Name, "shared_content3.txt", "shared content, long enough to need an object")
 
 	// Verify symlinks
 	verifySymlinkInDirectory(t, env.store, rootName, "link_to_root.txt", "root.txt")
@@ -245,17 +245,17 @@ func TestMixedImportMethods(t *testing.T) {
 			Mode:       0644,
 			Uid:        1000,
 			Gid:        1000,
-			Size:       11,
+			Size:       35,
 			ModTime:    now,
 			AccessTime: now,
 			ChangeTime: now,
 			Typeflag:   tar.TypeReg,
-			Content:    []byte("tar version"),
+			Content:    []byte("tar version of the shared name file"),
 		},
 	}
 
 	// Also create a file with the same name in filesystem
-	err = os.WriteFile(filepath.Join(fsDir, "shared_name.txt"), []byte("fs version"), 0644)
+	err = os.WriteFile(filepath.Join(fsDir, "shared_name.txt"), []byte("fs version of the shared name file"), 0644)
 	if err != nil {
 		t.Fatalf("Failed to create shared name file: %v", err)
 	}
@@ -276,11 +276,11 @@ func TestMixedImportMethods(t *testing.T) {
 
 	// Verify filesystem imported content
 	verifyFileInDirectory(t, env.store, fsRoot, "fs_file.txt", "from filesystem")
-	verifyFileInDirectory(t, env.store, fsRoot, "shared_name.txt", "fs version")
+	verifyFileInDirectory(t, env.store, fsRoot, "shared_name.txt", "fs version of the shared name file")
 
 	// Verify tar imported content
 	verifyFileInDirectory(t, env.store, tarRoot, "tar_file.txt", "from tar")
-	verifyFileInDirectory(t, env.store, tarRoot, "shared_name.txt", "tar version")
+	verifyFileInDirectory(t, env.store, tarRoot, "shared_name.txt", "tar version of the shared name file")
 
 	// Verify that the shared name files have different content and thus different objects
 	fsData, _ := readObjectData(env.store, *fsRoot)
@@ -488,7 +488,7 @@ func verifyFileInDirectory(t *testing.T, store hcas.Hcas, dirName *hcas.Name, fi
 		return
 	}
 
-	fileData, err := readObjectData(store, *entry.Inode.ObjName)
+	fileData, err := readInodeData(store, &entry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read %s content: %v", fileName, err)
 	}
@@ -518,7 +518,7 @@ func verifySymlinkInDirectory(t *testing.T, store hcas.Hcas, dirName *hcas.Name,
 		return
 	}
 
-	linkData, err := readObjectData(store, *entry.Inode.ObjName)
+	linkData, err := readInodeData(store, &entry.Inode)
 	if err != nil {
 		t.Fatalf("Failed to read %s target: %v", linkName, err)
 	}
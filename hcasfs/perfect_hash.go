@@ -0,0 +1,145 @@
+package hcasfs
+
+import (
+	"encoding/binary"
+	"io"
+	"sort"
+)
+
+// Large salted directories can carry a minimal perfect hash over the 64-bit
+// SipHash of their names in the style of PTHash. Names are split into buckets
+// by the upper half of their hash and each bucket stores a pilot chosen so
+// that every name in the bucket lands in a distinct free index slot. A lookup
+// reads one pilot and one index entry; the index is stored in slot order. The
+// kernel module implements the same functions, keep the two in sync.
+const (
+	perfectHashBucketSize = 3
+	perfectHashMaxPilot   = 1 << 28
+
+	defaultPerfectHashMinEntries = 256
+)
+
+func perfectHashBucket(h uint64, buckets uint32) uint32 {
+	return uint32(((h >> 32) * uint64(buckets)) >> 32)
+}
+
+func perfectHashSlot(h uint64, pilot uint32, entries uint32) uint32 {
+	x := fmix64(h ^ (uint64(pilot) * 0x9e3779b97f4a7c15))
+	return uint32(((x >> 32) * uint64(entries)) >> 32)
+}
+
+// Find a pilot for each bucket such that the hashes map to distinct slots.
+// Returns the pilots and the slot of each hash, or nil if no perfect hash was
+// found.
+func buildPerfectHash(hashes []uint64) ([]uint32, []uint32) {
+	entries := uint32(len(hashes))
+	buckets := (entries + perfectHashBucketSize - 1) / perfectHashBucketSize
+
+	// Equal hashes would never separate.
+	sorted := append([]uint64(nil), hashes...)
+	sort.Slice(sorted, func(i, j int) bool { return sorted[i] < sorted[j] })
+	for i := 1; i < len(sorted); i++ {
+		if sorted[i] == sorted[i-1] {
+			return nil, nil
+		}
+	}
+
+	members := make([][]int, buckets)
+	for i, h := range hashes {
+		bucket := perfectHashBucket(h, buckets)
+		members[bucket] = append(members[bucket], i)
+	}
+
+	// Place the largest buckets first while most slots are still free.
+	order := make([]uint32, buckets)
+	for i := range order {
+		order[i] = uint32(i)
+	}
+	sort.SliceStable(order, func(i, j int) bool {
+		return len(members[order[i]]) > len(members[order[j]])
+	})
+
+	pilots := make([]uint32, buckets)
+	slots := make([]uint32, entries)
+	taken := make([]bool, entries)
+	for _, bucket := range order {
+		keys := members[bucket]
+		if len(keys) == 0 {
+			break
+		}
+
+		pilot := uint32(0)
+		for ; pilot < perfectHashMaxPilot; pilot++ {
+			placed := 0
+			for _, key := range keys {
+				slot := perfectHashSlot(hashes[key], pilot, entries)
+				if taken[slot] {
+					break
+				}
+				taken[slot] = true
+				slots[key] = slot
+				placed++
+			}
+			if placed == len(keys) {
+				break
+			}
+			for _, key := range keys[:placed] {
+				taken[slots[key]] = false
+			}
+		}
+		if pilot == perfectHashMaxPilot {
+			return nil, nil
+		}
+		pilots[bucket] = pilot
+	}
+	return pilots, slots
+}
+
+// Look up name, with 64-bit hash h, in a directory with a perfect hash.
+func (hdr *DirHeader) lookupPerfectHash(dirData io.ReadSeeker, name string, h uint64) (*DirEntry, error) {
+	if hdr.EntryCount == 0 {
+		return nil, nil
+	}
+
+	bucket := perfectHashBucket(h, hdr.PerfectHashBuckets)
+	_, err := dirData.Seek(int64(hdr.PerfectHashOffset)+4*int64(bucket), 0)
+	if err != nil {
+		return nil, err
+	}
+
+	var buf [8]byte
+	err = readAll(dirData, buf[:4])
+	if err != nil {
+		return nil, err
+	}
+	slot := perfectHashSlot(h, binary.BigEndian.Uint32(buf[:]), hdr.EntryCount)
+
+	_, err = dirData.Seek(int64(hdr.IndexOffset)+8*int64(slot), 0)
+	if err != nil {
+		return nil, err
+	}
+	err = readAll(dirData, buf[:])
+	if err != nil {
+		return nil, err
+	}
+
+	// Names not in the directory still map to some slot.
+	if binary.BigEndian.Uint32(buf[4:]) != uint32(h) {
+		return nil, nil
+	}
+
+	_, err = dirData.Seek(int64(binary.BigEndian.Uint32(buf[0:])), 0)
+	if err != nil {
+		return nil, err
+	}
+
+	var de DirEntry
+	err = hdr.readRecord(dirData, &de)
+	if err != nil {
+		return nil, err
+	}
+	if de.FileName != name {
+		return nil, nil
+	}
+	return &de, nil
+}
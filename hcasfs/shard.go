@@ -0,0 +1,390 @@
+package hcasfs
+
+import (
+	"encoding/binary"
+	"io"
+	"sort"
+
+	"github.com/msg555/hcas/hcas"
+)
+
+// Huge directories are split into a tree of objects. The directory object and
+// any interior nodes are sharded nodes (DirFlagSharded) holding no records,
+// only a list of child objects ordered by the routing hash of the names they
+// hold: the SipHash of the name under the node's salt. Leaves are ordinary
+// directory objects holding a subset of the entries.
+//
+// Leaf and node boundaries are chosen from the routing hashes themselves
+// rather than by position, so inserting or removing a name only changes the
+// objects on the path to its leaf; every other shard encodes to the same
+// bytes and is shared with the previous version of the directory.
+//
+// Each child reference in a sharded node is encoded as
+//
+//	0   u64 smallest routing hash held by the child
+//	8   u64 base, added to the ParentDepIndex of every entry in the child
+//	16  u64 tree size of the entries in the child
+//	24  u32 number of entries in the child
+//	28  u32 reserved
+//	32  child object name
+//
+// Leaf entries number their ParentDepIndex from zero; an entry's inode offset
+// from the directory is its ParentDepIndex plus the bases along its path.
+const (
+	dirShardSize = 64
+
+	defaultShardMinEntries = 1 << 16
+	defaultShardEntries    = 4096
+	defaultShardFanout     = 64
+
+	// Bound on the depth of sharded directories followed by readers, as
+	// HCASFS_SHARD_MAX_DEPTH in the kernel module.
+	maxShardDepth = 16
+)
+
+// Routing salt used for sharded directories unless one is configured. It has to
+// stay the same between builds for unchanged shards to be shared, so unlike the
+// salt of an unsharded directory it is not derived from the names. Names can be
+// chosen to land in the same shard under a known salt; that only makes the
+// shard larger, lookups within it are still protected by its own salt.
+var defaultShardSalt = [2]uint64{0x6863617366732d73, 0x68617264696e6721}
+
+type DirShard struct {
+	MinHash    uint64
+	Base       uint64
+	TreeSize   uint64
+	EntryCount uint32
+	Name       hcas.Name
+}
+
+func (s *DirShard) encode(buf []byte) {
+	binary.BigEndian.PutUint64(buf[0:], s.MinHash)
+	binary.BigEndian.PutUint64(buf[8:], s.Base)
+	binary.BigEndian.PutUint64(buf[16:], s.TreeSize)
+	binary.BigEndian.PutUint32(buf[24:], s.EntryCount)
+	copy(buf[32:], s.Name.Name())
+}
+
+func (s *DirShard) decode(buf []byte) {
+	s.MinHash = binary.BigEndian.Uint64(buf[0:])
+	s.Base = binary.BigEndian.Uint64(buf[8:])
+	s.TreeSize = binary.BigEndian.Uint64(buf[16:])
+	s.EntryCount = binary.BigEndian.Uint32(buf[24:])
+	s.Name = hcas.NewName(string(buf[32:64]))
+}
+
+// Opens an object referenced by a directory. Used to follow the shards of
+// sharded directories.
+type ObjectOpener func(name *hcas.Name) (io.ReadSeekCloser, error)
+
+func (hdr *DirHeader) readShard(dirData io.ReadSeeker, index uint32) (*DirShard, error) {
+	_, err := dirData.Seek(int64(hdr.ShardsOffset)+dirShardSize*int64(index), 0)
+	if err != nil {
+		return nil, err
+	}
+
+	var buf [dirShardSize]byte
+	err = readAll(dirData, buf[:])
+	if err != nil {
+		return nil, err
+	}
+
+	var shard DirShard
+	shard.decode(buf[:])
+	return &shard, nil
+}
+
+// Find the child of a sharded node that holds names with the given routing
+// hash.
+func (hdr *DirHeader) findShard(dirData io.ReadSeeker, h uint64) (*DirShard, error) {
+	// Find the last child whose smallest hash is at most h.
+	var lo uint32 = 1
+	hi := hdr.ShardCount
+	for lo < hi {
+		mid := lo + (hi-lo)/2
+		_, err := dirData.Seek(int64(hdr.ShardsOffset)+dirShardSize*int64(mid), 0)
+		if err != nil {
+			return nil, err
+		}
+
+		var buf [8]byte
+		err = readAll(dirData, buf[:])
+		if err != nil {
+			return nil, err
+		}
+		if binary.BigEndian.Uint64(buf[:]) <= h {
+			lo = mid + 1
+		} else {
+			hi = mid
+		}
+	}
+	return hdr.readShard(dirData, lo-1)
+}
+
+// Build a sharded directory in hs and return the name of its root object.
+func (d *dirBuilder) buildSharded(hs hcas.Session) (*hcas.Name, error) {
+	opts := &d.Options
+	salt := opts.ShardSalt
+
+	entries := append([]DirEntry(nil), d.DirEntries...)
+	hashes := make([]uint64, len(entries))
+	for i := range entries {
+		hashes[i] = sipHash24(salt[0], salt[1], []byte(entries[i].FileName))
+	}
+	order := make([]int, len(entries))
+	for i := range order {
+		order[i] = i
+	}
+	sort.Slice(order, func(i, j int) bool {
+		if hashes[order[i]] != hashes[order[j]] {
+			return hashes[order[i]] < hashes[order[j]]
+		}
+		return entries[order[i]].FileName < entries[order[j]].FileName
+	})
+
+	// End a leaf after each name whose mixed hash is a multiple of the target
+	// leaf size. Names with equal hashes must share a leaf to be routable.
+	var nodes []DirShard
+	start := 0
+	for i := range order {
+		h := hashes[order[i]]
+		if i+1 < len(order) && (hashes[order[i+1]] == h ||
+			fmix64(h)%uint64(opts.ShardEntries) != 0) {
+			continue
+		}
+
+		leaf := make([]DirEntry, 0, i+1-start)
+		for _, ind := range order[start : i+1] {
+			leaf = append(leaf, entries[ind])
+		}
+		shard, err := d.buildShardLeaf(hs, leaf)
+		if err != nil {
+			return nil, err
+		}
+		shard.MinHash = hashes[order[start]]
+		nodes = append(nodes, *shard)
+		start = i + 1
+	}
+
+	// Group nodes the same way, keyed by their smallest hash, until one level
+	// fits in a single node.
+	for level := uint64(1); len(nodes) > 1; level++ {
+		var groups [][]DirShard
+		start := 0
+		for i := range nodes {
+			if i+1 < len(nodes) &&
+				fmix64(nodes[i].MinHash^level*0x9e3779b97f4a7c15)%uint64(opts.ShardFanout) != 0 {
+				continue
+			}
+			groups = append(groups, nodes[start:i+1])
+			start = i + 1
+		}
+		if len(groups) == 1 || len(groups) == len(nodes) {
+			break
+		}
+
+		var parents []DirShard
+		for _, group := range groups {
+			shard, err := d.buildShardNode(hs, group, 0, 0)
+			if err != nil {
+				return nil, err
+			}
+			parents = append(parents, *shard)
+		}
+		nodes = parents
+	}
+
+	shard, err := d.buildShardNode(hs, nodes, 1, d.TotalTreeSize)
+	if err != nil {
+		return nil, err
+	}
+	return &shard.Name, nil
+}
+
+// Store a leaf holding the given entries, numbering them from zero.
+func (d *dirBuilder) buildShardLeaf(hs hcas.Session, entries []DirEntry) (*DirShard, error) {
+	var treeSize uint64
+	var deps []hcas.Name
+	for i := range entries {
+		treeSize += entries[i].TreeSize
+		if entries[i].Inode.ObjName != nil {
+			deps = append(deps, *entries[i].Inode.ObjName)
+		}
+	}
+
+	data, _ := d.buildDir(entries, treeSize, 0)
+	name, err := hs.CreateObject(data, deps...)
+	if err != nil {
+		return nil, err
+	}
+	return &DirShard{
+		TreeSize:   treeSize,
+		EntryCount: uint32(len(entries)),
+		Name:       *name,
+	}, nil
+}
+
+// Store a sharded node over children. The first child's entries are numbered
+// from firstBase. If treeSize is zero the node's tree size is that of its
+// children.
+func (d *dirBuilder) buildShardNode(hs hcas.Session, children []DirShard, firstBase uint64, treeSize uint64) (*DirShard, error) {
+	node := DirShard{
+		MinHash: children[0].MinHash,
+	}
+
+	deps := make([]hcas.Name, len(children))
+	base := firstBase
+	for i := range children {
+		children[i].Base = base
+		base += children[i].TreeSize
+		node.TreeSize += children[i].TreeSize
+		node.EntryCount += children[i].EntryCount
+		deps[i] = children[i].Name
+	}
+	if treeSize == 0 {
+		treeSize = node.TreeSize
+	}
+
+	hdr := DirHeader{
+		Flags:      DirFlagSalted | DirFlagSharded,
+		EntryCount: node.EntryCount,
+		TreeSize:   treeSize,
+		Salt:       d.Options.ShardSalt,
+		ShardCount: uint32(len(children)),
+	}
+	hdr.ShardsOffset = hdr.Size()
+	hdr.IndexOffset = hdr.ShardsOffset + dirShardSize*hdr.ShardCount
+	hdr.RecordsOffset = hdr.IndexOffset
+
+	data := make([]byte, hdr.IndexOffset)
+	copy(data, hdr.Encode())
+	for i := range children {
+		children[i].encode(data[hdr.ShardsOffset+dirShardSize*uint32(i):])
+	}
+
+	name, err := hs.CreateObject(data, deps...)
+	if err != nil {
+		return nil, err
+	}
+	node.Name = *name
+	return &node, nil
+}
+
+// Same as LookupChild but follows the shards of sharded directories, opening
+// them with open. The returned entry's ParentDepIndex is relative to the
+// directory.
+func LookupChildSharded(open ObjectOpener, dirData io.ReadSeeker, name string) (*DirEntry, error) {
+	var base uint64
+	var shardData io.ReadSeekCloser
+	defer func() {
+		if shardData != nil {
+			shardData.Close()
+		}
+	}()
+
+	for {
+		hdr, err := ReadDirHeader(dirData)
+		if err != nil {
+			return nil, err
+		}
+		if hdr.Flags&DirFlagSharded == 0 {
+			break
+		}
+
+		shard, err := hdr.findShard(dirData, hdr.nameHash64(name))
+		if err != nil {
+			return nil, err
+		}
+		base += shard.Base
+
+		child, err := open(&shard.Name)
+		if err != nil {
+			return nil, err
+		}
+		if shardData != nil {
+			shardData.Close()
+		}
+		shardData = child
+		dirData = child
+	}
+
+	_, err := dirData.Seek(0, 0)
+	if err != nil {
+		return nil, err
+	}
+	dirEntry, err := LookupChild(dirData, name)
+	if dirEntry != nil {
+		dirEntry.ParentDepIndex += base
+	}
+	return dirEntry, err
+}
+
+// Read up to max entries of a directory in readdir order starting at entry
+// pos, following the shards of sharded directories. The ParentDepIndex of the
+// returned entries is relative to the directory.
+func ReadDirEntries(open ObjectOpener, dirData io.ReadSeeker, pos uint32, max int) ([]DirEntry, error) {
+	var entries []DirEntry
+	err := readDirEntries(open, dirData, pos, max, 0, &entries)
+	return entries, err
+}
+
+func readDirEntries(open ObjectOpener, dirData io.ReadSeeker, pos uint32, max int, base uint64, entries *[]DirEntry) error {
+	hdr, err := ReadDirHeader(dirData)
+	if err != nil {
+		return err
+	}
+
+	if hdr.Flags&DirFlagSharded == 0 {
+		if pos >= hdr.EntryCount {
+			return nil
+		}
+
+		_, err = dirData.Seek(int64(hdr.IndexOffset)+8*int64(pos), 0)
+		if err != nil {
+			return err
+		}
+		var buf [4]byte
+		err = readAll(dirData, buf[:])
+		if err != nil {
+			return err
+		}
+		_, err = dirData.Seek(int64(binary.BigEndian.Uint32(buf[:])), 0)
+		if err != nil {
+			return err
+		}
+
+		for ; pos < hdr.EntryCount && len(*entries) < max; pos++ {
+			var de DirEntry
+			err = hdr.readRecord(dirData, &de)
+			if err != nil {
+				return err
+			}
+			de.ParentDepIndex += base
+			*entries = append(*entries, de)
+		}
+		return nil
+	}
+
+	for i := uint32(0); i < hdr.ShardCount && len(*entries) < max; i++ {
+		shard, err := hdr.readShard(dirData, i)
+		if err != nil {
+			return err
+		}
+		if pos >= shard.EntryCount {
+			pos -= shard.EntryCount
+			continue
+		}
+
+		child, err := open(&shard.Name)
+		if err != nil {
+			return err
+		}
+		err = readDirEntries(open, child, pos, max, base+shard.Base, entries)
+		child.Close()
+		if err != nil {
+			return err
+		}
+		pos = 0
+	}
+	return nil
+}
@@ -50,3 +50,28 @@ func readObjectData(store hcas.Hcas, name hcas.Name) ([]byte, error) {
 
 	return io.ReadAll(file)
 }
+
+// readInodeData reads the content of an inode, whether stored inline or in
+// an object.
+func readInodeData(store hcas.Hcas, inode *InodeData) ([]byte, error) {
+	if inode.InlineData != nil {
+		return inode.InlineData, nil
+	}
+	return readObjectData(store, *inode.ObjName)
+}
+
+// countingSession counts the objects created through it.
+type countingSession struct {
+	hcas.Session
+	created int
+}
+
+func (s *countingSession) CreateObject(data []byte, deps ...hcas.Name) (*hcas.Name, error) {
+	s.created++
+	return s.Session.CreateObject(data, deps...)
+}
+
+func (s *countingSession) StreamObject(deps ...hcas.Name) (hcas.ObjectWriter, error) {
+	s.created++
+	return s.Session.StreamObject(deps...)
+}
@@ -0,0 +1,181 @@
+package hcasfs
+
+import (
+	"sync"
+	"time"
+
+	"github.com/go-errors/errors"
+
+	"github.com/msg555/hcas/hcas"
+	"github.com/msg555/hcas/unix"
+)
+
+// Label namespace that access traces are stored under. A trace is labelled
+// with the same label as the image it was recorded from.
+const TraceLabelNamespace = "trace"
+
+// Records the order objects are first accessed in during a fixed window after
+// a mount is created. Replaying a trace with PrefetchObjects at the next mount
+// warms the objects an image needs at startup in the order it needs them.
+type TraceRecorder struct {
+	lock       sync.Mutex
+	deadline   time.Time
+	maxEntries int
+	seen       map[hcas.Name]struct{}
+	names      []hcas.Name
+}
+
+// Create a recorder that accepts accesses for the given window, keeping at
+// most maxEntries distinct objects.
+func NewTraceRecorder(window time.Duration, maxEntries int) *TraceRecorder {
+	return &TraceRecorder{
+		deadline:   time.Now().Add(window),
+		maxEntries: maxEntries,
+		seen:       make(map[hcas.Name]struct{}),
+	}
+}
+
+// Record an access to the named object. Accesses after the window has closed
+// and repeat accesses are ignored.
+func (tr *TraceRecorder) Record(name *hcas.Name) {
+	tr.lock.Lock()
+	defer tr.lock.Unlock()
+
+	if len(tr.names) >= tr.maxEntries || time.Now().After(tr.deadline) {
+		return
+	}
+	if _, ok := tr.seen[*name]; ok {
+		return
+	}
+	tr.seen[*name] = struct{}{}
+	tr.names = append(tr.names, *name)
+}
+
+// Returns the objects recorded so far in first access order.
+func (tr *TraceRecorder) Names() []hcas.Name {
+	tr.lock.Lock()
+	defer tr.lock.Unlock()
+
+	return append([]hcas.Name(nil), tr.names...)
+}
+
+// Encode a trace as the concatenation of its object names. This is the same
+// format the kernel module exposes its recorded traces in.
+func EncodeTrace(names []hcas.Name) []byte {
+	data := make([]byte, 0, 32*len(names))
+	for _, name := range names {
+		data = append(data, name.Name()...)
+	}
+	return data
+}
+
+// Decode a trace written by EncodeTrace, dropping repeated names.
+func DecodeTrace(data []byte) ([]hcas.Name, error) {
+	if len(data)%32 != 0 {
+		return nil, errors.New("invalid trace length")
+	}
+
+	seen := make(map[hcas.Name]struct{})
+	names := make([]hcas.Name, 0, len(data)/32)
+	for i := 0; i < len(data); i += 32 {
+		name := hcas.NewName(string(data[i : i+32]))
+		if _, ok := seen[name]; ok {
+			continue
+		}
+		seen[name] = struct{}{}
+		names = append(names, name)
+	}
+	return names, nil
+}
+
+// Store a trace as an object and label it with the image's label.
+func SaveTrace(hs hcas.Session, label string, names []hcas.Name) (*hcas.Name, error) {
+	// The trace deliberately does not depend on the objects it lists; it
+	// should not keep an image alive after the image's label is removed.
+	name, err := hs.CreateObject(EncodeTrace(names))
+	if err != nil {
+		return nil, err
+	}
+
+	err = hs.SetLabel(TraceLabelNamespace, label, name)
+	if err != nil {
+		return nil, err
+	}
+	return name, nil
+}
+
+// Load the trace recorded for an image label. Returns nil if no trace has been
+// recorded.
+func LoadTrace(h hcas.Hcas, hs hcas.Session, label string) ([]hcas.Name, error) {
+	name, err := hs.GetLabel(TraceLabelNamespace, label)
+	if err != nil {
+		return nil, err
+	}
+	if name == nil {
+		return nil, nil
+	}
+
+	f, err := h.ObjectOpen(*name)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+
+	st, err := f.Stat()
+	if err != nil {
+		return nil, err
+	}
+
+	data := make([]byte, st.Size())
+	err = readAll(f, data)
+	if err != nil {
+		return nil, err
+	}
+	return DecodeTrace(data)
+}
+
+// Issue readahead on each of the named objects using up to parallelism
+// concurrent workers. Objects are started in the order given. Objects that
+// cannot be opened are skipped; the number of such objects is returned.
+func PrefetchObjects(h hcas.Hcas, names []hcas.Name, parallelism int) int {
+	if parallelism < 1 {
+		parallelism = 1
+	}
+
+	var wg sync.WaitGroup
+	var failLock sync.Mutex
+	failures := 0
+
+	work := make(chan hcas.Name)
+	for i := 0; i < parallelism; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for name := range work {
+				if prefetchObject(h, name) != nil {
+					failLock.Lock()
+					failures++
+					failLock.Unlock()
+				}
+			}
+		}()
+	}
+
+	for _, name := range names {
+		work <- name
+	}
+	close(work)
+	wg.Wait()
+
+	return failures
+}
+
+func prefetchObject(h hcas.Hcas, name hcas.Name) error {
+	f, err := h.ObjectOpen(name)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+
+	return unix.Fadvise(int(f.Fd()), 0, 0, unix.FADV_WILLNEED)
+}
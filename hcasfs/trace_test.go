@@ -0,0 +1,106 @@
+package hcasfs
+
+import (
+	"testing"
+	"time"
+
+	"github.com/msg555/hcas/hcas"
+)
+
+func traceTestName(c byte) hcas.Name {
+	name := make([]byte, 32)
+	for i := range name {
+		name[i] = c
+	}
+	return hcas.NewName(string(name))
+}
+
+func TestTraceRecorderOrderAndDedup(t *testing.T) {
+	a, b, c := traceTestName('a'), traceTestName('b'), traceTestName('c')
+
+	tr := NewTraceRecorder(time.Hour, 2)
+	tr.Record(&b)
+	tr.Record(&a)
+	tr.Record(&b)
+	tr.Record(&c)
+
+	names := tr.Names()
+	if len(names) != 2 || names[0] != b || names[1] != a {
+		t.Fatalf("unexpected trace %v", names)
+	}
+}
+
+func TestTraceRecorderWindow(t *testing.T) {
+	a := traceTestName('a')
+
+	tr := NewTraceRecorder(0, 10)
+	time.Sleep(time.Millisecond)
+	tr.Record(&a)
+
+	if len(tr.Names()) != 0 {
+		t.Fatal("expected access after window to be ignored")
+	}
+}
+
+func TestTraceEncodeDecode(t *testing.T) {
+	a, b := traceTestName('a'), traceTestName('b')
+
+	names, err := DecodeTrace(EncodeTrace([]hcas.Name{a, b, a}))
+	if err != nil {
+		t.Fatalf("Failed to decode trace: %v", err)
+	}
+	if len(names) != 2 || names[0] != a || names[1] != b {
+		t.Fatalf("unexpected trace %v", names)
+	}
+
+	_, err = DecodeTrace(make([]byte, 33))
+	if err == nil {
+		t.Fatal("expected error decoding truncated trace")
+	}
+}
+
+func TestTraceSaveLoadPrefetch(t *testing.T) {
+	env := createTestEnvironment(t)
+	defer env.store.Close()
+
+	var names []hcas.Name
+	for _, data := range []string{"one", "two", "three"} {
+		name, err := env.session.CreateObject([]byte(data))
+		if err != nil {
+			t.Fatalf("Failed to create object: %v", err)
+		}
+		names = append(names, *name)
+	}
+
+	loaded, err := LoadTrace(env.store, env.session, "image")
+	if err != nil {
+		t.Fatalf("Failed to load missing trace: %v", err)
+	}
+	if loaded != nil {
+		t.Fatal("expected no trace before one is saved")
+	}
+
+	_, err = SaveTrace(env.session, "image", names)
+	if err != nil {
+		t.Fatalf("Failed to save trace: %v", err)
+	}
+
+	loaded, err = LoadTrace(env.store, env.session, "image")
+	if err != nil {
+		t.Fatalf("Failed to load trace: %v", err)
+	}
+	if len(loaded) != len(names) {
+		t.Fatalf("expected %d names, got %d", len(names), len(loaded))
+	}
+	for i := range names {
+		if loaded[i] != names[i] {
+			t.Fatalf("trace entry %d mismatch", i)
+		}
+	}
+
+	missing := traceTestName('z')
+	failures := PrefetchObjects(env.store, append(loaded, missing), 2)
+	if failures != 1 {
+		t.Fatalf("expected 1 prefetch failure, got %d", failures)
+	}
+}
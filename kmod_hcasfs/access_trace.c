@@ -0,0 +1,92 @@
+/*
+ * HCAS Filesystem - Access Traces
+ *
+ * Fixed size per mount buffer of the objects resolved shortly after mount.
+ */
+
+#include "hcasfs.h"
+#include "access_trace.h"
+
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+
+struct hcasfs_trace {
+	struct dentry *debugfs;
+	ktime_t deadline;
+	u32 capacity;
+	/* Entries are published by a release store of count. */
+	u32 count;
+	spinlock_t lock;
+	char (*names)[HCASFS_OBJECT_NAME_LEN];
+};
+
+void hcasfs_trace_record(struct hcasfs_trace *trace,
+			 const char name[HCASFS_OBJECT_NAME_LEN])
+{
+	u32 count;
+
+	if (!trace || READ_ONCE(trace->count) >= trace->capacity)
+		return;
+	if (ktime_after(ktime_get(), trace->deadline))
+		return;
+
+	spin_lock(&trace->lock);
+	count = trace->count;
+	if (count < trace->capacity) {
+		memcpy(trace->names[count], name, HCASFS_OBJECT_NAME_LEN);
+		smp_store_release(&trace->count, count + 1);
+	}
+	spin_unlock(&trace->lock);
+}
+
+static ssize_t hcasfs_trace_read(struct file *file, char __user *buf,
+				 size_t len, loff_t *ppos)
+{
+	struct hcasfs_trace *trace = file->private_data;
+	u32 count = smp_load_acquire(&trace->count);
+
+	return simple_read_from_buffer(buf, len, ppos, trace->names,
+				       (size_t)count * HCASFS_OBJECT_NAME_LEN);
+}
+
+static const struct file_operations hcasfs_trace_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = hcasfs_trace_read,
+	.llseek = default_llseek,
+};
+
+struct hcasfs_trace *hcasfs_trace_create(unsigned int seconds,
+					 unsigned int max_entries,
+					 struct dentry *debugfs_dir)
+{
+	struct hcasfs_trace *trace;
+
+	trace = kzalloc(sizeof(*trace), GFP_KERNEL);
+	if (!trace)
+		return ERR_PTR(-ENOMEM);
+
+	trace->names = kvmalloc_array(max_entries, HCASFS_OBJECT_NAME_LEN,
+				      GFP_KERNEL);
+	if (!trace->names) {
+		kfree(trace);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	spin_lock_init(&trace->lock);
+	trace->capacity = max_entries;
+	trace->deadline = ktime_add_ms(ktime_get(), (u64)seconds * MSEC_PER_SEC);
+	trace->debugfs = debugfs_create_file("trace", 0400, debugfs_dir, trace,
+					     &hcasfs_trace_fops);
+	return trace;
+}
+
+void hcasfs_trace_destroy(struct hcasfs_trace *trace)
+{
+	if (!trace)
+		return;
+
+	debugfs_remove(trace->debugfs);
+	kvfree(trace->names);
+	kfree(trace);
+}
@@ -0,0 +1,27 @@
+#ifndef _ACCESS_TRACE_H
+#define _ACCESS_TRACE_H
+
+#include <linux/types.h>
+
+#include "hcasfs.h"
+
+#define HCASFS_TRACE_DEFAULT_ENTRIES 65536
+#define HCASFS_TRACE_MAX_ENTRIES (1 << 22)
+
+/* Records the order objects are first resolved in during a fixed window after
+ * mount. The trace is exposed in the "trace" file of the mount's debugfs
+ * directory as concatenated object names, the same format userspace stores
+ * traces in and the prefetch_trace mount option replays.
+ */
+struct hcasfs_trace;
+
+struct hcasfs_trace *hcasfs_trace_create(unsigned int seconds,
+					 unsigned int max_entries,
+					 struct dentry *debugfs_dir);
+void hcasfs_trace_destroy(struct hcasfs_trace *trace);
+
+/* Append name to the trace if it is still recording. trace may be NULL. */
+void hcasfs_trace_record(struct hcasfs_trace *trace,
+			 const char name[HCASFS_OBJECT_NAME_LEN]);
+
+#endif
@@ -1,20 +1,16 @@
 #include "hcasfs.h"
+#include "hcasfs_trace.h"
+#include "stats.h"
 
+#include <linux/fadvise.h>
+#include <linux/highmem.h>
 #include <linux/minmax.h>
-
-#define BUF_SIZE (4 * PAGE_SIZE)
+#include <linux/pagemap.h>
 
 struct buffered_file {
 	struct file *f;
-};
-
-struct buffered_view {
-	struct buffered_file *bf;
-	struct mutex lock;
-	loff_t f_size;
-	loff_t buf_pos;
-	loff_t buf_size;
-	char buf[BUF_SIZE];
+	/* Set if the backing mapping can be read through the page cache. */
+	bool page_cache;
 };
 
 struct buffered_file *buffered_open(struct file *f)
@@ -26,6 +22,8 @@ struct buffered_file *buffered_open(struct file *f)
 		return NULL;
 
 	bf->f = get_file(f);
+	bf->page_cache = f->f_mapping && f->f_mapping->a_ops &&
+			 f->f_mapping->a_ops->read_folio;
 	return bf;
 }
 
@@ -36,67 +34,112 @@ int buffered_close(struct buffered_file *bf)
 	return 0;
 }
 
-struct buffered_view *buffered_view_open(struct buffered_file *bf)
+loff_t buffered_readahead(struct buffered_file *bf, loff_t pos, loff_t len)
 {
-	struct buffered_view *bv;
-
-	size_t struct_size = sizeof(*bv);
-	loff_t f_size = bf->f->f_inode->i_size;
-
-	// If file size is smaller than buffer allocate buffer only large enough to
-	// fit.
-	if (f_size < BUF_SIZE)
-		f_size -= BUF_SIZE - f_size;
+	loff_t f_size = i_size_read(file_inode(bf->f));
+	struct folio *folio;
+	pgoff_t index, last;
+
+	if (pos >= f_size || len <= 0)
+		return 0;
+	len = min(len, f_size - pos);
+
+	vfs_fadvise(bf->f, pos, len, POSIX_FADV_WILLNEED);
+	if (!bf->page_cache)
+		return len;
+
+	// Folios stay locked until their read completes.
+	index = pos >> PAGE_SHIFT;
+	last = (pos + len - 1) >> PAGE_SHIFT;
+	while (index <= last) {
+		folio = filemap_get_folio(bf->f->f_mapping, index);
+		if (IS_ERR(folio)) {
+			index++;
+			continue;
+		}
+		folio_wait_locked(folio);
+		index = folio_next_index(folio);
+		folio_put(folio);
+	}
+	return len;
+}
 
-	bv = kmalloc(struct_size, GFP_KERNEL);
-	if (!bv)
-		return NULL;
+void buffered_view_init(struct buffered_view *bv, struct buffered_file *bf)
+{
 	bv->bf = bf;
-	bv->f_size = bf->f->f_inode->i_size;
-	bv->buf_pos = 0;
-	bv->buf_size = 0;
-	return bv;
+	bv->f_size = i_size_read(file_inode(bf->f));
+	bv->folio = NULL;
+	bv->mem = NULL;
+	bv->stats = NULL;
 }
 
-void buffered_view_close(struct buffered_view *bv)
+void buffered_view_init_mem(struct buffered_view *bv, char *data, loff_t size)
 {
-	kfree(bv);
+	bv->bf = NULL;
+	bv->f_size = size;
+	bv->folio = NULL;
+	bv->mem = data;
+	bv->stats = NULL;
 }
 
-static ssize_t read_block(struct buffered_view *bv, loff_t off)
+void buffered_view_release(struct buffered_view *bv)
 {
-	ssize_t bytes_read = 0;
-	ssize_t bytes_want = sizeof(bv->buf);
-	loff_t start = off;
-
-	if (bv->f_size - off < bytes_want)
-		bytes_want = bv->f_size - off;
-	if (bv->buf_pos == start) {
-		if (bytes_want <= bv->buf_size)
-			return 0;
-		bytes_read = bv->buf_size;
+	if (bv->folio) {
+		folio_put(bv->folio);
+		bv->folio = NULL;
 	}
+}
 
-	// Read in a full block. Usually this show be one kernel_read call.
-	while (bytes_want > 0) {
-		if (!bv->bf)
-			return -EIO;
-
-		ssize_t result = kernel_read(bv->bf->f, bv->buf + bytes_read,
-					     bytes_want, &off);
-		if (result < 0) {
-			bv->buf_pos = 0;
-			bv->buf_size = 0;
-			return result;
-		}
-		bytes_read += result;
-		bytes_want -= result;
+/* Return the uptodate folio containing off, reading it into the page cache if
+ * needed. The view keeps its reference until it moves to another folio.
+ */
+static struct folio *read_block(struct buffered_view *bv, loff_t off)
+{
+	pgoff_t index = off >> PAGE_SHIFT;
+	struct folio *folio = bv->folio;
+
+	if (folio && folio_contains(folio, index))
+		return folio;
+
+	buffered_view_release(bv);
+	folio = read_mapping_folio(bv->bf->f->f_mapping, index, bv->bf->f);
+	if (IS_ERR(folio))
+		return folio;
+
+	bv->folio = folio;
+	trace_hcasfs_read_block(bv->bf->f, folio_pos(folio), folio_size(folio));
+	if (bv->stats) {
+		hcasfs_stats_inc(bv->stats, HCASFS_STAT_BLOCK_READS);
+		hcasfs_stats_add(bv->stats, HCASFS_STAT_BLOCK_READ_BYTES,
+				 folio_size(folio));
 	}
+	return folio;
+}
 
-	bv->buf_pos = start;
-	bv->buf_size = bytes_read;
+/* Fallback for backing filesystems that cannot be read through their page
+ * cache directly. Always copies into buf.
+ */
+static char *read_copy(struct buffered_view *bv, char *buf, loff_t start,
+		       loff_t end)
+{
+	loff_t off = start;
 
-	return 0;
+	while (off < end) {
+		ssize_t result = kernel_read(bv->bf->f, buf + (off - start),
+					     end - off, &off);
+
+		if (result < 0)
+			return ERR_PTR(result);
+		if (result == 0)
+			return ERR_PTR(-EIO);
+		trace_hcasfs_read_block(bv->bf->f, off - result, result);
+		if (bv->stats) {
+			hcasfs_stats_inc(bv->stats, HCASFS_STAT_BLOCK_READS);
+			hcasfs_stats_add(bv->stats,
+					 HCASFS_STAT_BLOCK_READ_BYTES, result);
+		}
+	}
+	return buf;
 }
 
 char *buffered_view_read(struct buffered_view *bv, char *buf, ssize_t len,
@@ -104,33 +147,49 @@ char *buffered_view_read(struct buffered_view *bv, char *buf, ssize_t len,
 {
 	loff_t start = *pos;
 	loff_t end = start + len;
+	loff_t off;
 
 	if (end > bv->f_size)
 		end = bv->f_size;
 	if (start >= end)
 		return NULL;
 
-	loff_t block_start = start / BUF_SIZE;
-	loff_t block_end = (end - 1) / BUF_SIZE;
+	if (bv->mem) {
+		*pos = end;
+		return bv->mem + start;
+	}
 
-	for (loff_t i = block_start; i <= block_end; i++) {
-		ssize_t result = read_block(bv, i * BUF_SIZE);
+	if (!bv->bf->page_cache) {
+		char *result = read_copy(bv, buf, start, end);
 
-		if (result < 0)
-			return ERR_PTR(result);
+		if (!IS_ERR(result))
+			*pos = end;
+		return result;
+	}
+
+	for (off = start; off < end;) {
+		struct folio *folio = read_block(bv, off);
+		size_t folio_off;
+		size_t chunk;
+
+		if (IS_ERR(folio))
+			return ERR_PTR(PTR_ERR(folio));
 
-		loff_t f_s = max_t(loff_t, i * BUF_SIZE, start);
-		loff_t f_t = min_t(loff_t, (i + 1) * BUF_SIZE, end);
+		folio_off = off - folio_pos(folio);
+		chunk = min_t(loff_t, end - off, folio_size(folio) - folio_off);
 
-		if (f_s == start && f_t == end) {
-			*pos += end - start;
-			return bv->buf + start - bv->buf_pos;
+		// The whole range sits in one lowmem folio; hand back a pointer
+		// into the page cache rather than copying.
+		if (off == start && chunk == end - start &&
+		    !folio_test_highmem(folio)) {
+			*pos = end;
+			return (char *)folio_address(folio) + folio_off;
 		}
-		memcpy(buf + f_s - start, bv->buf + f_s - i * BUF_SIZE,
-		       f_t - f_s);
+		memcpy_from_folio(buf + (off - start), folio, folio_off, chunk);
+		off += chunk;
 	}
 
-	*pos += end - start;
+	*pos = end;
 	return buf;
 }
 
@@ -140,6 +199,8 @@ char *buffered_view_read_full(struct buffered_view *bv, char *buf, ssize_t len,
 	loff_t pos_cpy = *pos;
 	char *result = buffered_view_read(bv, buf, len, &pos_cpy);
 
+	if (IS_ERR(result))
+		return result;
 	if (pos_cpy - *pos != len)
 		return ERR_PTR(-EIO);
 	*pos = pos_cpy;
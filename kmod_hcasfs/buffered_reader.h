@@ -4,14 +4,51 @@
 #include <linux/types.h>
 
 struct buffered_file;
-struct buffered_view;
+struct folio;
+struct hcasfs_stats;
+
+/* A view is a cursor over a buffered_file that reads directly out of the
+ * backing file's page cache. It holds a reference to at most one folio at a
+ * time and is cheap enough to live on the stack for the duration of a single
+ * operation.
+ */
+struct buffered_view {
+	struct buffered_file *bf;
+	loff_t f_size;
+	struct folio *folio;
+	/* Set for views over an in-memory copy of the whole file. */
+	char *mem;
+	/* Optional per mount statistics to account block reads to. */
+	struct hcasfs_stats *stats;
+};
 
 struct buffered_file *buffered_open(struct file *f);
 int buffered_close(struct buffered_file *f);
 
-struct buffered_view *buffered_view_open(struct buffered_file *bf);
-void buffered_view_close(struct buffered_view *bv);
+/* Read len bytes of the file at pos into the page cache and wait for the reads
+ * to finish, so a caller reading a file window by window bounds the I/O it has
+ * in flight. Returns the number of bytes covered, 0 once pos is at or past the
+ * end of the file.
+ */
+loff_t buffered_readahead(struct buffered_file *bf, loff_t pos, loff_t len);
 
+void buffered_view_init(struct buffered_view *bv, struct buffered_file *bf);
+
+/* Initialize a view over size bytes of file contents already held in memory.
+ * Reads always return pointers into data, which must outlive the view.
+ */
+void buffered_view_init_mem(struct buffered_view *bv, char *data, loff_t size);
+
+/* Drop any folio reference held by the view. The view may be reused after
+ * this; the next read will fetch the folio again.
+ */
+void buffered_view_release(struct buffered_view *bv);
+
+/* Read up to len bytes at *pos. Returns either a pointer directly into the
+ * page cache or buf if the range had to be copied (e.g. it spans a folio
+ * boundary). The returned pointer is only valid until the next read or release
+ * on the view.
+ */
 char *buffered_view_read(struct buffered_view *bv, char *buf, ssize_t len,
 			 loff_t *pos);
 
@@ -0,0 +1,247 @@
+/*
+ * HCAS Filesystem - Directory Lookup Tables
+ *
+ * Decoded open addressing lookup tables for frequently searched directories.
+ */
+
+#include "hcasfs.h"
+#include "dir_table.h"
+#include "object_cache.h"
+
+#include <linux/debugfs.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
+#include <linux/rcupdate.h>
+#include <linux/seq_file.h>
+#include <linux/shrinker.h>
+
+/* Directories smaller than this are cheap enough to binary search. */
+#define HCASFS_DIR_TABLE_MIN_ENTRIES 64
+/* Tables are built synchronously on the lookup path, so cap them at 2 MiB of
+ * slots. Larger directories are left to the on-disk index.
+ */
+#define HCASFS_DIR_TABLE_MAX_ENTRIES (1U << 17)
+
+static unsigned int dir_table_threshold = 8;
+module_param(dir_table_threshold, uint, 0644);
+MODULE_PARM_DESC(dir_table_threshold,
+		 "Lookups in a directory before building its lookup table (0 disables)");
+
+struct hcasfs_dir_table_slot {
+	u32 crc;
+	u32 position; /* 0 marks an empty slot */
+};
+
+struct hcasfs_dir_table {
+	struct rcu_head rcu;
+	u32 mask;
+	struct hcasfs_dir_table_slot slots[];
+};
+
+/* Protects object table pointers and the LRU of objects owning a table. */
+static DEFINE_SPINLOCK(hcasfs_dir_table_lock);
+static LIST_HEAD(hcasfs_dir_table_lru);
+static unsigned long hcasfs_dir_table_count;
+
+static struct shrinker *hcasfs_dir_table_shrinker;
+
+static atomic_long_t hcasfs_dir_table_built = ATOMIC_LONG_INIT(0);
+static atomic_long_t hcasfs_dir_table_reclaimed = ATOMIC_LONG_INIT(0);
+static atomic_long_t hcasfs_dir_table_hits = ATOMIC_LONG_INIT(0);
+
+int hcasfs_dir_table_lookup(struct hcasfs_object *obj, u32 crc, u32 *positions,
+			    int max)
+{
+	struct hcasfs_dir_table *table;
+	int count = 0;
+
+	rcu_read_lock();
+	table = rcu_dereference(obj->table);
+	if (!table) {
+		rcu_read_unlock();
+		return -ENOENT;
+	}
+
+	// Tables are at most half full so the probe always ends on an empty slot.
+	for (u32 i = crc & table->mask;; i = (i + 1) & table->mask) {
+		struct hcasfs_dir_table_slot *slot = &table->slots[i];
+
+		if (!slot->position)
+			break;
+		if (slot->crc != crc)
+			continue;
+		if (count == max) {
+			count = -E2BIG;
+			break;
+		}
+		positions[count++] = slot->position;
+	}
+	rcu_read_unlock();
+
+	if (count >= 0)
+		atomic_long_inc(&hcasfs_dir_table_hits);
+	return count;
+}
+
+static struct hcasfs_dir_table *
+hcasfs_dir_table_build(struct buffered_view *bv,
+		       struct hcasfs_inode_dir_info *dir_info)
+{
+	u32 entry_count = dir_info->entry_count;
+	struct hcasfs_dir_table *table;
+	u32 slot_count = roundup_pow_of_two(entry_count * 2);
+	char buf[512];
+	u32 ind = 0;
+
+	table = kvzalloc(struct_size(table, slots, slot_count), GFP_KERNEL);
+	if (!table)
+		return ERR_PTR(-ENOMEM);
+	table->mask = slot_count - 1;
+
+	while (ind < entry_count) {
+		u32 batch = min_t(u32, entry_count - ind, sizeof(buf) / 8);
+		loff_t pos = dir_info->index_offset + 8 * (loff_t)ind;
+		char *data;
+
+		data = buffered_view_read_full(bv, buf, 8 * batch, &pos);
+		if (IS_ERR(data)) {
+			kvfree(table);
+			return ERR_PTR(PTR_ERR(data));
+		}
+
+		for (u32 j = 0; j < batch; j++, data += 8) {
+			u32 position = get_unaligned_be32(data + 0);
+			u32 crc = get_unaligned_be32(data + 4);
+			u32 i = crc & table->mask;
+
+			if (!position) {
+				kvfree(table);
+				return ERR_PTR(-EIO);
+			}
+			while (table->slots[i].position)
+				i = (i + 1) & table->mask;
+			table->slots[i].crc = crc;
+			table->slots[i].position = position;
+		}
+		ind += batch;
+	}
+
+	return table;
+}
+
+void hcasfs_dir_table_note_lookup(struct hcasfs_object *obj,
+				  struct buffered_view *bv,
+				  struct hcasfs_inode_dir_info *dir_info)
+{
+	unsigned int threshold = READ_ONCE(dir_table_threshold);
+	struct hcasfs_dir_table *table;
+
+	if (!threshold || dir_info->entry_count < HCASFS_DIR_TABLE_MIN_ENTRIES ||
+	    dir_info->entry_count > HCASFS_DIR_TABLE_MAX_ENTRIES)
+		return;
+	if (atomic_inc_return(&obj->lookups) < threshold)
+		return;
+
+	// Only one of the racing lookups gets to build the table; the counter
+	// stays negative until the table is reclaimed.
+	if (atomic_xchg(&obj->lookups, INT_MIN) < threshold)
+		return;
+
+	table = hcasfs_dir_table_build(bv, dir_info);
+	if (IS_ERR(table)) {
+		atomic_set(&obj->lookups, 0);
+		return;
+	}
+
+	spin_lock(&hcasfs_dir_table_lock);
+	rcu_assign_pointer(obj->table, table);
+	list_add_tail(&obj->table_lru, &hcasfs_dir_table_lru);
+	hcasfs_dir_table_count++;
+	spin_unlock(&hcasfs_dir_table_lock);
+
+	atomic_long_inc(&hcasfs_dir_table_built);
+}
+
+/* Detach and free obj's table. Called with hcasfs_dir_table_lock held. */
+static bool hcasfs_dir_table_detach(struct hcasfs_object *obj)
+{
+	struct hcasfs_dir_table *table;
+
+	table = rcu_dereference_protected(
+		obj->table, lockdep_is_held(&hcasfs_dir_table_lock));
+	if (!table)
+		return false;
+
+	RCU_INIT_POINTER(obj->table, NULL);
+	list_del_init(&obj->table_lru);
+	hcasfs_dir_table_count--;
+	kvfree_rcu(table, rcu);
+	return true;
+}
+
+void hcasfs_dir_table_drop(struct hcasfs_object *obj)
+{
+	spin_lock(&hcasfs_dir_table_lock);
+	hcasfs_dir_table_detach(obj);
+	spin_unlock(&hcasfs_dir_table_lock);
+}
+
+static unsigned long hcasfs_dir_table_shrink_count(struct shrinker *shrink,
+						   struct shrink_control *sc)
+{
+	unsigned long count = READ_ONCE(hcasfs_dir_table_count);
+
+	return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long hcasfs_dir_table_shrink_scan(struct shrinker *shrink,
+						  struct shrink_control *sc)
+{
+	struct hcasfs_object *obj;
+	unsigned long freed = 0;
+
+	spin_lock(&hcasfs_dir_table_lock);
+	while (freed < sc->nr_to_scan &&
+	       !list_empty(&hcasfs_dir_table_lru)) {
+		obj = list_first_entry(&hcasfs_dir_table_lru,
+				       struct hcasfs_object, table_lru);
+		hcasfs_dir_table_detach(obj);
+		atomic_set(&obj->lookups, 0);
+		freed++;
+	}
+	spin_unlock(&hcasfs_dir_table_lock);
+
+	atomic_long_add(freed, &hcasfs_dir_table_reclaimed);
+	return freed;
+}
+
+static int hcasfs_dir_table_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "tables: %lu\n", READ_ONCE(hcasfs_dir_table_count));
+	seq_printf(m, "built: %ld\n",
+		   atomic_long_read(&hcasfs_dir_table_built));
+	seq_printf(m, "reclaimed: %ld\n",
+		   atomic_long_read(&hcasfs_dir_table_reclaimed));
+	seq_printf(m, "hits: %ld\n", atomic_long_read(&hcasfs_dir_table_hits));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hcasfs_dir_table);
+
+int hcasfs_dir_table_init(void)
+{
+	hcasfs_dir_table_shrinker = shrinker_alloc(0, "hcasfs-dir-table");
+	if (!hcasfs_dir_table_shrinker)
+		return -ENOMEM;
+	hcasfs_dir_table_shrinker->count_objects = hcasfs_dir_table_shrink_count;
+	hcasfs_dir_table_shrinker->scan_objects = hcasfs_dir_table_shrink_scan;
+	shrinker_register(hcasfs_dir_table_shrinker);
+
+	debugfs_create_file("dir_table", 0444, hcasfs_debugfs_root, NULL,
+			    &hcasfs_dir_table_fops);
+	return 0;
+}
+
+void hcasfs_dir_table_exit(void)
+{
+	shrinker_free(hcasfs_dir_table_shrinker);
+}
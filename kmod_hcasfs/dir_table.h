@@ -0,0 +1,38 @@
+#ifndef _DIR_TABLE_H
+#define _DIR_TABLE_H
+
+#include <linux/types.h>
+
+#include "hcasfs.h"
+
+struct hcasfs_object;
+struct hcasfs_inode_dir_info;
+
+/* In-memory open addressing table mapping name checksums to record positions
+ * for directories that see repeated lookups. Tables are built after a number of
+ * lookups on the same directory object and can be reclaimed at any time by a
+ * shrinker, after which lookups fall back to searching the on-disk index.
+ */
+struct hcasfs_dir_table;
+
+/* Fill positions with the record positions of up to max candidates whose
+ * checksum matches crc. Returns the number of candidates, -ENOENT if the
+ * object has no table, or -E2BIG if there are more than max candidates.
+ */
+int hcasfs_dir_table_lookup(struct hcasfs_object *obj, u32 crc, u32 *positions,
+			    int max);
+
+/* Count a lookup that missed the table, building the table once the object
+ * has seen enough lookups. bv must be a view of the object's backing file.
+ */
+void hcasfs_dir_table_note_lookup(struct hcasfs_object *obj,
+				  struct buffered_view *bv,
+				  struct hcasfs_inode_dir_info *dir_info);
+
+/* Free any table attached to obj. Called when the object is freed. */
+void hcasfs_dir_table_drop(struct hcasfs_object *obj);
+
+int hcasfs_dir_table_init(void);
+void hcasfs_dir_table_exit(void);
+
+#endif
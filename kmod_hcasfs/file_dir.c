@@ -1,76 +1,98 @@
 #include "hcasfs.h"
+#include "hcasfs_trace.h"
 #include "inode.h"
+#include "record.h"
+#include "shard.h"
+#include "stats.h"
 
 struct hcasfs_dir_data {
-	struct buffered_view *bv;
+	struct buffered_view bv;
 	u32 entry_count;
 	loff_t f_pos;
 	loff_t dir_pos;
+
+	/* Entries [leaf_start, leaf_end) are read through bv from the object
+	 * described by leaf_info. For sharded directories that is the leaf held
+	 * in leaf, otherwise the directory's own object.
+	 */
+	struct hcasfs_object *leaf;
+	struct hcasfs_inode_dir_info *leaf_info;
+	u64 leaf_base;
+	u32 leaf_start;
+	u32 leaf_end;
 };
 
+/* Emit the record at the current offset. Returns 1 if it was emitted, 0 if
+ * ctx is full, or a negative error.
+ */
 static int hcasfs_readdir_one(struct file *file, struct dir_context *ctx)
 {
-	char buf[256]; // NAME_MAX + 1?
-	char *data;
+	char buf[HCASFS_RECORD_MAX];
+	struct hcasfs_record rec;
 	struct hcasfs_dir_data *dir_data = file->private_data;
 	loff_t dir_pos = dir_data->f_pos;
+	int result;
 
-	data = buffered_view_read_full(dir_data->bv, buf, 96, &dir_pos);
-	if (IS_ERR(data))
-		return PTR_ERR(data);
-
-	u32 mode = get_unaligned_be32(data + 0);
-	u64 parent_dep_index = get_unaligned_be64(data + 84);
-	u32 file_name_len = get_unaligned_be32(data + 92);
+	result = hcasfs_record_read(&dir_data->bv, dir_data->leaf_info, buf,
+				    &dir_pos, &rec);
+	if (result)
+		return result;
 
-	if (file_name_len > sizeof(buf))
-		return -EIO;
+	u64 inode_num = file->f_inode->i_ino + dir_data->leaf_base +
+			rec.parent_dep_index;
 
-	data = buffered_view_read_full(dir_data->bv, buf,
-				       ALIGN(file_name_len, 8), &dir_pos);
-	if (IS_ERR(data))
-		return PTR_ERR(data);
+	// Leave the entry to be emitted again by the next call if the caller's
+	// buffer is full.
+	if (!dir_emit(ctx, rec.name, rec.name_len, inode_num,
+		      (rec.mode & S_IFMT) >> 12))
+		return 0;
 
 	dir_data->f_pos = dir_pos;
-	u64 inode_num = file->f_inode->i_ino + parent_dep_index;
-
-	return dir_emit(ctx, data, file_name_len, inode_num,
-			(mode & S_IFMT) >> 12);
+	hcasfs_stats_inc(hcasfs_sb_stats(file_inode(file)->i_sb),
+			 HCASFS_STAT_READDIR_ENTRIES);
+	return 1;
 }
 
 static int hcasfs_opendir(struct inode *inode, struct file *file)
 {
 	struct hcasfs_dir_data *dir_data;
-	struct buffered_file *bf;
 	struct hcasfs_inode_dir_info *dir_info;
+	int result;
 
-	dir_data = kmalloc(sizeof(*dir_data), GFP_KERNEL);
+	dir_data = kzalloc(sizeof(*dir_data), GFP_KERNEL);
 	if (!dir_data)
 		return -ENOMEM;
 
-	bf = hcasfs_inode_buffered_file(inode);
-	if (IS_ERR(bf)) {
-		kfree(dir_data);
-		return PTR_ERR(bf);
+	// Inline directories are empty, only the dots are emitted.
+	if (hcasfs_inode_is_inline(inode)) {
+		file->private_data = dir_data;
+		return 0;
 	}
 
 	dir_info = hcasfs_inode_dir_info(inode);
 	if (IS_ERR(dir_info)) {
 		kfree(dir_data);
-		return PTR_ERR(dir_data);
+		return PTR_ERR(dir_info);
 	}
+	dir_data->entry_count = dir_info->entry_count;
 
-	dir_data->bv = buffered_view_open(bf);
-	if (IS_ERR(dir_data->bv)) {
-		int err = PTR_ERR(dir_data->bv);
+	// The first leaf of a sharded directory is found by the first readdir.
+	if (dir_info->flags & HCASFS_DIR_FLAG_SHARDED) {
+		dir_data->dir_pos = -1;
+		file->private_data = dir_data;
+		return 0;
+	}
 
+	result = hcasfs_inode_dir_view(inode, &dir_data->bv);
+	if (result) {
 		kfree(dir_data);
-		return err;
+		return result;
 	}
 
 	dir_data->dir_pos = 2;
-	dir_data->entry_count = dir_info->entry_count;
-	dir_data->f_pos = 16 + 8 * dir_info->entry_count;
+	dir_data->f_pos = dir_info->records_offset;
+	dir_data->leaf_info = dir_info;
+	dir_data->leaf_end = dir_info->entry_count;
 
 	file->private_data = dir_data;
 	return 0;
@@ -81,33 +103,94 @@ static int hcasfs_release(struct inode *inode, struct file *file)
 	struct hcasfs_dir_data *dir_data = file->private_data;
 
 	if (dir_data) {
-		buffered_view_close(dir_data->bv);
+		buffered_view_release(&dir_data->bv);
+		if (dir_data->leaf)
+			hcasfs_object_put(dir_data->leaf);
 		kfree(dir_data);
 	}
 	return 0;
 }
 
+/* Switch the view of a sharded directory to the leaf holding entry pos. */
+static int hcasfs_seek_leaf(struct file *file, u32 pos)
+{
+	struct inode *inode = file_inode(file);
+	struct hcasfs_dir_data *dir_data = file->private_data;
+	struct hcasfs_inode_dir_info *leaf_info;
+	struct hcasfs_object *obj;
+	struct hcasfs_object *leaf;
+	u32 leaf_pos = pos;
+	u64 base;
+	int result;
+
+	obj = hcasfs_inode_object(inode);
+	if (IS_ERR(obj))
+		return PTR_ERR(obj);
+
+	// Drop the current leaf first so a failure leaves no leaf selected.
+	buffered_view_release(&dir_data->bv);
+	if (dir_data->leaf)
+		hcasfs_object_put(dir_data->leaf);
+	dir_data->leaf = NULL;
+	dir_data->leaf_start = 0;
+	dir_data->leaf_end = 0;
+
+	leaf = hcasfs_shard_seek(inode->i_sb, obj, &leaf_pos, &base);
+	if (IS_ERR(leaf))
+		return PTR_ERR(leaf);
+
+	leaf_info = hcasfs_object_dir_info(leaf, hcasfs_creds(inode->i_sb));
+	if (IS_ERR(leaf_info)) {
+		hcasfs_object_put(leaf);
+		return PTR_ERR(leaf_info);
+	}
+	if (leaf_pos >= leaf_info->entry_count) {
+		hcasfs_object_put(leaf);
+		return -EIO;
+	}
+
+	result = hcasfs_object_dir_view(inode->i_sb, leaf, &dir_data->bv);
+	if (result) {
+		hcasfs_object_put(leaf);
+		return result;
+	}
+
+	dir_data->leaf = leaf;
+	dir_data->leaf_info = leaf_info;
+	dir_data->leaf_base = base;
+	dir_data->leaf_start = pos - leaf_pos;
+	dir_data->leaf_end = dir_data->leaf_start + leaf_info->entry_count;
+	return 0;
+}
+
 static int hcasfs_seek_dir(struct file *file, loff_t pos)
 {
 	loff_t read_pos;
 	char dir_index_data[4];
 	char *data;
 	struct hcasfs_dir_data *dir_data = file->private_data;
-	struct hcasfs_inode_dir_info *inode_dir_info =
-		hcasfs_inode_dir_info(file_inode(file));
 
-	if (WARN_ON(pos < 0 || pos >= inode_dir_info->entry_count))
+	if (WARN_ON(pos < 0 || pos >= dir_data->entry_count))
 		return -EIO;
 
+	if (pos < dir_data->leaf_start || pos >= dir_data->leaf_end) {
+		int result = hcasfs_seek_leaf(file, pos);
+
+		if (result)
+			return result;
+	}
+
 	// Find the file's offset in the dirent offset table
-	read_pos = 16 + 8 * pos;
-	data = buffered_view_read_full(dir_data->bv, dir_index_data,
+	read_pos = dir_data->leaf_info->index_offset +
+		   8 * (pos - dir_data->leaf_start);
+	data = buffered_view_read_full(&dir_data->bv, dir_index_data,
 				       sizeof(dir_index_data), &read_pos);
 	if (IS_ERR(data))
 		return PTR_ERR(data);
 
 	// Set the read offset
 	dir_data->f_pos = get_unaligned_be32(data);
+	dir_data->dir_pos = pos + 2;
 	return 0;
 }
 
@@ -116,45 +199,55 @@ static int hcasfs_readdir(struct file *file, struct dir_context *ctx)
 {
 	loff_t start_pos = ctx->pos;
 	struct hcasfs_dir_data *dir_data = file->private_data;
-	struct hcasfs_inode_dir_info *inode_dir_info;
 
 	if (!dir_data)
 		return -EIO;
 
-	inode_dir_info = hcasfs_inode_dir_info(file_inode(file));
-	if (IS_ERR(inode_dir_info))
-		return PTR_ERR(inode_dir_info);
-
 	/* Emit . and .. entries */
 	if (!dir_emit_dots(file, ctx))
 		return 0;
 
 	/* Passed the end of the directory already */
-	if (ctx->pos >= inode_dir_info->entry_count + 2)
+	if (ctx->pos >= dir_data->entry_count + 2)
 		return 0;
 
-	if (dir_data->dir_pos != ctx->pos) {
-		/* Need to seek our position in the directory. */
-		int result = hcasfs_seek_dir(file, ctx->pos - 2);
-
-		if (result)
-			return result;
-	}
-
 	// Emit as many records as can fit in the buffer.
-	while (ctx->pos < inode_dir_info->entry_count + 2) {
-		int result = hcasfs_readdir_one(file, ctx);
+	while (ctx->pos < dir_data->entry_count + 2) {
+		int result;
+
+		/* Need to seek our position in the directory, or move on to the
+		 * next leaf of a sharded directory.
+		 */
+		if (dir_data->dir_pos != ctx->pos ||
+		    ctx->pos - 2 >= dir_data->leaf_end) {
+			result = hcasfs_seek_dir(file, ctx->pos - 2);
+			if (result) {
+				buffered_view_release(&dir_data->bv);
+				return result;
+			}
+		}
+
+		result = hcasfs_readdir_one(file, ctx);
 
 		if (result < 0) {
+			buffered_view_release(&dir_data->bv);
+			trace_hcasfs_readdir(file_inode(file), start_pos,
+					     ctx->pos - start_pos, result);
 			if (ctx->pos == start_pos)
 				return 0;
 			return result;
 		}
+		if (result == 0)
+			break;
 
 		dir_data->dir_pos++;
 		ctx->pos++;
 	}
 
+	// Don't hold on to page cache folios between getdents calls.
+	buffered_view_release(&dir_data->bv);
+	trace_hcasfs_readdir(file_inode(file), start_pos, ctx->pos - start_pos,
+			     0);
 	return 0;
 }
 
@@ -5,29 +5,83 @@
  */
 
 #include "hcasfs.h"
+#include "hcasfs_trace.h"
 #include "inode.h"
+#include "record.h"
+#include "stats.h"
 #include <linux/backing-file.h>
+#include <linux/fadvise.h>
+#include <linux/highmem.h>
+#include <linux/pagemap.h>
 #include <linux/uaccess.h>
 
+/* Backing file shared by all overlapping opens of an inode through the same
+ * path. The backing file pins the user path it was opened for, so it can't be
+ * kept around after the last close without pinning the inode itself.
+ */
 struct hcasfs_file_data {
+	/* Protected by the inode's i_lock. */
+	unsigned int users;
 	struct file *backing_file;
 };
 
+/* Find the shared backing file for opens of inode at path, taking a user
+ * reference on it.
+ */
+static struct hcasfs_file_data *hcasfs_file_data_get(struct inode *inode,
+						     const struct path *path)
+{
+	struct hcasfs_inode_info *info = inode->i_private;
+	struct hcasfs_file_data *file_data;
+
+	spin_lock(&inode->i_lock);
+	file_data = info->file_data;
+	if (file_data &&
+	    path_equal(backing_file_user_path(file_data->backing_file), path))
+		file_data->users++;
+	else
+		file_data = NULL;
+	spin_unlock(&inode->i_lock);
+
+	return file_data;
+}
+
 /* File open operation */
 static int hcasfs_open(struct inode *inode, struct file *file)
 {
+	struct hcasfs_inode_info *info = inode->i_private;
+	struct hcasfs_stats *stats = hcasfs_sb_stats(inode->i_sb);
 	struct file *backing_file;
 	struct hcasfs_file_data *file_data;
-	struct hcasfs_inode_info *inode_info = inode->i_private;
+	struct hcasfs_object *obj;
+	u64 start;
 
 	if (!hcasfs_inode_has_content(inode))
 		return 0;
 
-	backing_file = backing_file_open(&file->f_path, O_RDONLY,
-					 &inode_info->path,
+	// The backing file is always opened read only and reads carry their own
+	// position so overlapping opens can share it.
+	file_data = hcasfs_file_data_get(inode, &file->f_path);
+	if (file_data) {
+		hcasfs_stats_inc(stats, HCASFS_STAT_BACKING_OPENS_SHARED);
+		trace_hcasfs_open(inode, true, 0, 0);
+		file->private_data = file_data;
+		return 0;
+	}
+
+	obj = hcasfs_inode_object(inode);
+	if (IS_ERR(obj))
+		return PTR_ERR(obj);
+
+	start = ktime_get_ns();
+	backing_file = backing_file_open(&file->f_path, O_RDONLY, &obj->path,
 					 hcasfs_creds(inode->i_sb));
-	if (IS_ERR(file))
+	trace_hcasfs_open(inode, false, ktime_get_ns() - start,
+			  PTR_ERR_OR_ZERO(backing_file));
+	if (IS_ERR(backing_file))
 		return PTR_ERR(backing_file);
+	hcasfs_stats_inc(stats, HCASFS_STAT_BACKING_OPENS);
+	hcasfs_stats_time(stats, HCASFS_HIST_BACKING_OPEN, start);
 
 	file_data = kmalloc(sizeof(*file_data), GFP_KERNEL);
 	if (!file_data) {
@@ -35,16 +89,37 @@ static int hcasfs_open(struct inode *inode, struct file *file)
 		return -ENOMEM;
 	}
 
+	file_data->users = 1;
 	file_data->backing_file = backing_file;
+
+	// If a racing open already published its backing file just keep ours
+	// private to this open.
+	spin_lock(&inode->i_lock);
+	if (!info->file_data)
+		info->file_data = file_data;
+	spin_unlock(&inode->i_lock);
+
 	file->private_data = file_data;
 	return 0;
 }
 
 static int hcasfs_release(struct inode *inode, struct file *file)
 {
+	struct hcasfs_inode_info *info = inode->i_private;
 	struct hcasfs_file_data *file_data = file->private_data;
+	bool last;
 
-	if (file_data) {
+	if (!file_data)
+		return 0;
+
+	spin_lock(&inode->i_lock);
+	last = --file_data->users == 0;
+	if (last && info->file_data == file_data)
+		info->file_data = NULL;
+	spin_unlock(&inode->i_lock);
+
+	trace_hcasfs_release(inode, last);
+	if (last) {
 		filp_close(file_data->backing_file, 0);
 		kfree(file_data);
 	}
@@ -89,6 +164,18 @@ static int hcasfs_fadvise(struct file *file, loff_t offset, loff_t len,
 	struct hcasfs_file_data *file_data = file->private_data;
 	int ret;
 
+	switch (advice) {
+	case POSIX_FADV_NORMAL:
+	case POSIX_FADV_RANDOM:
+	case POSIX_FADV_SEQUENTIAL:
+	case POSIX_FADV_NOREUSE:
+		// These only change the access mode and readahead state of the
+		// backing file, which is shared with every overlapping open of
+		// the inode. Accept them without letting one opener change them
+		// for all the others.
+		return len < 0 ? -EINVAL : 0;
+	}
+
 	old_creds = override_creds(hcasfs_creds(file_inode(file)->i_sb));
 	ret = vfs_fadvise(file_data->backing_file, offset, len, advice);
 	revert_creds(old_creds);
@@ -126,3 +213,32 @@ const struct file_operations hcasfs_reg_ops = {
 	.fadvise = hcasfs_fadvise,
 	.splice_read = hcasfs_splice_read,
 };
+
+/* Regular files with inline content (see record.h) have no backing file. Their
+ * page cache is filled from the inode and serves reads, mmap and splice.
+ */
+static int hcasfs_inline_read_folio(struct file *file, struct folio *folio)
+{
+	struct inode *inode = folio->mapping->host;
+	struct hcasfs_inode_info *info = inode->i_private;
+	size_t len = 0;
+
+	// Inline content always fits in the first folio.
+	if (folio->index == 0)
+		len = min_t(loff_t, i_size_read(inode), HCASFS_INLINE_MAX);
+	folio_fill_tail(folio, 0, info->name, len);
+	folio_mark_uptodate(folio);
+	folio_unlock(folio);
+	return 0;
+}
+
+const struct address_space_operations hcasfs_inline_aops = {
+	.read_folio = hcasfs_inline_read_folio,
+};
+
+const struct file_operations hcasfs_inline_reg_ops = {
+	.read_iter = generic_file_read_iter,
+	.llseek = generic_file_llseek,
+	.mmap = generic_file_readonly_mmap,
+	.splice_read = filemap_splice_read,
+};
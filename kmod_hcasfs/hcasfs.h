@@ -27,7 +27,6 @@
 #define HCASFS_MAGIC 0x48434153 /* "HCAS" */
 
 #define HCASFS_OBJECT_NAME_LEN 32
-#define HCASFS_MAX_OBJECT_PATH_LEN 80
 
 /* Mount data passed between mount and fill_super */
 struct hcasfs_mount_data {
@@ -41,6 +40,20 @@ int hcasfs_fill_super(struct super_block *sb, void *data, int silent);
 extern const struct file_operations hcasfs_reg_ops;
 extern const struct file_operations hcasfs_dir_ops;
 
+/* File and address space operations for regular files with inline content */
+extern const struct file_operations hcasfs_inline_reg_ops;
+extern const struct address_space_operations hcasfs_inline_aops;
+
+/* Root of the module's debugfs directory, may be NULL or an error pointer if
+ * debugfs is unavailable (debugfs_create_* accept either). */
+extern struct dentry *hcasfs_debugfs_root;
+
+/* Statistics of the mount, see stats.h. */
+struct hcasfs_stats *hcasfs_sb_stats(struct super_block *sb);
+
+/* The HCAS data directory backing the mount. */
+const struct path *hcasfs_data_dir(struct super_block *sb);
+
 /* Get the creds were used to create the mount. These should be used whenever
  * accessing backing files (assuming hcasfs' permission checks themselves look
  * good for the caller). */
@@ -50,8 +63,18 @@ const struct cred *hcasfs_creds(struct super_block *sb);
 int hcasfs_lookup_object(struct super_block *sb,
 			 char obj_name[HCASFS_OBJECT_NAME_LEN], struct path *out);
 
-/* Make a new inode for the given object name. */
-struct inode *hcasfs_new_inode(struct super_block *sb,
-			       char hcas_object_name[HCASFS_OBJECT_NAME_LEN]);
+/* Record the first access to an object for the mount's access trace, if the
+ * mount is recording one.
+ */
+void hcasfs_trace_access(struct super_block *sb,
+			 char name[HCASFS_OBJECT_NAME_LEN]);
+
+/* Find or create the inode numbered ino backed by the given object name.
+ * Inodes are hashed by number so repeated lookups share one in-memory inode.
+ * If the returned inode has I_NEW set the caller must fill in its attributes
+ * and call unlock_new_inode().
+ */
+struct inode *hcasfs_iget(struct super_block *sb, unsigned long ino,
+			  char hcas_object_name[HCASFS_OBJECT_NAME_LEN]);
 
 #endif /* _HCASFS_H */
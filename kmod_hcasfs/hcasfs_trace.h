@@ -0,0 +1,183 @@
+/*
+ * HCAS Filesystem - Tracepoints
+ *
+ * Enable with e.g.
+ *   echo 1 > /sys/kernel/tracing/events/hcasfs/enable
+ * or attach with perf/bpftrace to hcasfs:<event>.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hcasfs
+
+#if !defined(_HCASFS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HCASFS_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#include "hcasfs.h"
+
+TRACE_EVENT(hcasfs_lookup,
+	TP_PROTO(struct inode *dir, const struct dentry *dentry,
+		 struct inode *inode, unsigned int probes, u64 latency_ns),
+
+	TP_ARGS(dir, dentry, inode, probes, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, dir)
+		__string(name, dentry->d_name.name)
+		__field(unsigned long, ino)
+		__field(int, error)
+		__field(unsigned int, probes)
+		__field(u64, latency_ns)
+	),
+
+	TP_fast_assign(
+		__entry->dev = dir->i_sb->s_dev;
+		__entry->dir = dir->i_ino;
+		__assign_str(name);
+		__entry->ino = IS_ERR_OR_NULL(inode) ? 0 : inode->i_ino;
+		__entry->error = IS_ERR(inode) ? PTR_ERR(inode) : 0;
+		__entry->probes = probes;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("dev=%d:%d dir=%lu name=%s ino=%lu error=%d probes=%u latency_ns=%llu",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->dir,
+		  __get_str(name), __entry->ino, __entry->error,
+		  __entry->probes, __entry->latency_ns)
+);
+
+TRACE_EVENT(hcasfs_lookup_object,
+	TP_PROTO(struct super_block *sb, const char *name, u64 latency_ns,
+		 int error),
+
+	TP_ARGS(sb, name, latency_ns, error),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__array(u8, name, HCASFS_OBJECT_NAME_LEN)
+		__field(u64, latency_ns)
+		__field(int, error)
+	),
+
+	TP_fast_assign(
+		__entry->dev = sb->s_dev;
+		memcpy(__entry->name, name, HCASFS_OBJECT_NAME_LEN);
+		__entry->latency_ns = latency_ns;
+		__entry->error = error;
+	),
+
+	TP_printk("dev=%d:%d name=%*phN latency_ns=%llu error=%d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  HCASFS_OBJECT_NAME_LEN, __entry->name, __entry->latency_ns,
+		  __entry->error)
+);
+
+TRACE_EVENT(hcasfs_read_block,
+	TP_PROTO(struct file *file, loff_t offset, size_t bytes),
+
+	TP_ARGS(file, offset, bytes),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(loff_t, offset)
+		__field(size_t, bytes)
+	),
+
+	TP_fast_assign(
+		__entry->dev = file_inode(file)->i_sb->s_dev;
+		__entry->ino = file_inode(file)->i_ino;
+		__entry->offset = offset;
+		__entry->bytes = bytes;
+	),
+
+	TP_printk("backing_dev=%d:%d backing_ino=%lu offset=%lld bytes=%zu",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		  __entry->offset, __entry->bytes)
+);
+
+TRACE_EVENT(hcasfs_open,
+	TP_PROTO(struct inode *inode, bool shared, u64 latency_ns, int error),
+
+	TP_ARGS(inode, shared, latency_ns, error),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(bool, shared)
+		__field(u64, latency_ns)
+		__field(int, error)
+	),
+
+	TP_fast_assign(
+		__entry->dev = inode->i_sb->s_dev;
+		__entry->ino = inode->i_ino;
+		__entry->shared = shared;
+		__entry->latency_ns = latency_ns;
+		__entry->error = error;
+	),
+
+	TP_printk("dev=%d:%d ino=%lu shared=%d latency_ns=%llu error=%d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		  __entry->shared, __entry->latency_ns, __entry->error)
+);
+
+TRACE_EVENT(hcasfs_release,
+	TP_PROTO(struct inode *inode, bool last),
+
+	TP_ARGS(inode, last),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(bool, last)
+	),
+
+	TP_fast_assign(
+		__entry->dev = inode->i_sb->s_dev;
+		__entry->ino = inode->i_ino;
+		__entry->last = last;
+	),
+
+	TP_printk("dev=%d:%d ino=%lu last=%d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		  __entry->last)
+);
+
+TRACE_EVENT(hcasfs_readdir,
+	TP_PROTO(struct inode *dir, loff_t pos, unsigned int entries,
+		 int error),
+
+	TP_ARGS(dir, pos, entries, error),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(loff_t, pos)
+		__field(unsigned int, entries)
+		__field(int, error)
+	),
+
+	TP_fast_assign(
+		__entry->dev = dir->i_sb->s_dev;
+		__entry->ino = dir->i_ino;
+		__entry->pos = pos;
+		__entry->entries = entries;
+		__entry->error = error;
+	),
+
+	TP_printk("dev=%d:%d ino=%lu pos=%lld entries=%u error=%d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		  __entry->pos, __entry->entries, __entry->error)
+);
+
+#endif /* _HCASFS_TRACE_H */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hcasfs_trace
+#include <trace/define_trace.h>
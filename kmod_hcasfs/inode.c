@@ -7,36 +7,48 @@
 
 #include "inode.h"
 #include "hcasfs.h"
+#include "dir_table.h"
+#include "hcasfs_trace.h"
+#include "record.h"
+#include "shard.h"
+#include "stats.h"
 
 #include <linux/crc32.h>
 
-struct inode *hcasfs_new_inode(struct super_block *sb,
-			       char hcas_object_name[HCASFS_OBJECT_NAME_LEN])
+static int hcasfs_inode_test(struct inode *inode, void *data)
+{
+	return inode->i_ino == *(unsigned long *)data;
+}
+
+static int hcasfs_inode_set(struct inode *inode, void *data)
+{
+	inode->i_ino = *(unsigned long *)data;
+	return 0;
+}
+
+struct inode *hcasfs_iget(struct super_block *sb, unsigned long ino,
+			  char hcas_object_name[HCASFS_OBJECT_NAME_LEN])
 {
 	struct inode *inode;
 	struct hcasfs_inode_info *info;
-	int result;
 
-	info = kzalloc(sizeof(*info), GFP_KERNEL);
-	if (!info)
+	inode = iget5_locked(sb, ino, hcasfs_inode_test, hcasfs_inode_set,
+			     &ino);
+	if (!inode)
 		return ERR_PTR(-ENOMEM);
+	if (!(inode->i_state & I_NEW))
+		return inode;
 
-	result = hcasfs_lookup_object(sb, hcas_object_name,
-				      &info->path);
-	if (result) {
-		kfree(info);
-		return ERR_PTR(result);
+	info = kzalloc(sizeof(*info), GFP_KERNEL);
+	if (!info) {
+		iget_failed(inode);
+		return ERR_PTR(-ENOMEM);
 	}
 
-	inode = new_inode(sb);
-	if (!inode)
-		return ERR_PTR(-ENOMEM);
-	if (IS_ERR(inode))
-		return inode;
+	memcpy(info->name, hcas_object_name, HCASFS_OBJECT_NAME_LEN);
 
-	if (S_ISLNK(inode->i_mode))
-		inode->i_link = NULL;
 	inode->i_private = info;
+	hcasfs_stats_inc(hcasfs_sb_stats(sb), HCASFS_STAT_INODE_ALLOCS);
 	return inode;
 }
 
@@ -46,14 +58,12 @@ void hcasfs_inode_evict(struct inode *inode)
 
 	truncate_inode_pages_final(&inode->i_data);
 	clear_inode(inode);
+	hcasfs_stats_inc(hcasfs_sb_stats(inode->i_sb), HCASFS_STAT_INODE_EVICTS);
 
 	info = inode->i_private;
 	if (info) {
-		if (info->bv)
-			buffered_view_close(info->bv);
-		if (info->bf)
-			buffered_close(info->bf);
-		path_put(&info->path);
+		if (info->obj)
+			hcasfs_object_put(info->obj);
 		kfree(info);
 		inode->i_private = NULL;
 	}
@@ -63,75 +73,56 @@ void hcasfs_inode_evict(struct inode *inode)
 	}
 }
 
-struct buffered_file *hcasfs_inode_buffered_file(struct inode *inode)
+struct hcasfs_object *hcasfs_inode_object(struct inode *inode)
 {
-	struct buffered_file *result;
-	struct file *file;
 	struct hcasfs_inode_info *info = inode->i_private;
+	struct hcasfs_object *obj;
+
+	obj = smp_load_acquire(&info->obj);
+	if (obj)
+		return obj;
 
-	if (!info->bf) {
-		// TODO: Take on mount creds?
-		file = dentry_open(&info->path, O_RDONLY, hcasfs_creds(inode->i_sb));
-		if (IS_ERR(file))
-			return ERR_PTR(PTR_ERR(file));
+	if (WARN_ON(!hcasfs_inode_has_content(inode)))
+		return ERR_PTR(-EIO);
 
-		result = buffered_open(file);
-		fput(file);
-		if (IS_ERR(result))
-			return result;
+	obj = hcasfs_object_get(inode->i_sb, info->name);
+	if (IS_ERR(obj))
+		return obj;
 
-		info->bf = result;
+	// Concurrent first accesses can race to resolve the object.
+	if (cmpxchg(&info->obj, NULL, obj) != NULL) {
+		hcasfs_object_put(obj);
+		return info->obj;
 	}
-	return info->bf;
+	hcasfs_trace_access(inode->i_sb, info->name);
+	return obj;
 }
 
-static struct buffered_view *hcasfs_inode_buffered_view(struct inode *inode)
+struct buffered_file *hcasfs_inode_buffered_file(struct inode *inode)
 {
-	struct hcasfs_inode_info *info = inode->i_private;
-	struct buffered_file *bf;
-	struct buffered_view *bv;
-
-	if (info->bv)
-		return info->bv;
-
-	bf = hcasfs_inode_buffered_file(inode);
-	if (IS_ERR(bf))
-		return ERR_PTR(PTR_ERR(bf));
-
-	bv = buffered_view_open(bf);
-	if (!bv)
-		return ERR_PTR(-ENOMEM);
+	struct hcasfs_object *obj = hcasfs_inode_object(inode);
 
-	info->bv = bv;
-	return bv;
+	if (IS_ERR(obj))
+		return ERR_PTR(PTR_ERR(obj));
+	return hcasfs_object_buffered_file(obj, hcasfs_creds(inode->i_sb));
 }
 
 struct hcasfs_inode_dir_info *hcasfs_inode_dir_info(struct inode *inode)
 {
-	struct hcasfs_inode_info *info = inode->i_private;
-	struct hcasfs_inode_dir_info *dinfo = &info->dir;
-	struct buffered_view *bv;
-	char *data;
-	char buf[16];
-	loff_t pos;
+	struct hcasfs_object *obj = hcasfs_inode_object(inode);
 
-	if (dinfo->initialized)
-		return dinfo;
-
-	bv = hcasfs_inode_buffered_view(inode);
-	if (IS_ERR(bv))
-		return ERR_PTR(PTR_ERR(bv));
+	if (IS_ERR(obj))
+		return ERR_PTR(PTR_ERR(obj));
+	return hcasfs_object_dir_info(obj, hcasfs_creds(inode->i_sb));
+}
 
-	pos = 0;
-	data = buffered_view_read_full(bv, buf, 16, &pos);
-	if (IS_ERR(data))
-		return ERR_PTR(PTR_ERR(data));
+int hcasfs_inode_dir_view(struct inode *inode, struct buffered_view *bv)
+{
+	struct hcasfs_object *obj = hcasfs_inode_object(inode);
 
-	dinfo->initialized = true;
-	dinfo->flags = get_unaligned_be32(data + 0);
-	dinfo->entry_count = get_unaligned_be32(data + 4);
-	dinfo->tree_size = get_unaligned_be64(data + 8);
-	return dinfo;
+	if (IS_ERR(obj))
+		return PTR_ERR(obj);
+	return hcasfs_object_dir_view(inode->i_sb, obj, bv);
 }
 
 /* Inode operations for regular files (minimal - all NULL uses VFS defaults) */
@@ -143,66 +134,79 @@ static const struct file_operations hcasfs_default_ops = {
 	/* All operations NULL - VFS provides defaults */
 };
 
+/* Instantiate the inode of the record at record_position if its name matches
+ * dentry. base is added to the record's inode offset from dir, for entries of
+ * sharded directories.
+ */
 static struct inode *_lookup_at_position(struct inode *dir,
 					 struct buffered_view *bv,
-					 u32 record_position,
-					 struct dentry *dentry)
+					 struct hcasfs_inode_dir_info *dir_info,
+					 u64 base, u32 record_position,
+					 struct dentry *dentry,
+					 unsigned int *probes)
 {
-	char buf[96 + 256]; // entry size + NAME_MAX
-	char *data;
+	char buf[HCASFS_RECORD_MAX];
+	struct hcasfs_record rec;
+	struct hcasfs_inode_info *info;
 	struct inode *inode;
+	unsigned long ino;
 	loff_t pos;
-	u32 file_name_len;
-	u64 atime, mtime, ctime;
-
-	if (WARN_ON(dentry->d_name.len > 255))
-		return NULL;
+	int result;
 
+	(*probes)++;
 	pos = record_position;
-	data = buffered_view_read(bv, buf, 96 + dentry->d_name.len, &pos);
-	if (IS_ERR(data))
-		return ERR_PTR(PTR_ERR(data));
+	result = hcasfs_record_read(bv, dir_info, buf, &pos, &rec);
+	if (result)
+		return ERR_PTR(result);
 
 	// Verify name actually matches
-	file_name_len = get_unaligned_be32(data + 92);
-	if (file_name_len != dentry->d_name.len)
-		return NULL;
-	if (strncmp(data + 96, dentry->d_name.name, dentry->d_name.len))
+	if (rec.name_len != dentry->d_name.len ||
+	    memcmp(rec.name, dentry->d_name.name, rec.name_len)) {
+		hcasfs_stats_inc(hcasfs_sb_stats(dir->i_sb),
+				 HCASFS_STAT_LOOKUP_COLLISIONS);
 		return NULL;
+	}
 
-	// TODO: May need to only read object name for nodes with objects in the
-	// future.
-	inode = hcasfs_new_inode(dir->i_sb, data + 52);
+	// The object name is only meaningful for modes with content, and is
+	// only resolved once that content is accessed. Inline records carry the
+	// content itself in its place.
+	ino = dir->i_ino + base + rec.parent_dep_index;
+	inode = hcasfs_iget(dir->i_sb, ino, rec.obj_name);
 	if (IS_ERR(inode))
 		return ERR_PTR(PTR_ERR(inode));
 
-	inode->i_mode = get_unaligned_be32(data + 0);
-	inode->i_uid.val = get_unaligned_be32(data + 4);
-	inode->i_gid.val = get_unaligned_be32(data + 8);
-
-	atime = get_unaligned_be64(data + 20);
-	inode->i_atime_sec = atime / 1000000000;
-	inode->i_atime_nsec = atime % 1000000000;
+	// Already live in the inode cache; its attributes are immutable.
+	if (!(inode->i_state & I_NEW))
+		return inode;
 
-	mtime = get_unaligned_be64(data + 28);
-	inode->i_mtime_sec = mtime / 1000000000;
-	inode->i_mtime_nsec = mtime % 1000000000;
+	inode->i_mode = rec.mode;
+	inode->i_uid.val = rec.uid;
+	inode->i_gid.val = rec.gid;
 
-	ctime = get_unaligned_be64(data + 36);
-	inode->i_ctime_sec = ctime / 1000000000;
-	inode->i_ctime_nsec = ctime % 1000000000;
+	inode->i_atime_sec = rec.atime / 1000000000;
+	inode->i_atime_nsec = rec.atime % 1000000000;
+	inode->i_mtime_sec = rec.mtime / 1000000000;
+	inode->i_mtime_nsec = rec.mtime % 1000000000;
+	inode->i_ctime_sec = rec.ctime / 1000000000;
+	inode->i_ctime_nsec = rec.ctime % 1000000000;
 
-	inode->i_size = get_unaligned_be64(data + 44);
-	inode->i_ino = dir->i_ino + get_unaligned_be64(data + 84);
+	inode->i_size = rec.size;
+	info = inode->i_private;
+	info->inline_content = rec.inline_content;
 
 	if (S_ISDIR(inode->i_mode)) {
-		set_nlink(inode, get_unaligned_be64(data + 12));
+		set_nlink(inode, rec.nlink_dev);
 		inode->i_op = &hcasfs_dir_inode_ops;
 		inode->i_fop = &hcasfs_dir_ops;
 	} else {
-		inode->i_rdev = get_unaligned_be64(data + 12);
+		inode->i_rdev = rec.nlink_dev;
 		set_nlink(inode, 1);
-		if (S_ISREG(inode->i_mode)) {
+		if (S_ISREG(inode->i_mode) && rec.inline_content) {
+			// Served from the page cache, filled from the record.
+			inode->i_op = &hcasfs_none_inode_ops;
+			inode->i_fop = &hcasfs_inline_reg_ops;
+			inode->i_mapping->a_ops = &hcasfs_inline_aops;
+		} else if (S_ISREG(inode->i_mode)) {
 			inode->i_op = &hcasfs_none_inode_ops;
 			inode->i_fop = &hcasfs_reg_ops;
 		} else {
@@ -211,61 +215,54 @@ static struct inode *_lookup_at_position(struct inode *dir,
 		}
 	}
 
+	unlock_new_inode(inode);
 	return inode;
 }
 
-/* Lookup function - handles file/directory lookups */
-struct dentry *hcasfs_lookup(struct inode *dir, struct dentry *dentry,
-			     unsigned int flags)
+/* Binary search the on-disk hash index of dir for dentry, then scan
+ * neighbouring entries with the same hash. Fails with -EIO rather than scan
+ * more than HCASFS_DIR_MAX_HASH_RUN of them.
+ */
+static struct inode *_lookup_in_index(struct inode *dir,
+				      struct buffered_view *bv,
+				      struct hcasfs_inode_dir_info *dir_info,
+				      u64 base, u32 hash, struct dentry *dentry,
+				      unsigned int *probes)
 {
-	struct buffered_view *bv;
-	struct hcasfs_inode_dir_info *dir_info;
 	struct inode *inode = NULL;
 	char dir_index_data[8];
-
-	bv = hcasfs_inode_buffered_view(dir);
-	if (IS_ERR(bv))
-		return ERR_PTR(PTR_ERR(bv));
-
-	dir_info = hcasfs_inode_dir_info(dir);
-	if (IS_ERR(dir_info))
-		return ERR_PTR(PTR_ERR(dir_info));
-
-	u32 crc = ~crc32_le(~0, dentry->d_name.name, dentry->d_name.len);
+	char *data;
 
 	u32 lo = 0;
 	u32 hi = dir_info->entry_count;
-	u32 lo_crc = 0x00000000;
-	u32 hi_crc = 0xFFFFFFFF;
 	u32 ind = 0;
 	u32 record_position = 0;
+	u32 run = 0;
 
 	while (lo < hi) {
 		ind = lo + (hi - lo) / 2;
 
-		loff_t pos = 16 + 8 * ind;
-		char *data = buffered_view_read_full(
-			bv, dir_index_data, sizeof(dir_index_data), &pos);
+		loff_t pos = dir_info->index_offset + 8 * (loff_t)ind;
+
+		data = buffered_view_read_full(bv, dir_index_data,
+					       sizeof(dir_index_data), &pos);
+		if (IS_ERR(data))
+			return ERR_PTR(PTR_ERR(data));
 
-		u32 record_crc = get_unaligned_be32(data + 4);
+		u32 record_hash = get_unaligned_be32(data + 4);
 
-		if (record_crc < crc) {
+		if (record_hash < hash) {
 			lo = ind + 1;
-			lo_crc = record_crc;
-		} else if (record_crc > crc) {
+		} else if (record_hash > hash) {
 			hi = ind;
-			hi_crc = record_crc;
 		} else {
 			record_position = get_unaligned_be32(data + 0);
 			break;
 		}
 	}
 
-	if (lo == hi) {
-		/* Associate inode with dentry (NULL inode = file not found) */
-		d_add(dentry, inode);
+	if (lo == hi)
 		return NULL;
-	}
 
 	u32 ind_orig = ind;
 	u32 iter_dir = 0;
@@ -282,11 +279,14 @@ struct dentry *hcasfs_lookup(struct inode *dir, struct dentry *dentry,
 				break;
 			ind += iter_dir;
 
-			loff_t pos = 16 + 8 * ind;
-			char *data = buffered_view_read_full(
-				bv, dir_index_data, sizeof(dir_index_data),
-				&pos);
-			if (get_unaligned_be32(data + 4) != crc) {
+			loff_t pos = dir_info->index_offset + 8 * (loff_t)ind;
+
+			data = buffered_view_read_full(bv, dir_index_data,
+						       sizeof(dir_index_data),
+						       &pos);
+			if (IS_ERR(data))
+				return ERR_PTR(PTR_ERR(data));
+			if (get_unaligned_be32(data + 4) != hash) {
 				if (iter_dir == -1)
 					iter_dir = 1;
 				else
@@ -295,52 +295,407 @@ struct dentry *hcasfs_lookup(struct inode *dir, struct dentry *dentry,
 			record_position = get_unaligned_be32(data + 0);
 		}
 
-		inode = _lookup_at_position(dir, bv, record_position, dentry);
-		if (IS_ERR(inode))
-			return ERR_PTR(PTR_ERR(inode));
+		if (++run > HCASFS_DIR_MAX_HASH_RUN)
+			return ERR_PTR(-EIO);
+		inode = _lookup_at_position(dir, bv, dir_info, base,
+					    record_position, dentry, probes);
 		if (inode != NULL)
 			break;
 	}
+	return inode;
+}
+
+/* Search an index stored in Eytzinger order, see hcasfs/eytzinger.go. Slot k
+ * (counting from 1) has children 2k and 2k + 1 so the top of the tree shared
+ * by every search stays in the same few cache lines.
+ */
+static struct inode *_lookup_in_eytzinger(struct inode *dir,
+					  struct buffered_view *bv,
+					  struct hcasfs_inode_dir_info *dir_info,
+					  u64 base, u32 hash, struct dentry *dentry,
+					  unsigned int *probes)
+{
+	u32 count = dir_info->entry_count;
+	struct inode *inode = NULL;
+	char dir_index_data[8];
+	char *data;
+	loff_t pos;
+	u32 first = 0;
+	u32 run = 0;
+	u64 k;
+
+	// Descend to a leaf remembering the last slot not less than hash, the
+	// first entry that can match.
+	for (k = 1; k <= count;) {
+		pos = dir_info->index_offset + 8 * (loff_t)(k - 1);
+		data = buffered_view_read_full(bv, dir_index_data,
+					       sizeof(dir_index_data), &pos);
+		if (IS_ERR(data))
+			return ERR_PTR(PTR_ERR(data));
+
+		if (get_unaligned_be32(data + 4) < hash) {
+			k = 2 * k + 1;
+		} else {
+			first = k;
+			k = 2 * k;
+		}
+	}
 
-	/* Associate inode with dentry (NULL inode = file not found) */
-	d_add(dentry, inode);
+	// Visit entries with an equal hash in sorted order.
+	for (k = first; k && !inode;) {
+		pos = dir_info->index_offset + 8 * (loff_t)(k - 1);
+		data = buffered_view_read_full(bv, dir_index_data,
+					       sizeof(dir_index_data), &pos);
+		if (IS_ERR(data))
+			return ERR_PTR(PTR_ERR(data));
+		if (get_unaligned_be32(data + 4) != hash)
+			break;
+
+		if (++run > HCASFS_DIR_MAX_HASH_RUN)
+			return ERR_PTR(-EIO);
+		inode = _lookup_at_position(dir, bv, dir_info, base,
+					    get_unaligned_be32(data), dentry,
+					    probes);
+
+		if (2 * k + 1 <= count) {
+			k = 2 * k + 1;
+			while (2 * k <= count)
+				k = 2 * k;
+		} else {
+			while (k & 1)
+				k >>= 1;
+			k >>= 1;
+		}
+	}
+	return inode;
+}
+
+/* Hash a name the way the directory's index was built. The index holds the
+ * low 32 bits of the hash.
+ */
+static u64 _name_hash(struct hcasfs_inode_dir_info *dir_info,
+		      const struct qstr *name)
+{
+	if (dir_info->flags & HCASFS_DIR_FLAG_SALTED)
+		return siphash(name->name, name->len, &dir_info->salt);
+	return (u32)~crc32_le(~0, name->name, name->len);
+}
+
+/* The murmur3 64-bit finalizer. */
+static u64 _mix64(u64 h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* Check the Bloom filter of dir for a name hash, as hcasfs/bloom.go does.
+ * Returns 0 if no name with that hash is in the directory, 1 if one may be.
+ */
+static int _lookup_bloom(struct buffered_view *bv,
+			 struct hcasfs_inode_dir_info *dir_info, u32 hash)
+{
+	char bloom_data[8];
+	char *data;
+	u64 mask = 0;
+	u64 h = _mix64(hash);
+	loff_t pos;
+
+	// The upper half picks the word, the lower half the bits within it.
+	pos = dir_info->bloom_offset +
+	      8 * (loff_t)(((h >> 32) * dir_info->bloom_words) >> 32);
+	for (u32 i = 0; i < dir_info->bloom_hashes; i++)
+		mask |= 1ULL << ((h >> (6 * i)) & 63);
+
+	data = buffered_view_read_full(bv, bloom_data, sizeof(bloom_data),
+				       &pos);
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+	return (get_unaligned_be64(data) & mask) == mask;
+}
+
+/* Look up dentry in a directory indexed by a minimal perfect hash, see
+ * hcasfs/perfect_hash.go. The name can only be in the one slot its hash maps
+ * to.
+ */
+static struct inode *_lookup_perfect_hash(struct inode *dir,
+					  struct buffered_view *bv,
+					  struct hcasfs_inode_dir_info *dir_info,
+					  u64 base, u64 hash, struct dentry *dentry,
+					  unsigned int *probes)
+{
+	char buf[8];
+	char *data;
+	u64 pilot;
+	u32 bucket;
+	u32 slot;
+	loff_t pos;
+
+	if (!dir_info->entry_count)
+		return NULL;
+
+	bucket = ((hash >> 32) * dir_info->mph_buckets) >> 32;
+	pos = dir_info->mph_offset + 4 * (loff_t)bucket;
+	data = buffered_view_read_full(bv, buf, 4, &pos);
+	if (IS_ERR(data))
+		return ERR_PTR(PTR_ERR(data));
+	pilot = get_unaligned_be32(data);
+
+	slot = ((_mix64(hash ^ (pilot * 0x9e3779b97f4a7c15ULL)) >> 32) *
+		dir_info->entry_count) >> 32;
+	pos = dir_info->index_offset + 8 * (loff_t)slot;
+	data = buffered_view_read_full(bv, buf, 8, &pos);
+	if (IS_ERR(data))
+		return ERR_PTR(PTR_ERR(data));
+
+	// Names not in the directory still map to some slot.
+	if (get_unaligned_be32(data + 4) != (u32)hash)
+		return NULL;
+	return _lookup_at_position(dir, bv, dir_info, base,
+				   get_unaligned_be32(data + 0), dentry,
+				   probes);
+}
+
+/* Scan the records of a directory held in memory for dentry. Small directories
+ * only have a handful of entries so comparing names directly is cheaper than
+ * hashing the name and searching the index.
+ */
+static struct inode *_lookup_in_memory(struct inode *dir,
+				       struct buffered_view *bv,
+				       struct hcasfs_inode_dir_info *dir_info,
+				       u64 base, struct dentry *dentry,
+				       unsigned int *probes)
+{
+	char buf[HCASFS_RECORD_MAX];
+	struct hcasfs_record rec;
+	loff_t pos = dir_info->records_offset;
+	int result;
+
+	for (u32 i = 0; i < dir_info->entry_count; i++) {
+		loff_t record_pos = pos;
+
+		result = hcasfs_record_read(bv, dir_info, buf, &pos, &rec);
+		if (result)
+			return ERR_PTR(result);
+
+		if (rec.name_len == dentry->d_name.len &&
+		    !memcmp(rec.name, dentry->d_name.name, rec.name_len))
+			return _lookup_at_position(dir, bv, dir_info, base,
+						   record_pos, dentry, probes);
+	}
 	return NULL;
 }
 
-static const char *hcasfs_get_link(struct dentry *dentry, struct inode *inode,
-				   struct delayed_call *done)
+/* Look up dentry in the directory object obj, either dir's own object or a
+ * leaf of it if dir is sharded.
+ */
+static struct inode *_lookup_in_object(struct inode *dir,
+				       struct hcasfs_object *obj, u64 base,
+				       struct dentry *dentry,
+				       unsigned int *probes)
+{
+	struct hcasfs_stats *stats = hcasfs_sb_stats(dir->i_sb);
+	struct hcasfs_inode_dir_info *dir_info;
+	struct buffered_view bv;
+	struct inode *inode = NULL;
+	u32 positions[HCASFS_DIR_MAX_HASH_RUN];
+	int count;
+	int result;
+
+	dir_info = hcasfs_object_dir_info(obj, hcasfs_creds(dir->i_sb));
+	if (IS_ERR(dir_info))
+		return ERR_PTR(PTR_ERR(dir_info));
+
+	result = hcasfs_object_dir_view(dir->i_sb, obj, &bv);
+	if (result)
+		return ERR_PTR(result);
+
+	if (bv.mem) {
+		inode = _lookup_in_memory(dir, &bv, dir_info, base, dentry,
+					  probes);
+		goto out;
+	}
+
+	u64 name_hash = _name_hash(dir_info, &dentry->d_name);
+	u32 hash = name_hash;
+
+	// Hot directories get a decoded table that skips the index search.
+	count = hcasfs_dir_table_lookup(obj, hash, positions,
+					ARRAY_SIZE(positions));
+	if (count >= 0) {
+		for (int i = 0; i < count && !inode; i++)
+			inode = _lookup_at_position(dir, &bv, dir_info, base,
+						    positions[i], dentry,
+						    probes);
+		goto out;
+	}
+
+	// Most misses stop at the Bloom filter. They don't count towards
+	// building a table since they never search the index.
+	if (dir_info->flags & HCASFS_DIR_FLAG_BLOOM) {
+		result = _lookup_bloom(&bv, dir_info, hash);
+		if (result < 0) {
+			inode = ERR_PTR(result);
+			goto out;
+		}
+		if (!result) {
+			hcasfs_stats_inc(stats, HCASFS_STAT_BLOOM_REJECTS);
+			goto out;
+		}
+	}
+
+	// Perfect hash lookups are as direct as the table, never build one.
+	if (dir_info->flags & HCASFS_DIR_FLAG_PERFECT_HASH) {
+		inode = _lookup_perfect_hash(dir, &bv, dir_info, base,
+					     name_hash, dentry, probes);
+		goto out;
+	}
+
+	if (count == -ENOENT)
+		hcasfs_dir_table_note_lookup(obj, &bv, dir_info);
+
+	if (dir_info->flags & HCASFS_DIR_FLAG_EYTZINGER)
+		inode = _lookup_in_eytzinger(dir, &bv, dir_info, base, hash,
+					     dentry, probes);
+	else
+		inode = _lookup_in_index(dir, &bv, dir_info, base, hash,
+					 dentry, probes);
+
+out:
+	buffered_view_release(&bv);
+	return inode;
+}
+
+/* Find dentry in the records of dir, routing through the shards of sharded
+ * directories.
+ */
+static struct inode *_lookup_in_dir(struct inode *dir, struct dentry *dentry,
+				    unsigned int *probes)
+{
+	struct hcasfs_object *obj;
+	struct hcasfs_object *leaf = NULL;
+	struct hcasfs_inode_dir_info *dir_info;
+	struct inode *inode;
+	u64 base = 0;
+
+	obj = hcasfs_inode_object(dir);
+	if (IS_ERR(obj))
+		return ERR_PTR(PTR_ERR(obj));
+
+	dir_info = hcasfs_inode_dir_info(dir);
+	if (IS_ERR(dir_info))
+		return ERR_PTR(PTR_ERR(dir_info));
+
+	// Sharded directories hold no records, find the leaf for the name.
+	if (dir_info->flags & HCASFS_DIR_FLAG_SHARDED) {
+		leaf = hcasfs_shard_route(dir->i_sb, obj, &dentry->d_name,
+					  &base);
+		if (IS_ERR(leaf))
+			return ERR_PTR(PTR_ERR(leaf));
+		obj = leaf;
+	}
+
+	inode = _lookup_in_object(dir, obj, base, dentry, probes);
+	if (leaf)
+		hcasfs_object_put(leaf);
+	return inode;
+}
+
+/* Lookup function - handles file/directory lookups */
+struct dentry *hcasfs_lookup(struct inode *dir, struct dentry *dentry,
+			     unsigned int flags)
+{
+	struct hcasfs_stats *stats = hcasfs_sb_stats(dir->i_sb);
+	struct inode *inode = NULL;
+	u64 start = ktime_get_ns();
+	unsigned int probes = 0;
+
+	// Inline directories are empty and have no object to search.
+	if (!hcasfs_inode_is_inline(dir))
+		inode = _lookup_in_dir(dir, dentry, &probes);
+
+	trace_hcasfs_lookup(dir, dentry, inode, probes,
+			    ktime_get_ns() - start);
+	if (IS_ERR(inode))
+		return ERR_PTR(PTR_ERR(inode));
+
+	hcasfs_stats_inc(stats, HCASFS_STAT_LOOKUPS);
+	if (!inode)
+		hcasfs_stats_inc(stats, HCASFS_STAT_LOOKUPS_NEGATIVE);
+	hcasfs_stats_time(stats, HCASFS_HIST_LOOKUP, start);
+
+	/* Associate inode with dentry (NULL inode = file not found). Directory
+	 * inodes found in the inode cache may already have an alias.
+	 */
+	return d_splice_alias(inode, dentry);
+}
+
+/* Read the target of a symlink from its backing object. */
+static char *hcasfs_read_link(struct inode *inode)
 {
-	struct buffered_view *bv;
+	struct buffered_file *bf;
+	struct buffered_view bv;
 	char *link_data;
 	char *read_data;
 	loff_t pos;
 
-	if (WARN_ON(!S_ISLNK(inode->i_mode)))
-		return ERR_PTR(-EINVAL);
-	if (WARN_ON(inode->i_size > PATH_MAX))
-		return ERR_PTR(-EIO);
-
-	// TODO: Do I need to grab some sort of lock here?
-	if (inode->i_link)
-		return inode->i_link;
-
-	bv = hcasfs_inode_buffered_view(inode);
-	if (IS_ERR(bv))
-		return ERR_PTR(PTR_ERR(bv));
+	bf = hcasfs_inode_buffered_file(inode);
+	if (IS_ERR(bf))
+		return ERR_PTR(PTR_ERR(bf));
 
 	link_data = kmalloc(inode->i_size + 1, GFP_KERNEL);
+	if (!link_data)
+		return ERR_PTR(-ENOMEM);
 
+	buffered_view_init(&bv, bf);
+	bv.stats = hcasfs_sb_stats(inode->i_sb);
 	pos = 0;
-	read_data = buffered_view_read_full(bv, link_data, inode->i_size, &pos);
+	read_data = buffered_view_read_full(&bv, link_data, inode->i_size, &pos);
 	if (IS_ERR(read_data)) {
+		buffered_view_release(&bv);
 		kfree(link_data);
 		return read_data;
 	} else if (read_data != link_data) {
 		memcpy(link_data, read_data, inode->i_size);
 	}
+	buffered_view_release(&bv);
 	link_data[inode->i_size] = 0;
+	return link_data;
+}
+
+static const char *hcasfs_get_link(struct dentry *dentry, struct inode *inode,
+				   struct delayed_call *done)
+{
+	struct hcasfs_inode_info *info = inode->i_private;
+	char *link_data;
 
-	inode->i_link = link_data;
+	if (WARN_ON(!S_ISLNK(inode->i_mode)))
+		return ERR_PTR(-EINVAL);
+	if (WARN_ON(inode->i_size > PATH_MAX))
+		return ERR_PTR(-EIO);
+
+	if (READ_ONCE(inode->i_link))
+		return inode->i_link;
+
+	if (info->inline_content) {
+		// Short targets are stored in the record itself.
+		link_data = kmemdup_nul(info->name, inode->i_size, GFP_KERNEL);
+		if (!link_data)
+			return ERR_PTR(-ENOMEM);
+	} else {
+		link_data = hcasfs_read_link(inode);
+		if (IS_ERR(link_data))
+			return link_data;
+	}
+
+	// Concurrent readers of a shared inode may race to fill in the link.
+	if (cmpxchg(&inode->i_link, NULL, link_data) != NULL) {
+		kfree(link_data);
+		return inode->i_link;
+	}
 	return link_data;
 }
 
@@ -356,6 +711,8 @@ const struct inode_operations hcasfs_none_inode_ops = {};
 
 int hcasfs_inode_has_content(struct inode *inode)
 {
+	if (hcasfs_inode_is_inline(inode))
+		return 0;
 	return S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode) ||
 	       S_ISLNK(inode->i_mode);
 }
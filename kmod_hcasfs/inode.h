@@ -4,33 +4,49 @@
 #include <linux/types.h>
 
 #include "hcasfs.h"
+#include "object_cache.h"
 
-struct hcasfs_inode_dir_info {
-	int initialized;
-	u32 flags;
-	u32 entry_count;
-	u64 tree_size;
-};
+struct hcasfs_file_data;
 
 struct hcasfs_inode_info {
-	struct path path;
-	struct buffered_file *bf;
-	struct buffered_view *bv;
-	union {
-		struct hcasfs_inode_dir_info dir;
-		int unk;
-	};
+	/* Backing object name from the directory record. The object itself is
+	 * only resolved on first content access so that stat-only workloads
+	 * never touch the backing filesystem. Holds the content itself for
+	 * inline inodes.
+	 */
+	char name[HCASFS_OBJECT_NAME_LEN];
+	/* Content is stored inline in name, see record.h. Such inodes have no
+	 * backing object; inline directories are empty.
+	 */
+	bool inline_content;
+	/* Shared backing object, see object_cache.h. NULL until resolved. */
+	struct hcasfs_object *obj;
+	/* Backing file shared by open regular files, see file_reg.c. */
+	struct hcasfs_file_data *file_data;
 };
 
+struct hcasfs_object *hcasfs_inode_object(struct inode *inode);
 struct buffered_file *hcasfs_inode_buffered_file(struct inode *inode);
 struct hcasfs_inode_dir_info *hcasfs_inode_dir_info(struct inode *inode);
 
+/* Initialize a view over a directory's contents, backed by memory for small
+ * directories and by the backing file otherwise.
+ */
+int hcasfs_inode_dir_view(struct inode *inode, struct buffered_view *bv);
+
 struct dentry *hcasfs_lookup(struct inode *dir, struct dentry *dentry,
 			     unsigned int flags);
 void hcasfs_inode_evict(struct inode *inode);
 
 int hcasfs_inode_has_content(struct inode *inode);
 
+static inline bool hcasfs_inode_is_inline(struct inode *inode)
+{
+	struct hcasfs_inode_info *info = inode->i_private;
+
+	return info->inline_content;
+}
+
 extern const struct inode_operations hcasfs_dir_inode_ops;
 extern const struct inode_operations hcasfs_lnk_inode_ops;
 extern const struct inode_operations hcasfs_none_inode_ops;
@@ -5,8 +5,17 @@
  */
 
 #include "hcasfs.h"
+#include "dir_table.h"
+#include "object_cache.h"
+#include "prefetch.h"
+#include <linux/debugfs.h>
 #include <linux/init.h>
 
+#define CREATE_TRACE_POINTS
+#include "hcasfs_trace.h"
+
+struct dentry *hcasfs_debugfs_root;
+
 /* Forward declarations */
 static struct dentry *hcasfs_mount(struct file_system_type *fs_type, int flags,
 				   const char *dev_name, void *data);
@@ -78,21 +87,58 @@ static int __init hcasfs_init(void)
 	printk(KERN_INFO "hcasfs: Loading HCAS filesystem module v%s\n",
 	       HCASFS_VERSION);
 
+	hcasfs_debugfs_root = debugfs_create_dir(HCASFS_MODULE_NAME, NULL);
+
+	ret = hcasfs_dir_table_init();
+	if (ret) {
+		printk(KERN_ERR "hcasfs: Failed to set up lookup tables: %d\n",
+		       ret);
+		goto err_debugfs;
+	}
+
+	ret = hcasfs_object_cache_init();
+	if (ret) {
+		printk(KERN_ERR "hcasfs: Failed to create object cache: %d\n",
+		       ret);
+		goto err_dir_table;
+	}
+
+	ret = hcasfs_prefetch_init();
+	if (ret) {
+		printk(KERN_ERR "hcasfs: Failed to create prefetch workqueue: %d\n",
+		       ret);
+		goto err_object_cache;
+	}
+
 	ret = register_filesystem(&hcasfs_type);
 	if (ret) {
 		printk(KERN_ERR "hcasfs: Failed to register filesystem: %d\n",
 		       ret);
-		return ret;
+		goto err_prefetch;
 	}
 
 	printk(KERN_INFO "hcasfs: Filesystem registered successfully\n");
 	return 0;
+
+err_prefetch:
+	hcasfs_prefetch_exit();
+err_object_cache:
+	hcasfs_object_cache_exit();
+err_dir_table:
+	hcasfs_dir_table_exit();
+err_debugfs:
+	debugfs_remove_recursive(hcasfs_debugfs_root);
+	return ret;
 }
 
 static void __exit hcasfs_exit(void)
 {
 	printk(KERN_INFO "hcasfs: Unloading HCAS filesystem module\n");
 	unregister_filesystem(&hcasfs_type);
+	hcasfs_prefetch_exit();
+	hcasfs_object_cache_exit();
+	hcasfs_dir_table_exit();
+	debugfs_remove_recursive(hcasfs_debugfs_root);
 	printk(KERN_INFO "hcasfs: Filesystem unregistered\n");
 }
 
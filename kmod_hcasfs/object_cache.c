@@ -0,0 +1,442 @@
+/*
+ * HCAS Filesystem - Object Cache
+ *
+ * Module wide cache of resolved backing objects keyed by object name, shared
+ * between all inodes and mounts that reference the same content.
+ */
+
+#include "hcasfs.h"
+#include "dir_table.h"
+#include "object_cache.h"
+
+#include <linux/cred.h>
+#include <linux/debugfs.h>
+#include <linux/rhashtable.h>
+#include <linux/seq_file.h>
+#include <linux/shrinker.h>
+
+static const struct rhashtable_params hcasfs_object_params = {
+	.key_len = sizeof(struct hcasfs_object_key),
+	.key_offset = offsetof(struct hcasfs_object, key),
+	.head_offset = offsetof(struct hcasfs_object, node),
+	.automatic_shrinking = true,
+};
+
+static struct rhashtable hcasfs_objects;
+
+/* Protects object user counts and the LRU of unused objects. */
+static DEFINE_SPINLOCK(hcasfs_object_lock);
+static LIST_HEAD(hcasfs_object_lru);
+static unsigned long hcasfs_object_unused;
+
+static struct shrinker *hcasfs_object_shrinker;
+
+static atomic_long_t hcasfs_object_hits = ATOMIC_LONG_INIT(0);
+static atomic_long_t hcasfs_object_misses = ATOMIC_LONG_INIT(0);
+static atomic_long_t hcasfs_object_reclaimed = ATOMIC_LONG_INIT(0);
+
+static void hcasfs_object_free(struct hcasfs_object *obj)
+{
+	hcasfs_dir_table_drop(obj);
+	kfree(obj->small_dir);
+	if (obj->bf)
+		buffered_close(obj->bf);
+	path_put(&obj->path);
+	put_cred(obj->key.cred);
+	kfree(obj);
+}
+
+/* Take a user reference on obj. Called with hcasfs_object_lock held. */
+static void hcasfs_object_grab(struct hcasfs_object *obj)
+{
+	if (obj->users++ == 0) {
+		list_del_init(&obj->lru);
+		hcasfs_object_unused--;
+	}
+}
+
+struct hcasfs_object *hcasfs_object_get(struct super_block *sb,
+					char name[HCASFS_OBJECT_NAME_LEN])
+{
+	struct hcasfs_object_key key;
+	struct hcasfs_object *obj;
+	struct hcasfs_object *existing;
+	int result;
+
+	memset(&key, 0, sizeof(key));
+	key.data_dir = hcasfs_data_dir(sb)->dentry;
+	key.cred = hcasfs_creds(sb);
+	memcpy(key.name, name, HCASFS_OBJECT_NAME_LEN);
+
+	spin_lock(&hcasfs_object_lock);
+	obj = rhashtable_lookup_fast(&hcasfs_objects, &key,
+				     hcasfs_object_params);
+	if (obj) {
+		hcasfs_object_grab(obj);
+		spin_unlock(&hcasfs_object_lock);
+		atomic_long_inc(&hcasfs_object_hits);
+		return obj;
+	}
+	spin_unlock(&hcasfs_object_lock);
+	atomic_long_inc(&hcasfs_object_misses);
+
+	obj = kzalloc(sizeof(*obj), GFP_KERNEL);
+	if (!obj)
+		return ERR_PTR(-ENOMEM);
+	obj->key = key;
+	obj->users = 1;
+	INIT_LIST_HEAD(&obj->lru);
+	INIT_LIST_HEAD(&obj->table_lru);
+
+	result = hcasfs_lookup_object(sb, name, &obj->path);
+	if (result) {
+		kfree(obj);
+		return ERR_PTR(result);
+	}
+	// Hold the credentials so their address can't be reused by another
+	// mounter while this object is cached.
+	get_cred(obj->key.cred);
+
+	spin_lock(&hcasfs_object_lock);
+	existing = rhashtable_lookup_get_insert_fast(
+		&hcasfs_objects, &obj->node, hcasfs_object_params);
+	if (existing && !IS_ERR(existing))
+		hcasfs_object_grab(existing);
+	spin_unlock(&hcasfs_object_lock);
+
+	// Either insertion failed or we lost a race with another resolver of
+	// the same object.
+	if (existing) {
+		hcasfs_object_free(obj);
+		return existing;
+	}
+	return obj;
+}
+
+void hcasfs_object_put(struct hcasfs_object *obj)
+{
+	spin_lock(&hcasfs_object_lock);
+	if (WARN_ON(obj->users == 0)) {
+		spin_unlock(&hcasfs_object_lock);
+		return;
+	}
+	if (--obj->users == 0) {
+		list_add_tail(&obj->lru, &hcasfs_object_lru);
+		hcasfs_object_unused++;
+	}
+	spin_unlock(&hcasfs_object_lock);
+}
+
+struct buffered_file *hcasfs_object_buffered_file(struct hcasfs_object *obj,
+						  const struct cred *cred)
+{
+	struct buffered_file *result;
+	struct file *file;
+
+	if (!obj->bf) {
+		file = dentry_open(&obj->path, O_RDONLY, cred);
+		if (IS_ERR(file))
+			return ERR_PTR(PTR_ERR(file));
+
+		result = buffered_open(file);
+		fput(file);
+		if (!result)
+			return ERR_PTR(-ENOMEM);
+
+		// Users of a shared object can race to open the backing file.
+		if (cmpxchg(&obj->bf, NULL, result) != NULL)
+			buffered_close(result);
+	}
+	return obj->bf;
+}
+
+/* Parse the extended header that follows the base header of a directory with
+ * flags set. buf must have room for HCASFS_DIR_EXT_HEADER_MAX bytes.
+ */
+static int hcasfs_object_dir_info_ext(struct hcasfs_inode_dir_info *dinfo,
+				      struct buffered_view *bv, char *buf,
+				      loff_t *pos)
+{
+	size_t len = 8;
+	char *data;
+
+	if (dinfo->flags & ~HCASFS_DIR_FLAGS_SUPPORTED)
+		return -EIO;
+	if ((dinfo->flags & HCASFS_DIR_FLAG_PERFECT_HASH) &&
+	    (dinfo->flags & HCASFS_DIR_FLAG_EYTZINGER))
+		return -EIO;
+	if ((dinfo->flags & HCASFS_DIR_FLAG_SHARDED) &&
+	    dinfo->flags != (HCASFS_DIR_FLAG_SALTED | HCASFS_DIR_FLAG_SHARDED))
+		return -EIO;
+	if (dinfo->flags & HCASFS_DIR_FLAG_BLOOM)
+		len += 16;
+	if (dinfo->flags & HCASFS_DIR_FLAG_SALTED)
+		len += 16;
+	if (dinfo->flags & HCASFS_DIR_FLAG_PERFECT_HASH)
+		len += 8;
+	if (dinfo->flags & HCASFS_DIR_FLAG_SHARDED)
+		len += 8;
+	if (dinfo->flags & HCASFS_DIR_FLAG_COMPACT_RECORDS)
+		len += 8;
+
+	data = buffered_view_read_full(bv, buf, len, pos);
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+
+	dinfo->index_offset = get_unaligned_be32(data + 0);
+	dinfo->records_offset = get_unaligned_be32(data + 4);
+	data += 8;
+	if (dinfo->flags & HCASFS_DIR_FLAG_BLOOM) {
+		dinfo->bloom_offset = get_unaligned_be32(data + 0);
+		dinfo->bloom_words = get_unaligned_be32(data + 4);
+		dinfo->bloom_hashes = get_unaligned_be32(data + 8);
+		if (!dinfo->bloom_words ||
+		    dinfo->bloom_hashes > HCASFS_DIR_BLOOM_MAX_HASHES)
+			return -EIO;
+		data += 16;
+	}
+	if (dinfo->flags & HCASFS_DIR_FLAG_SALTED) {
+		dinfo->salt.key[0] = get_unaligned_be64(data + 0);
+		dinfo->salt.key[1] = get_unaligned_be64(data + 8);
+		data += 16;
+	}
+	if (dinfo->flags & HCASFS_DIR_FLAG_PERFECT_HASH) {
+		dinfo->mph_offset = get_unaligned_be32(data + 0);
+		dinfo->mph_buckets = get_unaligned_be32(data + 4);
+		if (!(dinfo->flags & HCASFS_DIR_FLAG_SALTED) ||
+		    (!dinfo->mph_buckets && dinfo->entry_count))
+			return -EIO;
+		data += 8;
+	}
+	if (dinfo->flags & HCASFS_DIR_FLAG_SHARDED) {
+		dinfo->shards_offset = get_unaligned_be32(data + 0);
+		dinfo->shard_count = get_unaligned_be32(data + 4);
+		if (!dinfo->shard_count)
+			return -EIO;
+		data += 8;
+	}
+	if (dinfo->flags & HCASFS_DIR_FLAG_COMPACT_RECORDS)
+		dinfo->time_base = get_unaligned_be64(data + 0);
+	return 0;
+}
+
+struct hcasfs_inode_dir_info *
+hcasfs_object_dir_info(struct hcasfs_object *obj, const struct cred *cred)
+{
+	struct hcasfs_inode_dir_info parsed = {};
+	struct hcasfs_inode_dir_info *dinfo = &parsed;
+	struct buffered_file *bf;
+	struct buffered_view bv;
+	char *data;
+	char buf[HCASFS_DIR_EXT_HEADER_MAX];
+	loff_t pos;
+	int result = 0;
+
+	if (smp_load_acquire(&obj->dir.initialized))
+		return &obj->dir;
+
+	bf = hcasfs_object_buffered_file(obj, cred);
+	if (IS_ERR(bf))
+		return ERR_PTR(PTR_ERR(bf));
+
+	buffered_view_init(&bv, bf);
+	pos = 0;
+	data = buffered_view_read_full(&bv, buf, 16, &pos);
+	if (IS_ERR(data)) {
+		buffered_view_release(&bv);
+		return ERR_PTR(PTR_ERR(data));
+	}
+
+	dinfo->flags = get_unaligned_be32(data + 0);
+	dinfo->entry_count = get_unaligned_be32(data + 4);
+	dinfo->tree_size = get_unaligned_be64(data + 8);
+	dinfo->index_offset = 16;
+	dinfo->records_offset = 16 + 8 * dinfo->entry_count;
+	if (dinfo->flags)
+		result = hcasfs_object_dir_info_ext(dinfo, &bv, buf, &pos);
+	buffered_view_release(&bv);
+	if (result)
+		return ERR_PTR(result);
+
+	// Racing parsers of a shared object each parse into their own copy and
+	// the first to finish publishes it. Readers never see a partial header.
+	spin_lock(&hcasfs_object_lock);
+	if (!obj->dir.initialized) {
+		obj->dir = parsed;
+		smp_store_release(&obj->dir.initialized, true);
+	}
+	spin_unlock(&hcasfs_object_lock);
+	return &obj->dir;
+}
+
+struct hcasfs_small_dir *hcasfs_object_small_dir(struct hcasfs_object *obj,
+						 const struct cred *cred)
+{
+	struct hcasfs_small_dir *small_dir;
+	struct buffered_file *bf;
+	struct buffered_view bv;
+	loff_t size;
+	loff_t pos;
+	char *data;
+
+	small_dir = smp_load_acquire(&obj->small_dir);
+	if (small_dir)
+		return small_dir;
+
+	size = i_size_read(d_inode(obj->path.dentry));
+	if (size > PAGE_SIZE)
+		return NULL;
+
+	bf = hcasfs_object_buffered_file(obj, cred);
+	if (IS_ERR(bf))
+		return ERR_PTR(PTR_ERR(bf));
+
+	small_dir = kmalloc(struct_size(small_dir, data, size), GFP_KERNEL);
+	if (!small_dir)
+		return ERR_PTR(-ENOMEM);
+	small_dir->size = size;
+
+	buffered_view_init(&bv, bf);
+	pos = 0;
+	data = buffered_view_read_full(&bv, small_dir->data, size, &pos);
+	if (IS_ERR(data)) {
+		buffered_view_release(&bv);
+		kfree(small_dir);
+		return ERR_PTR(PTR_ERR(data));
+	}
+	if (data != small_dir->data)
+		memcpy(small_dir->data, data, size);
+	buffered_view_release(&bv);
+
+	// Users of a shared object can race to load the directory.
+	if (cmpxchg(&obj->small_dir, NULL, small_dir) != NULL) {
+		kfree(small_dir);
+		small_dir = obj->small_dir;
+	}
+	return small_dir;
+}
+
+int hcasfs_object_dir_view(struct super_block *sb, struct hcasfs_object *obj,
+			   struct buffered_view *bv)
+{
+	const struct cred *cred = hcasfs_creds(sb);
+	struct hcasfs_small_dir *small_dir;
+	struct buffered_file *bf;
+
+	small_dir = hcasfs_object_small_dir(obj, cred);
+	if (IS_ERR(small_dir))
+		return PTR_ERR(small_dir);
+	if (small_dir) {
+		buffered_view_init_mem(bv, small_dir->data, small_dir->size);
+		return 0;
+	}
+
+	bf = hcasfs_object_buffered_file(obj, cred);
+	if (IS_ERR(bf))
+		return PTR_ERR(bf);
+	buffered_view_init(bv, bf);
+	bv->stats = hcasfs_sb_stats(sb);
+	return 0;
+}
+
+/* Remove up to nr unused objects from the cache. If data_dir is set only
+ * objects from that data directory are considered.
+ */
+static unsigned long hcasfs_object_reclaim(unsigned long nr,
+					   struct dentry *data_dir)
+{
+	struct hcasfs_object *obj, *next;
+	unsigned long freed = 0;
+	LIST_HEAD(dispose);
+
+	spin_lock(&hcasfs_object_lock);
+	list_for_each_entry_safe(obj, next, &hcasfs_object_lru, lru) {
+		if (freed >= nr)
+			break;
+		if (data_dir && obj->key.data_dir != data_dir)
+			continue;
+
+		rhashtable_remove_fast(&hcasfs_objects, &obj->node,
+				       hcasfs_object_params);
+		list_move(&obj->lru, &dispose);
+		hcasfs_object_unused--;
+		freed++;
+	}
+	spin_unlock(&hcasfs_object_lock);
+
+	list_for_each_entry_safe(obj, next, &dispose, lru)
+		hcasfs_object_free(obj);
+
+	atomic_long_add(freed, &hcasfs_object_reclaimed);
+	return freed;
+}
+
+void hcasfs_object_cache_prune(struct dentry *data_dir)
+{
+	hcasfs_object_reclaim(ULONG_MAX, data_dir);
+}
+
+static unsigned long hcasfs_object_count(struct shrinker *shrink,
+					 struct shrink_control *sc)
+{
+	unsigned long count = READ_ONCE(hcasfs_object_unused);
+
+	return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long hcasfs_object_scan(struct shrinker *shrink,
+					struct shrink_control *sc)
+{
+	// Freeing objects drops dentry and file references.
+	if (!(sc->gfp_mask & __GFP_FS))
+		return SHRINK_STOP;
+	return hcasfs_object_reclaim(sc->nr_to_scan, NULL);
+}
+
+static int hcasfs_object_cache_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "entries: %u\n",
+		   atomic_read(&hcasfs_objects.nelems));
+	seq_printf(m, "unused: %lu\n", READ_ONCE(hcasfs_object_unused));
+	seq_printf(m, "hits: %ld\n", atomic_long_read(&hcasfs_object_hits));
+	seq_printf(m, "misses: %ld\n",
+		   atomic_long_read(&hcasfs_object_misses));
+	seq_printf(m, "reclaimed: %ld\n",
+		   atomic_long_read(&hcasfs_object_reclaimed));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hcasfs_object_cache);
+
+static void hcasfs_object_free_fn(void *ptr, void *arg)
+{
+	hcasfs_object_free(ptr);
+}
+
+int hcasfs_object_cache_init(void)
+{
+	int ret;
+
+	ret = rhashtable_init(&hcasfs_objects, &hcasfs_object_params);
+	if (ret)
+		return ret;
+
+	hcasfs_object_shrinker = shrinker_alloc(0, "hcasfs-object");
+	if (!hcasfs_object_shrinker) {
+		rhashtable_destroy(&hcasfs_objects);
+		return -ENOMEM;
+	}
+	hcasfs_object_shrinker->count_objects = hcasfs_object_count;
+	hcasfs_object_shrinker->scan_objects = hcasfs_object_scan;
+	shrinker_register(hcasfs_object_shrinker);
+
+	debugfs_create_file("object_cache", 0444, hcasfs_debugfs_root, NULL,
+			    &hcasfs_object_cache_fops);
+	return 0;
+}
+
+void hcasfs_object_cache_exit(void)
+{
+	shrinker_free(hcasfs_object_shrinker);
+	rhashtable_free_and_destroy(&hcasfs_objects, hcasfs_object_free_fn,
+				    NULL);
+}
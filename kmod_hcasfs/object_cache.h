@@ -0,0 +1,145 @@
+#ifndef _OBJECT_CACHE_H
+#define _OBJECT_CACHE_H
+
+#include <linux/rhashtable-types.h>
+#include <linux/siphash.h>
+#include <linux/types.h>
+
+#include "hcasfs.h"
+
+/* Directory object flags, see hcasfs/dir_header.go for the layout. Any set
+ * flag means an extended header follows the base 16 byte header.
+ */
+#define HCASFS_DIR_FLAG_BLOOM (1U << 0)
+#define HCASFS_DIR_FLAG_SALTED (1U << 1)
+#define HCASFS_DIR_FLAG_PERFECT_HASH (1U << 2)
+#define HCASFS_DIR_FLAG_EYTZINGER (1U << 3)
+#define HCASFS_DIR_FLAG_SHARDED (1U << 4)
+#define HCASFS_DIR_FLAG_COMPACT_RECORDS (1U << 5)
+#define HCASFS_DIR_FLAGS_SUPPORTED                                \
+	(HCASFS_DIR_FLAG_BLOOM | HCASFS_DIR_FLAG_SALTED |        \
+	 HCASFS_DIR_FLAG_PERFECT_HASH | HCASFS_DIR_FLAG_EYTZINGER | \
+	 HCASFS_DIR_FLAG_SHARDED | HCASFS_DIR_FLAG_COMPACT_RECORDS)
+
+/* Largest extended header of the supported flags */
+#define HCASFS_DIR_EXT_HEADER_MAX 56
+
+#define HCASFS_DIR_BLOOM_MAX_HASHES 5
+
+/* Directories with more index entries sharing one name hash than this are
+ * rejected as corrupt rather than scanned record by record. The builder never
+ * writes such a directory.
+ */
+#define HCASFS_DIR_MAX_HASH_RUN 8
+
+struct hcasfs_inode_dir_info {
+	int initialized;
+	u32 flags;
+	u32 entry_count;
+	u64 tree_size;
+	u32 index_offset;
+	u32 records_offset;
+
+	/* Valid if HCASFS_DIR_FLAG_BLOOM is set */
+	u32 bloom_offset;
+	u32 bloom_words;
+	u32 bloom_hashes;
+
+	/* Valid if HCASFS_DIR_FLAG_SALTED is set. Names are indexed by the low 32
+	 * bits of their SipHash-2-4 under this key instead of their CRC32.
+	 */
+	siphash_key_t salt;
+
+	/* Valid if HCASFS_DIR_FLAG_PERFECT_HASH is set. The index is in slot
+	 * order of a minimal perfect hash with a u32 pilot per bucket.
+	 */
+	u32 mph_offset;
+	u32 mph_buckets;
+
+	/* Valid if HCASFS_DIR_FLAG_SHARDED is set. The directory holds no
+	 * records, only references to child objects; see shard.h.
+	 */
+	u32 shards_offset;
+	u32 shard_count;
+
+	/* Valid if HCASFS_DIR_FLAG_COMPACT_RECORDS is set. Record modification
+	 * times are stored relative to this, see record.h.
+	 */
+	u64 time_base;
+};
+
+/* Directory objects no larger than a page are copied into memory in full on
+ * first use; lookups scan them directly instead of searching the index.
+ */
+struct hcasfs_small_dir {
+	loff_t size;
+	char data[];
+};
+
+/* Objects are content addressed so two inodes (in the same or different
+ * mounts) that reference the same object name in the same HCAS data directory
+ * can share the resolved backing path, the opened backing file and the parsed
+ * directory header. The backing file is opened with the mounter's credentials
+ * so only mounts made with the same credentials share an object.
+ */
+struct hcasfs_object_key {
+	struct dentry *data_dir;
+	const struct cred *cred;
+	char name[HCASFS_OBJECT_NAME_LEN];
+};
+
+struct hcasfs_object {
+	struct rhash_head node;
+	struct hcasfs_object_key key;
+
+	/* Protected by the cache lock. Objects with no users sit on the LRU and
+	 * may be reclaimed by the shrinker.
+	 */
+	unsigned int users;
+	struct list_head lru;
+
+	struct path path;
+	struct buffered_file *bf;
+	struct hcasfs_inode_dir_info dir;
+	struct hcasfs_small_dir *small_dir;
+
+	/* Decoded lookup table, see dir_table.h */
+	struct hcasfs_dir_table __rcu *table;
+	atomic_t lookups;
+	struct list_head table_lru;
+};
+
+/* Find or resolve the object with the given name, taking a user reference. */
+struct hcasfs_object *hcasfs_object_get(struct super_block *sb,
+					char name[HCASFS_OBJECT_NAME_LEN]);
+void hcasfs_object_put(struct hcasfs_object *obj);
+
+/* Lazily open the backing file of an object, shared by all of its users. */
+struct buffered_file *hcasfs_object_buffered_file(struct hcasfs_object *obj,
+						  const struct cred *cred);
+
+/* Lazily parse the directory header of an object. The header is published
+ * once fully parsed and never changes after that.
+ */
+struct hcasfs_inode_dir_info *
+hcasfs_object_dir_info(struct hcasfs_object *obj, const struct cred *cred);
+
+/* Lazily load the full contents of a small directory object. Returns NULL if
+ * the object is too large to be held in memory.
+ */
+struct hcasfs_small_dir *hcasfs_object_small_dir(struct hcasfs_object *obj,
+						 const struct cred *cred);
+
+/* Initialize a view over a directory object's contents, backed by memory for
+ * small directories and by the backing file otherwise.
+ */
+int hcasfs_object_dir_view(struct super_block *sb, struct hcasfs_object *obj,
+			   struct buffered_view *bv);
+
+/* Drop all unused cache entries that belong to the passed data directory. */
+void hcasfs_object_cache_prune(struct dentry *data_dir);
+
+int hcasfs_object_cache_init(void);
+void hcasfs_object_cache_exit(void);
+
+#endif
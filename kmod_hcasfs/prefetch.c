@@ -0,0 +1,469 @@
+/*
+ * HCAS Filesystem - Tree Prefetch
+ *
+ * Background walk of a mount's directory objects to warm the page cache and
+ * object cache ahead of the first lookups.
+ */
+
+#include "hcasfs.h"
+#include "object_cache.h"
+#include "prefetch.h"
+#include "record.h"
+#include "shard.h"
+
+#include <linux/debugfs.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+
+static struct workqueue_struct *hcasfs_prefetch_wq;
+
+enum hcasfs_prefetch_kind {
+	/* Directory object whose subdirectories are walked. */
+	HCASFS_PREFETCH_DIR,
+	/* Any object, only read ahead. */
+	HCASFS_PREFETCH_OBJECT,
+	/* Trace object whose listed objects are queued in order. */
+	HCASFS_PREFETCH_TRACE,
+};
+
+struct hcasfs_prefetch_item {
+	/* Entry in the seen table until the walk finishes. */
+	struct hlist_node node;
+	/* Entry in the queue until picked up by a worker. */
+	struct list_head list;
+	enum hcasfs_prefetch_kind kind;
+	unsigned int depth;
+	char name[HCASFS_OBJECT_NAME_LEN];
+};
+
+struct hcasfs_prefetch_worker {
+	struct work_struct work;
+	struct hcasfs_prefetch *pf;
+};
+
+struct hcasfs_prefetch {
+	struct super_block *sb;
+	struct hcasfs_prefetch_opts opts;
+	struct dentry *debugfs;
+
+	/* Protects everything below up to the counters. */
+	spinlock_t lock;
+	struct list_head queue;
+	/* Objects already queued; trees share subdirectories. */
+	DECLARE_HASHTABLE(seen, 10);
+	unsigned int active;
+	bool stopping;
+	ktime_t start;
+	ktime_t end;
+
+	atomic_long_t dirs_queued;
+	atomic_long_t dirs_done;
+	atomic_long_t files;
+	atomic_long_t traced;
+	atomic_long_t errors;
+
+	struct hcasfs_prefetch_worker workers[];
+};
+
+static u32 hcasfs_prefetch_hash(const char *name)
+{
+	return jhash(name, HCASFS_OBJECT_NAME_LEN, 0);
+}
+
+/* Queue the object name unless it has been seen before with the same kind. */
+static void hcasfs_prefetch_queue(struct hcasfs_prefetch *pf,
+				  enum hcasfs_prefetch_kind kind,
+				  const char *name, unsigned int depth)
+{
+	struct hcasfs_prefetch_item *item;
+	struct hcasfs_prefetch_item *existing;
+	u32 hash = hcasfs_prefetch_hash(name);
+
+	item = kmalloc(sizeof(*item), GFP_KERNEL);
+	if (!item) {
+		atomic_long_inc(&pf->errors);
+		return;
+	}
+	item->kind = kind;
+	item->depth = depth;
+	memcpy(item->name, name, HCASFS_OBJECT_NAME_LEN);
+
+	spin_lock(&pf->lock);
+	hash_for_each_possible(pf->seen, existing, node, hash) {
+		if (existing->kind == kind &&
+		    !memcmp(existing->name, name, HCASFS_OBJECT_NAME_LEN)) {
+			spin_unlock(&pf->lock);
+			kfree(item);
+			return;
+		}
+	}
+	if (pf->stopping) {
+		spin_unlock(&pf->lock);
+		kfree(item);
+		return;
+	}
+	hash_add(pf->seen, &item->node, hash);
+	list_add_tail(&item->list, &pf->queue);
+	if (kind == HCASFS_PREFETCH_DIR)
+		atomic_long_inc(&pf->dirs_queued);
+
+	// Kick idle workers under the lock so none are requeued after stop.
+	for (int i = 0; i < pf->opts.workers; i++)
+		queue_work(hcasfs_prefetch_wq, &pf->workers[i].work);
+	spin_unlock(&pf->lock);
+}
+
+/* Free the seen table. Called with no items left queued or being read. */
+static void hcasfs_prefetch_forget(struct hcasfs_prefetch *pf)
+{
+	struct hcasfs_prefetch_item *item;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe(pf->seen, bkt, tmp, item, node) {
+		hash_del(&item->node);
+		kfree(item);
+	}
+}
+
+/* Read the whole backing file into the page cache one window at a time. */
+static void hcasfs_prefetch_readahead(struct hcasfs_prefetch *pf,
+				      struct buffered_file *bf)
+{
+	loff_t pos = 0;
+	loff_t len;
+
+	while (!READ_ONCE(pf->stopping)) {
+		len = buffered_readahead(bf, pos, pf->opts.window);
+		if (!len)
+			break;
+		pos += len;
+	}
+}
+
+/* Resolve an object into the object cache and read ahead its contents. */
+static int hcasfs_prefetch_object(struct hcasfs_prefetch *pf, char *name)
+{
+	const struct cred *cred = hcasfs_creds(pf->sb);
+	struct hcasfs_object *obj;
+	struct buffered_file *bf;
+	struct file *file;
+	int result = 0;
+
+	obj = hcasfs_object_get(pf->sb, name);
+	if (IS_ERR(obj))
+		return PTR_ERR(obj);
+
+	// Read through a private backing file so the object cache doesn't keep
+	// one open for every prefetched object.
+	file = dentry_open(&obj->path, O_RDONLY, cred);
+	if (IS_ERR(file)) {
+		result = PTR_ERR(file);
+		goto out_put;
+	}
+	bf = buffered_open(file);
+	fput(file);
+	if (!bf) {
+		result = -ENOMEM;
+		goto out_put;
+	}
+
+	hcasfs_prefetch_readahead(pf, bf);
+	buffered_close(bf);
+
+out_put:
+	hcasfs_object_put(obj);
+	return result;
+}
+
+/* Queue each object listed in a trace object, in trace order. */
+static int hcasfs_prefetch_trace(struct hcasfs_prefetch *pf,
+				 struct hcasfs_prefetch_item *item)
+{
+	const struct cred *cred = hcasfs_creds(pf->sb);
+	struct hcasfs_object *obj;
+	struct buffered_file *bf;
+	struct buffered_view bv;
+	char buf[HCASFS_OBJECT_NAME_LEN];
+	char *data;
+	loff_t pos = 0;
+	int result = 0;
+
+	obj = hcasfs_object_get(pf->sb, item->name);
+	if (IS_ERR(obj))
+		return PTR_ERR(obj);
+
+	bf = hcasfs_object_buffered_file(obj, cred);
+	if (IS_ERR(bf)) {
+		hcasfs_object_put(obj);
+		return PTR_ERR(bf);
+	}
+
+	buffered_view_init(&bv, bf);
+	while (pos + HCASFS_OBJECT_NAME_LEN <= bv.f_size) {
+		if (READ_ONCE(pf->stopping))
+			break;
+
+		data = buffered_view_read_full(&bv, buf, sizeof(buf), &pos);
+		if (IS_ERR(data)) {
+			result = PTR_ERR(data);
+			break;
+		}
+		hcasfs_prefetch_queue(pf, HCASFS_PREFETCH_OBJECT, data, 0);
+	}
+	buffered_view_release(&bv);
+	hcasfs_object_put(obj);
+	return result;
+}
+
+/* Queue the children of a sharded directory node at the node's depth; they
+ * are part of the same directory.
+ */
+static int hcasfs_prefetch_shards(struct hcasfs_prefetch *pf,
+				  struct hcasfs_prefetch_item *item,
+				  struct buffered_view *bv,
+				  struct hcasfs_inode_dir_info *dir_info)
+{
+	struct hcasfs_shard shard;
+	int result;
+
+	for (u32 i = 0; i < dir_info->shard_count; i++) {
+		if (READ_ONCE(pf->stopping))
+			break;
+
+		result = hcasfs_shard_read(bv, dir_info, i, &shard);
+		if (result)
+			return result;
+		hcasfs_prefetch_queue(pf, HCASFS_PREFETCH_DIR, shard.name,
+				      item->depth);
+	}
+	return 0;
+}
+
+/* Read the records of a directory object, queueing its subdirectories and
+ * reading ahead small regular files.
+ */
+static int hcasfs_prefetch_dir(struct hcasfs_prefetch *pf,
+			       struct hcasfs_prefetch_item *item)
+{
+	const struct cred *cred = hcasfs_creds(pf->sb);
+	struct hcasfs_inode_dir_info *dir_info;
+	struct hcasfs_object *obj;
+	struct buffered_file *bf;
+	struct buffered_view bv;
+	struct hcasfs_record rec;
+	char buf[HCASFS_RECORD_MAX];
+	loff_t pos;
+	int result = 0;
+
+	obj = hcasfs_object_get(pf->sb, item->name);
+	if (IS_ERR(obj))
+		return PTR_ERR(obj);
+
+	bf = hcasfs_object_buffered_file(obj, cred);
+	if (IS_ERR(bf)) {
+		result = PTR_ERR(bf);
+		goto out_put;
+	}
+
+	// Read the whole object before walking it record by record.
+	hcasfs_prefetch_readahead(pf, bf);
+
+	dir_info = hcasfs_object_dir_info(obj, cred);
+	if (IS_ERR(dir_info)) {
+		result = PTR_ERR(dir_info);
+		goto out_put;
+	}
+
+	buffered_view_init(&bv, bf);
+	if (dir_info->flags & HCASFS_DIR_FLAG_SHARDED) {
+		result = hcasfs_prefetch_shards(pf, item, &bv, dir_info);
+		buffered_view_release(&bv);
+		goto out_put;
+	}
+
+	pos = dir_info->records_offset;
+	for (u32 i = 0; i < dir_info->entry_count; i++) {
+		if (READ_ONCE(pf->stopping))
+			break;
+
+		result = hcasfs_record_read(&bv, dir_info, buf, &pos, &rec);
+		if (result)
+			break;
+
+		// Inline records have no objects to read.
+		if (rec.inline_content)
+			continue;
+
+		if (S_ISDIR(rec.mode) && item->depth < pf->opts.depth) {
+			hcasfs_prefetch_queue(pf, HCASFS_PREFETCH_DIR,
+					      rec.obj_name, item->depth + 1);
+		} else if (S_ISREG(rec.mode) && rec.size &&
+			   rec.size <= pf->opts.file_size) {
+			if (hcasfs_prefetch_object(pf, rec.obj_name))
+				atomic_long_inc(&pf->errors);
+			else
+				atomic_long_inc(&pf->files);
+		}
+	}
+	buffered_view_release(&bv);
+
+out_put:
+	hcasfs_object_put(obj);
+	return result;
+}
+
+static void hcasfs_prefetch_work(struct work_struct *work)
+{
+	struct hcasfs_prefetch_worker *worker =
+		container_of(work, struct hcasfs_prefetch_worker, work);
+	struct hcasfs_prefetch *pf = worker->pf;
+	struct hcasfs_prefetch_item *item;
+	const struct cred *old_cred;
+	int result = 0;
+
+	old_cred = override_creds(hcasfs_creds(pf->sb));
+	for (;;) {
+		spin_lock(&pf->lock);
+		if (pf->stopping || list_empty(&pf->queue)) {
+			spin_unlock(&pf->lock);
+			break;
+		}
+		item = list_first_entry(&pf->queue, struct hcasfs_prefetch_item,
+					list);
+		list_del_init(&item->list);
+		pf->active++;
+		spin_unlock(&pf->lock);
+
+		switch (item->kind) {
+		case HCASFS_PREFETCH_DIR:
+			result = hcasfs_prefetch_dir(pf, item);
+			atomic_long_inc(&pf->dirs_done);
+			break;
+		case HCASFS_PREFETCH_OBJECT:
+			result = hcasfs_prefetch_object(pf, item->name);
+			atomic_long_inc(&pf->traced);
+			break;
+		case HCASFS_PREFETCH_TRACE:
+			result = hcasfs_prefetch_trace(pf, item);
+			break;
+		}
+		if (result)
+			atomic_long_inc(&pf->errors);
+
+		spin_lock(&pf->lock);
+		if (--pf->active == 0 && list_empty(&pf->queue) &&
+		    !pf->stopping) {
+			// Nothing can be queued once the walk is done.
+			pf->end = ktime_get();
+			hcasfs_prefetch_forget(pf);
+		}
+		spin_unlock(&pf->lock);
+	}
+	revert_creds(old_cred);
+}
+
+static int hcasfs_prefetch_show(struct seq_file *m, void *v)
+{
+	struct hcasfs_prefetch *pf = m->private;
+	const char *state;
+	ktime_t end;
+
+	spin_lock(&pf->lock);
+	end = pf->end;
+	if (pf->stopping)
+		state = "stopped";
+	else if (end)
+		state = "done";
+	else
+		state = "running";
+	spin_unlock(&pf->lock);
+
+	if (!end)
+		end = ktime_get();
+
+	seq_printf(m, "state: %s\n", state);
+	seq_printf(m, "dirs_queued: %ld\n", atomic_long_read(&pf->dirs_queued));
+	seq_printf(m, "dirs_done: %ld\n", atomic_long_read(&pf->dirs_done));
+	seq_printf(m, "files: %ld\n", atomic_long_read(&pf->files));
+	seq_printf(m, "traced: %ld\n", atomic_long_read(&pf->traced));
+	seq_printf(m, "errors: %ld\n", atomic_long_read(&pf->errors));
+	seq_printf(m, "elapsed_ms: %lld\n", ktime_ms_delta(end, pf->start));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hcasfs_prefetch);
+
+struct hcasfs_prefetch *
+hcasfs_prefetch_start(struct super_block *sb,
+		      const struct hcasfs_prefetch_opts *opts,
+		      char root_name[HCASFS_OBJECT_NAME_LEN],
+		      struct dentry *debugfs_dir)
+{
+	struct hcasfs_prefetch *pf;
+
+	pf = kzalloc(struct_size(pf, workers, opts->workers), GFP_KERNEL);
+	if (!pf)
+		return ERR_PTR(-ENOMEM);
+
+	pf->sb = sb;
+	pf->opts = *opts;
+	spin_lock_init(&pf->lock);
+	INIT_LIST_HEAD(&pf->queue);
+	hash_init(pf->seen);
+	atomic_long_set(&pf->dirs_queued, 0);
+	atomic_long_set(&pf->dirs_done, 0);
+	atomic_long_set(&pf->files, 0);
+	atomic_long_set(&pf->traced, 0);
+	atomic_long_set(&pf->errors, 0);
+	for (int i = 0; i < opts->workers; i++) {
+		INIT_WORK(&pf->workers[i].work, hcasfs_prefetch_work);
+		pf->workers[i].pf = pf;
+	}
+	pf->start = ktime_get();
+
+	pf->debugfs = debugfs_create_file("prefetch", 0444, debugfs_dir, pf,
+					  &hcasfs_prefetch_fops);
+
+	// The trace goes first so its objects, in the order the image used
+	// them last time, are read alongside the top of the tree walk.
+	if (opts->replay)
+		hcasfs_prefetch_queue(pf, HCASFS_PREFETCH_TRACE,
+				      opts->replay_name, 0);
+	if (opts->enabled)
+		hcasfs_prefetch_queue(pf, HCASFS_PREFETCH_DIR, root_name, 0);
+	return pf;
+}
+
+void hcasfs_prefetch_stop(struct hcasfs_prefetch *pf)
+{
+	if (!pf)
+		return;
+
+	debugfs_remove(pf->debugfs);
+
+	spin_lock(&pf->lock);
+	pf->stopping = true;
+	spin_unlock(&pf->lock);
+
+	for (int i = 0; i < pf->opts.workers; i++)
+		cancel_work_sync(&pf->workers[i].work);
+
+	hcasfs_prefetch_forget(pf);
+	kfree(pf);
+}
+
+int hcasfs_prefetch_init(void)
+{
+	hcasfs_prefetch_wq = alloc_workqueue("hcasfs_prefetch", WQ_UNBOUND, 0);
+	if (!hcasfs_prefetch_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void hcasfs_prefetch_exit(void)
+{
+	destroy_workqueue(hcasfs_prefetch_wq);
+}
@@ -0,0 +1,55 @@
+#ifndef _PREFETCH_H
+#define _PREFETCH_H
+
+#include <linux/types.h>
+
+#include "hcasfs.h"
+
+#define HCASFS_PREFETCH_DEPTH_ALL UINT_MAX
+#define HCASFS_PREFETCH_DEFAULT_WORKERS 4
+#define HCASFS_PREFETCH_MAX_WORKERS 64
+#define HCASFS_PREFETCH_DEFAULT_WINDOW (1 << 20)
+
+/* Mount options controlling the background prefetch of the directory tree. */
+struct hcasfs_prefetch_opts {
+	bool enabled;
+	/* Directory levels below the root to read. */
+	unsigned int depth;
+	/* Read ahead regular files up to this size, 0 disables. */
+	u64 file_size;
+	/* Number of directories being read at once. */
+	unsigned int workers;
+	/* Bytes each worker reads ahead before waiting for them. */
+	u64 window;
+	/* Read ahead the objects listed in the trace object replay_name, in
+	 * order, before walking the tree.
+	 */
+	bool replay;
+	char replay_name[HCASFS_OBJECT_NAME_LEN];
+};
+
+/* A prefetch walks the directory objects of a mount starting from its root
+ * object on an unbounded workqueue, pulling each directory through the object
+ * cache and reading its backing file ahead one window at a time, so at most
+ * workers * window bytes of prefetch I/O are in flight. It can also replay an
+ * access trace (see access_trace.h) recorded by an earlier mount of the same
+ * image. Progress is reported in the "prefetch" file of the mount's debugfs
+ * directory.
+ */
+struct hcasfs_prefetch;
+
+struct hcasfs_prefetch *
+hcasfs_prefetch_start(struct super_block *sb,
+		      const struct hcasfs_prefetch_opts *opts,
+		      char root_name[HCASFS_OBJECT_NAME_LEN],
+		      struct dentry *debugfs_dir);
+
+/* Stop a prefetch and wait for its workers to finish. Must be called before
+ * the super block's private data is released.
+ */
+void hcasfs_prefetch_stop(struct hcasfs_prefetch *pf);
+
+int hcasfs_prefetch_init(void);
+void hcasfs_prefetch_exit(void);
+
+#endif
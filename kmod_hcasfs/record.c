@@ -0,0 +1,158 @@
+/*
+ * HCAS Filesystem - Directory Records
+ *
+ * Decoding of the fixed and compact directory record layouts.
+ */
+
+#include "hcasfs.h"
+#include "object_cache.h"
+#include "record.h"
+
+struct hcasfs_record_cursor {
+	const char *data;
+	u32 len;
+	u32 off;
+	int err;
+};
+
+static u64 hcasfs_record_uvarint(struct hcasfs_record_cursor *c)
+{
+	u64 val = 0;
+
+	for (int shift = 0; shift < 64; shift += 7) {
+		u8 b;
+
+		if (c->off >= c->len)
+			break;
+		b = c->data[c->off++];
+		val |= (u64)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return val;
+	}
+	c->err = -EIO;
+	return 0;
+}
+
+static u64 hcasfs_record_varint(struct hcasfs_record_cursor *c)
+{
+	u64 val = hcasfs_record_uvarint(c);
+
+	// Zig-zag encoded as Go's binary.AppendVarint does.
+	return (val >> 1) ^ -(val & 1);
+}
+
+static bool hcasfs_record_has_content(u32 mode)
+{
+	return S_ISREG(mode) || S_ISDIR(mode) || S_ISLNK(mode);
+}
+
+/* Strip the inline flag from rec->mode, returning the length of the inline
+ * content or a negative error if the record cannot have any.
+ */
+static int hcasfs_record_inline_len(struct hcasfs_record *rec)
+{
+	rec->inline_content = rec->mode & HCASFS_RECORD_MODE_INLINE;
+	rec->mode &= ~HCASFS_RECORD_MODE_INLINE;
+	if (!rec->inline_content)
+		return 0;
+
+	if (S_ISDIR(rec->mode))
+		return 0;
+	if ((S_ISREG(rec->mode) || S_ISLNK(rec->mode)) &&
+	    rec->size <= HCASFS_INLINE_MAX)
+		return rec->size;
+	return -EIO;
+}
+
+static int hcasfs_record_read_compact(struct buffered_view *bv,
+				      struct hcasfs_inode_dir_info *dir_info,
+				      char *buf, loff_t *pos,
+				      struct hcasfs_record *rec)
+{
+	struct hcasfs_record_cursor c = {};
+	loff_t end = *pos;
+	int inline_len;
+
+	// Records are variable length; read as much as the largest could need.
+	c.data = buffered_view_read(bv, buf, HCASFS_RECORD_MAX, &end);
+	if (IS_ERR(c.data))
+		return PTR_ERR(c.data);
+	if (!c.data)
+		return -EIO;
+	c.len = end - *pos;
+
+	rec->name_len = hcasfs_record_uvarint(&c);
+	if (c.err || rec->name_len > NAME_MAX ||
+	    rec->name_len > c.len - c.off)
+		return -EIO;
+	rec->name = c.data + c.off;
+	c.off += rec->name_len;
+
+	rec->mode = hcasfs_record_uvarint(&c);
+	rec->parent_dep_index = hcasfs_record_uvarint(&c);
+	rec->uid = hcasfs_record_uvarint(&c);
+	rec->gid = hcasfs_record_uvarint(&c);
+	rec->nlink_dev = hcasfs_record_uvarint(&c);
+	rec->mtime = dir_info->time_base + hcasfs_record_uvarint(&c);
+	rec->atime = rec->mtime + hcasfs_record_varint(&c);
+	rec->ctime = rec->mtime + hcasfs_record_varint(&c);
+	rec->size = hcasfs_record_uvarint(&c);
+	if (c.err)
+		return c.err;
+
+	inline_len = hcasfs_record_inline_len(rec);
+	if (inline_len < 0)
+		return inline_len;
+
+	memset(rec->obj_name, 0, HCASFS_OBJECT_NAME_LEN);
+	if (rec->inline_content) {
+		if (c.len - c.off < (u32)inline_len)
+			return -EIO;
+		memcpy(rec->obj_name, c.data + c.off, inline_len);
+		c.off += inline_len;
+	} else if (hcasfs_record_has_content(rec->mode)) {
+		if (c.len - c.off < HCASFS_OBJECT_NAME_LEN)
+			return -EIO;
+		memcpy(rec->obj_name, c.data + c.off, HCASFS_OBJECT_NAME_LEN);
+		c.off += HCASFS_OBJECT_NAME_LEN;
+	}
+
+	*pos += c.off;
+	return 0;
+}
+
+int hcasfs_record_read(struct buffered_view *bv,
+		       struct hcasfs_inode_dir_info *dir_info, char *buf,
+		       loff_t *pos, struct hcasfs_record *rec)
+{
+	char *data;
+
+	if (dir_info->flags & HCASFS_DIR_FLAG_COMPACT_RECORDS)
+		return hcasfs_record_read_compact(bv, dir_info, buf, pos, rec);
+
+	data = buffered_view_read_full(bv, buf, 96, pos);
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+
+	rec->mode = get_unaligned_be32(data + 0);
+	rec->uid = get_unaligned_be32(data + 4);
+	rec->gid = get_unaligned_be32(data + 8);
+	rec->nlink_dev = get_unaligned_be64(data + 12);
+	rec->atime = get_unaligned_be64(data + 20);
+	rec->mtime = get_unaligned_be64(data + 28);
+	rec->ctime = get_unaligned_be64(data + 36);
+	rec->size = get_unaligned_be64(data + 44);
+	memcpy(rec->obj_name, data + 52, HCASFS_OBJECT_NAME_LEN);
+	rec->parent_dep_index = get_unaligned_be64(data + 84);
+	rec->name_len = get_unaligned_be32(data + 92);
+	if (rec->name_len > NAME_MAX || hcasfs_record_inline_len(rec) < 0)
+		return -EIO;
+
+	// The header may be overwritten by this read, everything needed from it
+	// has been copied out.
+	data = buffered_view_read_full(bv, buf, ALIGN(rec->name_len, 8), pos);
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+	rec->name = data;
+	return 0;
+}
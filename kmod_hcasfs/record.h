@@ -0,0 +1,56 @@
+#ifndef _RECORD_H
+#define _RECORD_H
+
+#include <linux/types.h>
+
+#include "hcasfs.h"
+
+struct hcasfs_inode_dir_info;
+
+/* A decoded directory record. Directories store records either in the fixed
+ * 96 byte layout of DirEntry.Encode or, with HCASFS_DIR_FLAG_COMPACT_RECORDS,
+ * in the variable length layout of hcasfs/compact_record.go.
+ */
+struct hcasfs_record {
+	u32 mode;
+	u32 uid;
+	u32 gid;
+	/* Link count of directories, device number of anything else */
+	u64 nlink_dev;
+	u64 atime;
+	u64 mtime;
+	u64 ctime;
+	u64 size;
+	u64 parent_dep_index;
+	/* Zeroed for modes without content. Holds the content itself, zero
+	 * padded, if inline_content is set.
+	 */
+	char obj_name[HCASFS_OBJECT_NAME_LEN];
+	/* Set for regular files and symlinks of at most HCASFS_INLINE_MAX bytes
+	 * and for empty directories, which have no backing object.
+	 */
+	bool inline_content;
+	/* Points into the view, valid until its next read or release */
+	const char *name;
+	u32 name_len;
+};
+
+/* Set in the encoded mode of records with inline content. */
+#define HCASFS_RECORD_MODE_INLINE (1U << 31)
+
+/* Largest inline content, the size of the object name it replaces. */
+#define HCASFS_INLINE_MAX HCASFS_OBJECT_NAME_LEN
+
+/* Largest encoded record of either layout, a compact record with a NAME_MAX
+ * name, maximal varints and an object name.
+ */
+#define HCASFS_RECORD_MAX 368
+
+/* Decode the record at *pos, advancing *pos to the following record. buf must
+ * have room for HCASFS_RECORD_MAX bytes.
+ */
+int hcasfs_record_read(struct buffered_view *bv,
+		       struct hcasfs_inode_dir_info *dir_info, char *buf,
+		       loff_t *pos, struct hcasfs_record *rec);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * HCAS Filesystem - Sharded Directories
+ *
+ * Routing of lookups and readdir positions through the tree of objects that
+ * huge directories are split into.
+ */
+
+#include "hcasfs.h"
+#include "object_cache.h"
+#include "shard.h"
+
+#include <linux/siphash.h>
+
+#define HCASFS_SHARD_SIZE 64
+
+int hcasfs_shard_read(struct buffered_view *bv,
+		      struct hcasfs_inode_dir_info *dir_info, u32 index,
+		      struct hcasfs_shard *shard)
+{
+	char buf[HCASFS_SHARD_SIZE];
+	char *data;
+	loff_t pos;
+
+	if (index >= dir_info->shard_count)
+		return -EIO;
+
+	pos = dir_info->shards_offset + HCASFS_SHARD_SIZE * (loff_t)index;
+	data = buffered_view_read_full(bv, buf, sizeof(buf), &pos);
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+
+	shard->min_hash = get_unaligned_be64(data + 0);
+	shard->base = get_unaligned_be64(data + 8);
+	shard->tree_size = get_unaligned_be64(data + 16);
+	shard->entry_count = get_unaligned_be32(data + 24);
+	memcpy(shard->name, data + 32, HCASFS_OBJECT_NAME_LEN);
+	return 0;
+}
+
+/* Find the last child whose smallest hash is at most hash. */
+static int hcasfs_shard_find_hash(struct buffered_view *bv,
+				  struct hcasfs_inode_dir_info *dir_info,
+				  u64 hash, struct hcasfs_shard *shard)
+{
+	char buf[8];
+	char *data;
+	loff_t pos;
+	u32 lo = 1;
+	u32 hi = dir_info->shard_count;
+
+	while (lo < hi) {
+		u32 mid = lo + (hi - lo) / 2;
+
+		pos = dir_info->shards_offset + HCASFS_SHARD_SIZE * (loff_t)mid;
+		data = buffered_view_read_full(bv, buf, sizeof(buf), &pos);
+		if (IS_ERR(data))
+			return PTR_ERR(data);
+
+		if (get_unaligned_be64(data) <= hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return hcasfs_shard_read(bv, dir_info, lo - 1, shard);
+}
+
+/* Find the child holding entry *pos, reducing *pos to a position within it. */
+static int hcasfs_shard_find_pos(struct buffered_view *bv,
+				 struct hcasfs_inode_dir_info *dir_info,
+				 u32 *pos, struct hcasfs_shard *shard)
+{
+	int result;
+
+	for (u32 i = 0; i < dir_info->shard_count; i++) {
+		result = hcasfs_shard_read(bv, dir_info, i, shard);
+		if (result)
+			return result;
+		if (*pos < shard->entry_count)
+			return 0;
+		*pos -= shard->entry_count;
+	}
+	return -EIO;
+}
+
+/* Walk from obj down to a leaf, picking children by name if set and by *pos
+ * otherwise.
+ */
+static struct hcasfs_object *hcasfs_shard_descend(struct super_block *sb,
+						  struct hcasfs_object *obj,
+						  const struct qstr *name,
+						  u32 *pos, u64 *base)
+{
+	const struct cred *cred = hcasfs_creds(sb);
+	struct hcasfs_inode_dir_info *dir_info;
+	struct hcasfs_object *node = obj;
+	struct hcasfs_object *child;
+	struct hcasfs_shard shard;
+	struct buffered_view bv;
+	int result = -EIO;
+
+	*base = 0;
+	for (int depth = 0; depth <= HCASFS_SHARD_MAX_DEPTH; depth++) {
+		dir_info = hcasfs_object_dir_info(node, cred);
+		if (IS_ERR(dir_info)) {
+			result = PTR_ERR(dir_info);
+			break;
+		}
+		if (!(dir_info->flags & HCASFS_DIR_FLAG_SHARDED)) {
+			if (WARN_ON(node == obj))
+				return ERR_PTR(-EIO);
+			return node;
+		}
+
+		result = hcasfs_object_dir_view(sb, node, &bv);
+		if (result)
+			break;
+		if (name)
+			result = hcasfs_shard_find_hash(
+				&bv, dir_info,
+				siphash(name->name, name->len, &dir_info->salt),
+				&shard);
+		else
+			result = hcasfs_shard_find_pos(&bv, dir_info, pos,
+						       &shard);
+		buffered_view_release(&bv);
+		if (result)
+			break;
+
+		child = hcasfs_object_get(sb, shard.name);
+		if (node != obj)
+			hcasfs_object_put(node);
+		if (IS_ERR(child))
+			return child;
+		hcasfs_trace_access(sb, shard.name);
+
+		node = child;
+		*base += shard.base;
+		result = -EIO;
+	}
+
+	if (node != obj)
+		hcasfs_object_put(node);
+	return ERR_PTR(result);
+}
+
+struct hcasfs_object *hcasfs_shard_route(struct super_block *sb,
+					 struct hcasfs_object *obj,
+					 const struct qstr *name, u64 *base)
+{
+	return hcasfs_shard_descend(sb, obj, name, NULL, base);
+}
+
+struct hcasfs_object *hcasfs_shard_seek(struct super_block *sb,
+					struct hcasfs_object *obj, u32 *pos,
+					u64 *base)
+{
+	return hcasfs_shard_descend(sb, obj, NULL, pos, base);
+}
@@ -0,0 +1,52 @@
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include <linux/types.h>
+
+#include "hcasfs.h"
+
+struct hcasfs_object;
+struct hcasfs_inode_dir_info;
+struct qstr;
+
+/* Huge directories are split into a tree of objects by the SipHash of their
+ * names, see hcasfs/shard.go. Sharded nodes (HCASFS_DIR_FLAG_SHARDED) hold a
+ * list of child references ordered by the smallest hash each child holds;
+ * leaves are ordinary directory objects. The inode offset of an entry is its
+ * record's ParentDepIndex plus the bases of the references on its path.
+ */
+struct hcasfs_shard {
+	u64 min_hash;
+	u64 base;
+	u64 tree_size;
+	u32 entry_count;
+	char name[HCASFS_OBJECT_NAME_LEN];
+};
+
+/* Bound on the depth of a sharded directory so malformed objects cannot send
+ * lookups on an unbounded walk.
+ */
+#define HCASFS_SHARD_MAX_DEPTH 16
+
+/* Read child reference index of a sharded node. */
+int hcasfs_shard_read(struct buffered_view *bv,
+		      struct hcasfs_inode_dir_info *dir_info, u32 index,
+		      struct hcasfs_shard *shard);
+
+/* Descend from the sharded directory obj to the leaf object that would hold
+ * name. Returns the leaf with a user reference and sets *base to the sum of
+ * the bases on the path.
+ */
+struct hcasfs_object *hcasfs_shard_route(struct super_block *sb,
+					 struct hcasfs_object *obj,
+					 const struct qstr *name, u64 *base);
+
+/* Descend from the sharded directory obj to the leaf object holding entry *pos
+ * in readdir order. Returns the leaf with a user reference, sets *pos to the
+ * entry's position within the leaf and *base as for hcasfs_shard_route.
+ */
+struct hcasfs_object *hcasfs_shard_seek(struct super_block *sb,
+					struct hcasfs_object *obj, u32 *pos,
+					u64 *base);
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * HCAS Filesystem - Statistics
+ *
+ * Per mount counters and latency histograms exported through debugfs.
+ */
+
+#include "hcasfs.h"
+#include "stats.h"
+
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+static const char *const hcasfs_stat_names[HCASFS_STAT_COUNT] = {
+	[HCASFS_STAT_LOOKUPS] = "lookups",
+	[HCASFS_STAT_LOOKUPS_NEGATIVE] = "lookups_negative",
+	[HCASFS_STAT_LOOKUP_COLLISIONS] = "lookup_collisions",
+	[HCASFS_STAT_BLOOM_REJECTS] = "bloom_rejects",
+	[HCASFS_STAT_OBJECT_RESOLVES] = "object_resolves",
+	[HCASFS_STAT_BACKING_OPENS] = "backing_opens",
+	[HCASFS_STAT_BACKING_OPENS_SHARED] = "backing_opens_shared",
+	[HCASFS_STAT_BLOCK_READS] = "block_reads",
+	[HCASFS_STAT_BLOCK_READ_BYTES] = "block_read_bytes",
+	[HCASFS_STAT_READDIR_ENTRIES] = "readdir_entries",
+	[HCASFS_STAT_INODE_ALLOCS] = "inode_allocs",
+	[HCASFS_STAT_INODE_EVICTS] = "inode_evicts",
+};
+
+static const char *const hcasfs_hist_names[HCASFS_HIST_COUNT] = {
+	[HCASFS_HIST_LOOKUP] = "lookup_ns",
+	[HCASFS_HIST_BACKING_OPEN] = "backing_open_ns",
+};
+
+static int hcasfs_stats_show(struct seq_file *m, void *v)
+{
+	struct hcasfs_stats *stats = m->private;
+	u64 hist[HCASFS_HIST_BUCKETS];
+	int cpu;
+
+	for (int i = 0; i < HCASFS_STAT_COUNT; i++) {
+		u64 total = 0;
+
+		for_each_possible_cpu(cpu)
+			total += per_cpu_ptr(stats->cpu, cpu)->counters[i];
+		seq_printf(m, "%s: %llu\n", hcasfs_stat_names[i], total);
+	}
+
+	for (int i = 0; i < HCASFS_HIST_COUNT; i++) {
+		memset(hist, 0, sizeof(hist));
+		for_each_possible_cpu(cpu) {
+			struct hcasfs_stats_cpu *c = per_cpu_ptr(stats->cpu, cpu);
+
+			for (int b = 0; b < HCASFS_HIST_BUCKETS; b++)
+				hist[b] += c->hist[i][b];
+		}
+
+		seq_printf(m, "%s:\n", hcasfs_hist_names[i]);
+		for (int b = 0; b < HCASFS_HIST_BUCKETS; b++) {
+			if (!hist[b])
+				continue;
+			seq_printf(m, "  < %llu: %llu\n", 1ULL << b, hist[b]);
+		}
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hcasfs_stats);
+
+struct hcasfs_stats *hcasfs_stats_create(struct dentry *debugfs_dir)
+{
+	struct hcasfs_stats *stats;
+
+	stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return NULL;
+
+	stats->cpu = alloc_percpu(struct hcasfs_stats_cpu);
+	if (!stats->cpu) {
+		kfree(stats);
+		return NULL;
+	}
+
+	stats->debugfs = debugfs_create_file("stats", 0444, debugfs_dir, stats,
+					     &hcasfs_stats_fops);
+	return stats;
+}
+
+void hcasfs_stats_destroy(struct hcasfs_stats *stats)
+{
+	if (!stats)
+		return;
+
+	debugfs_remove(stats->debugfs);
+	free_percpu(stats->cpu);
+	kfree(stats);
+}
@@ -0,0 +1,75 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/types.h>
+
+enum hcasfs_stat {
+	HCASFS_STAT_LOOKUPS,
+	HCASFS_STAT_LOOKUPS_NEGATIVE,
+	/* Records probed whose name checksum matched but name did not. */
+	HCASFS_STAT_LOOKUP_COLLISIONS,
+	/* Lookups answered negatively by a directory's Bloom filter. */
+	HCASFS_STAT_BLOOM_REJECTS,
+	HCASFS_STAT_OBJECT_RESOLVES,
+	HCASFS_STAT_BACKING_OPENS,
+	HCASFS_STAT_BACKING_OPENS_SHARED,
+	HCASFS_STAT_BLOCK_READS,
+	HCASFS_STAT_BLOCK_READ_BYTES,
+	HCASFS_STAT_READDIR_ENTRIES,
+	HCASFS_STAT_INODE_ALLOCS,
+	HCASFS_STAT_INODE_EVICTS,
+	HCASFS_STAT_COUNT,
+};
+
+enum hcasfs_hist {
+	HCASFS_HIST_LOOKUP,
+	HCASFS_HIST_BACKING_OPEN,
+	HCASFS_HIST_COUNT,
+};
+
+/* Bucket i counts latencies in [2^(i-1), 2^i) nanoseconds. */
+#define HCASFS_HIST_BUCKETS 40
+
+struct hcasfs_stats_cpu {
+	u64 counters[HCASFS_STAT_COUNT];
+	u64 hist[HCASFS_HIST_COUNT][HCASFS_HIST_BUCKETS];
+};
+
+/* Per mount counters and latency histograms, shown in the "stats" file of the
+ * mount's debugfs directory.
+ */
+struct hcasfs_stats {
+	struct hcasfs_stats_cpu __percpu *cpu;
+	struct dentry *debugfs;
+};
+
+struct hcasfs_stats *hcasfs_stats_create(struct dentry *debugfs_dir);
+void hcasfs_stats_destroy(struct hcasfs_stats *stats);
+
+static inline void hcasfs_stats_add(struct hcasfs_stats *stats,
+				    enum hcasfs_stat stat, u64 n)
+{
+	this_cpu_add(stats->cpu->counters[stat], n);
+}
+
+static inline void hcasfs_stats_inc(struct hcasfs_stats *stats,
+				    enum hcasfs_stat stat)
+{
+	this_cpu_inc(stats->cpu->counters[stat]);
+}
+
+/* Record the time elapsed since start, a ktime_get_ns() timestamp. */
+static inline void hcasfs_stats_time(struct hcasfs_stats *stats,
+				     enum hcasfs_hist hist, u64 start)
+{
+	int bucket = fls64(ktime_get_ns() - start);
+
+	if (bucket >= HCASFS_HIST_BUCKETS)
+		bucket = HCASFS_HIST_BUCKETS - 1;
+	this_cpu_inc(stats->cpu->hist[hist][bucket]);
+}
+
+#endif
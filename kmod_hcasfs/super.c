@@ -6,14 +6,33 @@
 
 #include "hcasfs.h"
 #include "inode.h"
+#include "object_cache.h"
+#include "prefetch.h"
+#include "access_trace.h"
+#include "hcasfs_trace.h"
+#include "stats.h"
 
+#include <linux/debugfs.h>
 #include <linux/init.h>
+#include <linux/mount.h>
 #include <linux/uaccess.h>
 
+#define HCASFS_FANOUT_DIRS 256
+
 struct hcasfs_sb_info {
 	struct path hcas_data_dir;
+	/* Pinned data/<xx> fan-out directories, NULL until found. */
+	struct dentry *fanout[HCASFS_FANOUT_DIRS];
 	char root_object_name[HCASFS_OBJECT_NAME_LEN];
 	const struct cred *creator_cred;
+	struct hcasfs_prefetch_opts prefetch_opts;
+	struct hcasfs_prefetch *prefetch;
+	unsigned int trace_seconds;
+	unsigned int trace_entries;
+	struct hcasfs_trace *trace;
+	struct hcasfs_stats *stats;
+	/* Per mount debugfs directory, named by the anonymous device number. */
+	struct dentry *debugfs;
 };
 
 const struct cred *hcasfs_creds(struct super_block *sb)
@@ -23,6 +42,20 @@ const struct cred *hcasfs_creds(struct super_block *sb)
 	return sb_info->creator_cred;
 }
 
+struct hcasfs_stats *hcasfs_sb_stats(struct super_block *sb)
+{
+	struct hcasfs_sb_info *sb_info = sb->s_fs_info;
+
+	return sb_info->stats;
+}
+
+const struct path *hcasfs_data_dir(struct super_block *sb)
+{
+	struct hcasfs_sb_info *sb_info = sb->s_fs_info;
+
+	return &sb_info->hcas_data_dir;
+}
+
 static int hcas_parse_hex_digit(char digit)
 {
 	if ('0' <= digit && digit <= '9')
@@ -57,11 +90,31 @@ static int hcas_parse_hex_name(char *hex_name,
 	return 0;
 }
 
-enum hcasfs_param { Opt_root_object, Opt_err };
+enum hcasfs_param {
+	Opt_root_object,
+	Opt_prefetch_all,
+	Opt_prefetch_depth,
+	Opt_prefetch_file_size,
+	Opt_prefetch_workers,
+	Opt_prefetch_window,
+	Opt_prefetch_trace,
+	Opt_trace_seconds,
+	Opt_trace_entries,
+	Opt_err
+};
 
-static const match_table_t hcasfs_tokens = { { Opt_root_object,
-					       "root_object=%s" },
-					     { Opt_err, NULL } };
+static const match_table_t hcasfs_tokens = {
+	{ Opt_root_object, "root_object=%s" },
+	{ Opt_prefetch_all, "prefetch=all" },
+	{ Opt_prefetch_depth, "prefetch_depth=%u" },
+	{ Opt_prefetch_file_size, "prefetch_file_size=%s" },
+	{ Opt_prefetch_workers, "prefetch_workers=%u" },
+	{ Opt_prefetch_window, "prefetch_window=%s" },
+	{ Opt_prefetch_trace, "prefetch_trace=%s" },
+	{ Opt_trace_seconds, "trace_seconds=%u" },
+	{ Opt_trace_entries, "trace_entries=%u" },
+	{ Opt_err, NULL }
+};
 
 /* Parse mount options */
 static int hcasfs_parse_options(char *options, struct hcasfs_sb_info *sbi)
@@ -70,6 +123,11 @@ static int hcasfs_parse_options(char *options, struct hcasfs_sb_info *sbi)
 	substring_t args[MAX_OPT_ARGS];
 	int token;
 	int root_object_found = 0;
+	unsigned int uval;
+
+	sbi->prefetch_opts.workers = HCASFS_PREFETCH_DEFAULT_WORKERS;
+	sbi->prefetch_opts.window = HCASFS_PREFETCH_DEFAULT_WINDOW;
+	sbi->trace_entries = HCASFS_TRACE_DEFAULT_ENTRIES;
 
 	if (!options) {
 		printk(KERN_ERR
@@ -94,6 +152,78 @@ static int hcasfs_parse_options(char *options, struct hcasfs_sb_info *sbi)
 						sbi->root_object_name)) {
 				printk(KERN_ERR
 				       "hcasfs: Failed to parse root_object name\n");
+				kfree(obj_name);
+				return -EINVAL;
+			}
+			kfree(obj_name);
+			break;
+
+		case Opt_prefetch_trace:
+			char *trace_name = match_strdup(&args[0]);
+
+			if (!trace_name)
+				return -ENOMEM;
+			if (hcas_parse_hex_name(trace_name,
+						sbi->prefetch_opts.replay_name)) {
+				printk(KERN_ERR
+				       "hcasfs: Failed to parse prefetch_trace name\n");
+				kfree(trace_name);
+				return -EINVAL;
+			}
+			kfree(trace_name);
+			sbi->prefetch_opts.replay = true;
+			break;
+
+		case Opt_trace_seconds:
+			if (match_uint(&args[0], &sbi->trace_seconds))
+				return -EINVAL;
+			break;
+
+		case Opt_trace_entries:
+			if (match_uint(&args[0], &uval) || uval == 0 ||
+			    uval > HCASFS_TRACE_MAX_ENTRIES) {
+				printk(KERN_ERR
+				       "hcasfs: trace_entries must be between 1 and %d\n",
+				       HCASFS_TRACE_MAX_ENTRIES);
+				return -EINVAL;
+			}
+			sbi->trace_entries = uval;
+			break;
+
+		case Opt_prefetch_all:
+			sbi->prefetch_opts.enabled = true;
+			sbi->prefetch_opts.depth = HCASFS_PREFETCH_DEPTH_ALL;
+			break;
+
+		case Opt_prefetch_depth:
+			if (match_uint(&args[0], &uval))
+				return -EINVAL;
+			sbi->prefetch_opts.enabled = true;
+			sbi->prefetch_opts.depth = uval;
+			break;
+
+		case Opt_prefetch_file_size:
+			if (match_u64(&args[0], &sbi->prefetch_opts.file_size))
+				return -EINVAL;
+			break;
+
+		case Opt_prefetch_workers:
+			if (match_uint(&args[0], &uval) || uval == 0 ||
+			    uval > HCASFS_PREFETCH_MAX_WORKERS) {
+				printk(KERN_ERR
+				       "hcasfs: prefetch_workers must be between 1 and %d\n",
+				       HCASFS_PREFETCH_MAX_WORKERS);
+				return -EINVAL;
+			}
+			sbi->prefetch_opts.workers = uval;
+			break;
+
+		case Opt_prefetch_window:
+			if (match_u64(&args[0], &sbi->prefetch_opts.window) ||
+			    sbi->prefetch_opts.window < PAGE_SIZE) {
+				printk(KERN_ERR
+				       "hcasfs: prefetch_window must be at least %lu\n",
+				       PAGE_SIZE);
 				return -EINVAL;
 			}
 			break;
@@ -124,6 +254,11 @@ static int hcasfs_parse_options(char *options, struct hcasfs_sb_info *sbi)
 static void hcasfs_free_sb_info(struct hcasfs_sb_info *sbi)
 {
 	if (sbi) {
+		hcasfs_trace_destroy(sbi->trace);
+		hcasfs_stats_destroy(sbi->stats);
+		debugfs_remove_recursive(sbi->debugfs);
+		for (int i = 0; i < HCASFS_FANOUT_DIRS; i++)
+			dput(sbi->fanout[i]);
 		path_put(&sbi->hcas_data_dir);
 		if (sbi->creator_cred)
 			put_cred(sbi->creator_cred);
@@ -134,11 +269,61 @@ static void hcasfs_free_sb_info(struct hcasfs_sb_info *sbi)
 /* Put superblock - cleanup private data */
 static void hcasfs_put_super(struct super_block *sb)
 {
+	struct hcasfs_sb_info *sbi = sb->s_fs_info;
+
 	printk(KERN_INFO "hcasfs: Releasing superblock\n");
-	hcasfs_free_sb_info(sb->s_fs_info);
+
+	hcasfs_prefetch_stop(sbi->prefetch);
+
+	/* All inodes are gone; don't let cached objects pin the backing mount. */
+	hcasfs_object_cache_prune(sbi->hcas_data_dir.dentry);
+	hcasfs_free_sb_info(sbi);
 	sb->s_fs_info = NULL;
 }
 
+/* Lookup (and pin) the data/<xx> fan-out directory for the given name
+ * prefix. Must be called with the mount creds. Missing directories are not
+ * cached since objects with that prefix may be added to the store later.
+ */
+static struct dentry *hcasfs_fanout_dir(struct hcasfs_sb_info *sbi, u8 prefix)
+{
+	struct dentry *data_dir = sbi->hcas_data_dir.dentry;
+	struct dentry *dentry;
+	char name[2];
+
+	dentry = READ_ONCE(sbi->fanout[prefix]);
+	if (dentry)
+		return dentry;
+
+	name[0] = hcas_nibble_to_hex_digit(prefix >> 4);
+	name[1] = hcas_nibble_to_hex_digit(prefix & 0xf);
+	dentry = lookup_one_unlocked(mnt_idmap(sbi->hcas_data_dir.mnt), name,
+				     data_dir, sizeof(name));
+	if (IS_ERR(dentry))
+		return dentry;
+	if (d_really_is_negative(dentry) || !d_is_dir(dentry)) {
+		dput(dentry);
+		return ERR_PTR(-ENOENT);
+	}
+
+	if (cmpxchg(&sbi->fanout[prefix], NULL, dentry) != NULL) {
+		dput(dentry);
+		dentry = sbi->fanout[prefix];
+	}
+	return dentry;
+}
+
+/* Pin all fan-out directories that exist at mount time. */
+static void hcasfs_pin_fanout_dirs(struct hcasfs_sb_info *sbi)
+{
+	const struct cred *old_cred;
+
+	old_cred = override_creds(sbi->creator_cred);
+	for (int i = 0; i < HCASFS_FANOUT_DIRS; i++)
+		hcasfs_fanout_dir(sbi, i);
+	revert_creds(old_cred);
+}
+
 /* Superblock operations */
 static const struct super_operations hcasfs_sops = {
 	.statfs = simple_statfs,
@@ -189,6 +374,32 @@ int hcasfs_fill_super(struct super_block *sb, void *data, int silent)
 	/* Store private data in superblock */
 	sb->s_fs_info = sbi;
 
+	hcasfs_pin_fanout_dirs(sbi);
+
+	char debugfs_name[32];
+
+	snprintf(debugfs_name, sizeof(debugfs_name), "%u:%u",
+		 MAJOR(sb->s_dev), MINOR(sb->s_dev));
+	sbi->debugfs = debugfs_create_dir(debugfs_name, hcasfs_debugfs_root);
+
+	sbi->stats = hcasfs_stats_create(sbi->debugfs);
+	if (!sbi->stats) {
+		ret = -ENOMEM;
+		goto err_sbi;
+	}
+
+	/* Start tracing before the root is resolved so it is the first entry. */
+	if (sbi->trace_seconds) {
+		sbi->trace = hcasfs_trace_create(sbi->trace_seconds,
+						 sbi->trace_entries,
+						 sbi->debugfs);
+		if (IS_ERR(sbi->trace)) {
+			ret = PTR_ERR(sbi->trace);
+			sbi->trace = NULL;
+			goto err_sbi;
+		}
+	}
+
 	/* Set superblock parameters */
 	sb->s_magic = HCASFS_MAGIC;
 	sb->s_op = &hcasfs_sops;
@@ -197,14 +408,14 @@ int hcasfs_fill_super(struct super_block *sb, void *data, int silent)
 	sb->s_flags = SB_RDONLY;
 
 	/* Create root inode */
-	root_inode = hcasfs_new_inode(sb, sbi->root_object_name);
+	root_inode = hcasfs_iget(sb, 1, sbi->root_object_name);
 	if (IS_ERR(root_inode)) {
 		printk(KERN_ERR "hcasfs: Failed to allocate root inode\n");
-		return PTR_ERR(root_inode);
+		ret = PTR_ERR(root_inode);
+		goto err_sbi;
 	}
 
 	/* Set root inode attributes */
-	root_inode->i_ino = 1;
 	root_inode->i_mode = S_IFDIR | 0755;
 
 	struct timespec64 now = current_time(root_inode);
@@ -218,50 +429,109 @@ int hcasfs_fill_super(struct super_block *sb, void *data, int silent)
 	root_inode->i_op = &hcasfs_dir_inode_ops;
 	root_inode->i_fop = &hcasfs_dir_ops;
 	set_nlink(root_inode, 2);
+	unlock_new_inode(root_inode);
+
+	/* Resolve the root object now so a bad root_object fails the mount. */
+	ret = PTR_ERR_OR_ZERO(hcasfs_inode_object(root_inode));
+	if (ret) {
+		printk(KERN_ERR "hcasfs: Failed to open root object: %d\n",
+		       ret);
+		iput(root_inode);
+		goto err_sbi;
+	}
 
-	/* Create root dentry */
+	/* Create root dentry (releases the inode on failure) */
 	root_dentry = d_make_root(root_inode);
 	if (!root_dentry) {
 		printk(KERN_ERR "hcasfs: Failed to allocate root dentry\n");
-		iput(root_inode); /* Release inode reference */
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto err_sbi;
 	}
 
 	sb->s_root = root_dentry;
+
+	if (sbi->prefetch_opts.enabled || sbi->prefetch_opts.replay) {
+		sbi->prefetch = hcasfs_prefetch_start(sb, &sbi->prefetch_opts,
+						      sbi->root_object_name,
+						      sbi->debugfs);
+		// The mount is still usable without the prefetch.
+		if (IS_ERR(sbi->prefetch)) {
+			printk(KERN_WARNING
+			       "hcasfs: Failed to start prefetch: %ld\n",
+			       PTR_ERR(sbi->prefetch));
+			sbi->prefetch = NULL;
+		}
+	}
+
 	printk(KERN_INFO "hcasfs: Superblock filled successfully\n");
 	return 0;
+
+err_sbi:
+	/* put_super is only called once s_root is set. */
+	sb->s_fs_info = NULL;
+	hcasfs_object_cache_prune(sbi->hcas_data_dir.dentry);
+	hcasfs_free_sb_info(sbi);
+	return ret;
 }
 
-/* path_buf should be at least HCASFS_MAX_OBJECT_PATH_LEN in size */
-static void hcas_build_object_path(char *path_buf,
-				   char obj_name[HCASFS_OBJECT_NAME_LEN])
+void hcasfs_trace_access(struct super_block *sb,
+			 char name[HCASFS_OBJECT_NAME_LEN])
 {
-	path_buf[2] = '/';
-	for (int i = 0; i < HCASFS_OBJECT_NAME_LEN; i++) {
-		int offset = 2 * i + (i ? 1 : 0);
+	struct hcasfs_sb_info *sbi = sb->s_fs_info;
 
-		path_buf[offset + 0] =
+	hcasfs_trace_record(sbi->trace, name);
+}
+
+/* Write the hex file name of the object within its fan-out directory. */
+static void hcas_build_object_file_name(char *name_buf,
+					char obj_name[HCASFS_OBJECT_NAME_LEN])
+{
+	for (int i = 1; i < HCASFS_OBJECT_NAME_LEN; i++) {
+		name_buf[2 * i - 2] =
 			hcas_nibble_to_hex_digit((obj_name[i] >> 4) & 0xf);
-		path_buf[offset + 1] =
+		name_buf[2 * i - 1] =
 			hcas_nibble_to_hex_digit(obj_name[i] & 0xf);
 	}
-	path_buf[1 + HCASFS_OBJECT_NAME_LEN * 2] = 0;
 }
 
 int hcasfs_lookup_object(struct super_block *sb,
-		         char obj_name[HCASFS_OBJECT_NAME_LEN], struct path *out)
+			 char obj_name[HCASFS_OBJECT_NAME_LEN], struct path *out)
 {
-	char rel_path[HCASFS_MAX_OBJECT_PATH_LEN];
+	char file_name[(HCASFS_OBJECT_NAME_LEN - 1) * 2];
 	struct hcasfs_sb_info *sbi = sb->s_fs_info;
 	const struct cred *old_cred;
-	int result;
+	struct dentry *parent;
+	struct dentry *dentry;
+	u64 start = ktime_get_ns();
+	int result = 0;
 
-	hcas_build_object_path(rel_path, obj_name);
+	hcas_build_object_file_name(file_name, obj_name);
+	hcasfs_stats_inc(sbi->stats, HCASFS_STAT_OBJECT_RESOLVES);
 
 	old_cred = override_creds(sbi->creator_cred);
-	result = vfs_path_lookup(sbi->hcas_data_dir.dentry,
-				 sbi->hcas_data_dir.mnt, rel_path, LOOKUP_FOLLOW,
-				 out);
+	parent = hcasfs_fanout_dir(sbi, obj_name[0]);
+	if (IS_ERR(parent)) {
+		result = PTR_ERR(parent);
+		goto out;
+	}
+
+	dentry = lookup_one_unlocked(mnt_idmap(sbi->hcas_data_dir.mnt),
+				     file_name, parent, sizeof(file_name));
+	if (IS_ERR(dentry)) {
+		result = PTR_ERR(dentry);
+		goto out;
+	}
+	if (d_really_is_negative(dentry)) {
+		dput(dentry);
+		result = -ENOENT;
+		goto out;
+	}
+
+	out->mnt = mntget(sbi->hcas_data_dir.mnt);
+	out->dentry = dentry;
+out:
 	revert_creds(old_cred);
+	trace_hcasfs_lookup_object(sb, obj_name, ktime_get_ns() - start,
+				   result);
 	return result;
 }
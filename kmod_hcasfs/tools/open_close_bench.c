@@ -0,0 +1,122 @@
+/*
+ * HCAS Filesystem - open/close microbenchmark
+ *
+ * Times open(2)/close(2) pairs on a file, optionally reading the first block
+ * of each open. With -k a descriptor to the file is held open for the whole
+ * run, which lets hcasfs reuse the backing file of the held open.
+ *
+ * Usage: open_close_bench [-n iterations] [-t threads] [-r] [-k] <path>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *bench_path;
+static long iterations = 100000;
+static int do_read;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *bench_thread(void *arg)
+{
+	char buf[4096];
+	long i;
+
+	for (i = 0; i < iterations; i++) {
+		int fd = open(bench_path, O_RDONLY);
+
+		if (fd < 0) {
+			fprintf(stderr, "open %s: %s\n", bench_path,
+				strerror(errno));
+			exit(1);
+		}
+		if (do_read && read(fd, buf, sizeof(buf)) < 0) {
+			fprintf(stderr, "read %s: %s\n", bench_path,
+				strerror(errno));
+			exit(1);
+		}
+		close(fd);
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t *tids;
+	int threads = 1;
+	int keep_open = 0;
+	int keep_fd = -1;
+	double start, elapsed;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "n:t:rk")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atol(optarg);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'r':
+			do_read = 1;
+			break;
+		case 'k':
+			keep_open = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-n iterations] [-t threads] [-r] [-k] <path>\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (optind != argc - 1 || iterations <= 0 || threads <= 0) {
+		fprintf(stderr,
+			"usage: %s [-n iterations] [-t threads] [-r] [-k] <path>\n",
+			argv[0]);
+		return 2;
+	}
+	bench_path = argv[optind];
+
+	if (keep_open) {
+		keep_fd = open(bench_path, O_RDONLY);
+		if (keep_fd < 0) {
+			fprintf(stderr, "open %s: %s\n", bench_path,
+				strerror(errno));
+			return 1;
+		}
+	}
+
+	tids = calloc(threads, sizeof(*tids));
+	if (!tids)
+		return 1;
+
+	start = now_ns();
+	for (i = 0; i < threads; i++)
+		pthread_create(&tids[i], NULL, bench_thread, NULL);
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	elapsed = now_ns() - start;
+
+	printf("%ld opens x %d threads: %.0f ns/open, %.0f opens/s\n",
+	       iterations, threads, elapsed / iterations,
+	       iterations * threads / (elapsed / 1e9));
+
+	if (keep_fd >= 0)
+		close(keep_fd);
+	free(tids);
+	return 0;
+}
@@ -75,8 +75,13 @@ const (
 	SIGTERM = unix.SIGTERM
 	SIGTRAP = unix.SIGTRAP
 
+	PROT_READ  = unix.PROT_READ
+	MAP_SHARED = unix.MAP_SHARED
+
 	F_WRLCK  = unix.F_WRLCK
 	F_SETLKW = unix.F_SETLKW
+
+	FADV_WILLNEED = unix.FADV_WILLNEED
 )
 
 type Flock_t = unix.Flock_t
@@ -311,3 +316,23 @@ func FcntlFlock(fd uintptr, cmd int, lk *Flock_t) error {
 		return unix.FcntlFlock(fd, cmd, lk)
 	})
 }
+
+func Fadvise(fd int, offset int64, length int64, advice int) error {
+	return RetrySyscallE(func() error {
+		return unix.Fadvise(fd, offset, length, advice)
+	})
+}
+
+func Mmap(fd int, offset int64, length int, prot int, flags int) ([]byte, error) {
+	var data []byte
+	err := RetrySyscallE(func() error {
+		var err error
+		data, err = unix.Mmap(fd, offset, length, prot, flags)
+		return err
+	})
+	return data, err
+}
+
+func Munmap(b []byte) error {
+	return unix.Munmap(b)
+}